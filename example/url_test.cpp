@@ -61,4 +61,17 @@ int main()
 		url.set_path("hello");
 		std::cout << url.to_string() << std::endl;
 	}
+	{
+		swarm::url url("HTTP://Example.ORG:80/a/./b/../c?y=2&x=1&y=1#fragment");
+		std::cout << "original: " << url.to_string() << std::endl;
+		std::cout << "canonical: " << url.to_canonical() << std::endl;
+		std::cout << "canonical with sorted query: " << url.to_canonical(swarm::url::canonical_sort_query) << std::endl;
+
+		swarm::url other("http://example.org/a/c?x=1&y=2&y=1");
+		std::cout << ((url.fingerprint(swarm::url::canonical_sort_query) == other.fingerprint(swarm::url::canonical_sort_query))
+			? "fingerprints are equal" : "FAIL") << std::endl;
+
+		url.set_path("/d");
+		std::cout << ((url.to_string().find(":80/d?y=2&x=1&y=1#") != std::string::npos) ? "cache is reset" : "FAIL") << std::endl;
+	}
 }
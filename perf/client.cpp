@@ -15,8 +15,7 @@
  */
 
 #include <swarm/urlfetcher/url_fetcher.hpp>
-#include <swarm/urlfetcher/boost_event_loop.hpp>
-#include <swarm/urlfetcher/ev_event_loop.hpp>
+#include <swarm/urlfetcher/sharded_url_fetcher.hpp>
 #include <swarm/urlfetcher/stream.hpp>
 #include <list>
 #include <iostream>
@@ -24,12 +23,12 @@
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <future>
 
 #include <iostream>
 #include <blackhole/utils/atomic.hpp>
 
 #include <boost/program_options.hpp>
-#include <boost/thread.hpp>
 
 #include "timer.hpp"
 
@@ -74,16 +73,6 @@ struct request_handler_functor {
 	}
 };
 
-struct io_service_runner
-{
-	boost::asio::io_service *service;
-
-	void operator()() const
-	{
-		service->run();
-	}
-};
-
 int main(int argc, char *argv[])
 {
         namespace bpo = boost::program_options;
@@ -92,7 +81,8 @@ int main(int argc, char *argv[])
 
         std::string url;
 
-	long request_num, chunk_num, connections_limit;
+	long request_num, chunk_num, connections_limit, host_connections_limit, streams_limit, threads_num;
+	std::string http2, routing;
 
         generic.add_options()
                 ("help", "This help message")
@@ -100,6 +90,11 @@ int main(int argc, char *argv[])
                 ("requests", bpo::value<long>(&request_num)->default_value(100000), "Number of test calls")
                 ("chunk", bpo::value<long>(&chunk_num)->default_value(1000), "Send this many requests and then synchronously wait for all of them to complete")
 		("connections", bpo::value<long>(&connections_limit)->default_value(100), "Number of connections limit")
+		("host-connections", bpo::value<long>(&host_connections_limit)->default_value(0), "Number of connections limit per host, unlimited if zero")
+		("http2", bpo::value<std::string>(&http2)->default_value("disabled"), "Usage of HTTP/2: disabled, tls or prior-knowledge")
+		("streams", bpo::value<long>(&streams_limit)->default_value(0), "Number of HTTP/2 streams limit per connection, libcurl's default if zero")
+		("threads", bpo::value<long>(&threads_num)->default_value(1), "Number of url fetcher's threads, number of CPU cores if zero")
+		("routing", bpo::value<std::string>(&routing)->default_value("least-loaded"), "Choice of thread for request: host or least-loaded")
                 ;
 
         bpo::options_description cmdline_options;
@@ -122,17 +117,18 @@ int main(int argc, char *argv[])
 	auto logger_base = ioremap::swarm::utils::logger::create("/dev/stdout", SWARM_LOG_DEBUG);
 	ioremap::swarm::logger logger(logger_base, blackhole::log::attributes_t());
 
-	boost::asio::io_service service;
-	std::unique_ptr<boost::asio::io_service::work> work;
-	work.reset(new boost::asio::io_service::work(service));
-	swarm::boost_event_loop loop(service, logger);
-
-	swarm::url_fetcher manager(loop, logger);
+	// Connections limit is per thread
+	swarm::sharded_url_fetcher manager(std::max(0l, threads_num), logger,
+		routing == "host" ? swarm::sharded_url_fetcher::route_by_host : swarm::sharded_url_fetcher::route_least_loaded);
 	manager.set_total_limit(connections_limit);
-//	manager.set_host_limit(connections_limit);
-
-	io_service_runner runner = { &service };
-	boost::thread thread(runner);
+	if (host_connections_limit > 0)
+		manager.set_host_limit(host_connections_limit);
+	if (http2 == "tls")
+		manager.set_http2_mode(swarm::url_fetcher::http2_tls);
+	else if (http2 == "prior-knowledge")
+		manager.set_http2_mode(swarm::url_fetcher::http2_prior_knowledge);
+	if (streams_limit > 0)
+		manager.set_max_streams(streams_limit);
 
 	ioremap::warp::timer tm, total, preparation;
 
@@ -164,9 +160,51 @@ int main(int argc, char *argv[])
 
 	std::cout << "num: " << request_num << ", performance: " << request_num * 1000000 / total.restart() << std::endl;
 
-	work.reset();
-	service.stop();
-	thread.join();
+	{
+		std::promise<std::vector<swarm::url_fetcher::host_statistics>> promise;
+		manager.get_host_statistics([&promise] (std::vector<swarm::url_fetcher::host_statistics> &&statistics) {
+			promise.set_value(std::move(statistics));
+		});
+
+		const auto statistics = promise.get_future().get();
+		for (auto it = statistics.begin(); it != statistics.end(); ++it) {
+			std::cout << "host: " << it->host << ", requests: " << it->finished
+				  << ", connections: " << it->connections
+				  << ", http2 requests: " << it->http2_finished
+				  << ", requests per connection: " << double(it->finished) / std::max<uint64_t>(it->connections, 1)
+				  << std::endl;
+		}
+	}
+
+	{
+		std::promise<swarm::url_fetcher::timing_statistics> promise;
+		manager.get_timing_statistics([&promise] (swarm::url_fetcher::timing_statistics &&statistics) {
+			promise.set_value(std::move(statistics));
+		});
+
+		const auto statistics = promise.get_future().get();
+		const std::pair<const char *, const swarm::url_fetcher::timing_histogram *> phases[] = {
+			{ "queue", &statistics.queue },
+			{ "name lookup", &statistics.name_lookup },
+			{ "connect", &statistics.connect },
+			{ "tls", &statistics.tls },
+			{ "server", &statistics.server },
+			{ "total", &statistics.total }
+		};
+
+		for (auto it = std::begin(phases); it != std::end(phases); ++it) {
+			const swarm::url_fetcher::timing_histogram &histogram = *it->second;
+			if (!histogram.count)
+				continue;
+
+			std::cout << it->first << ": count: " << histogram.count
+				  << ", average: " << histogram.sum / int64_t(histogram.count) << " usecs"
+				  << ", p50: " << histogram.percentile(0.5)
+				  << ", p99: " << histogram.percentile(0.99) << " usecs"
+				  << std::endl;
+		}
+		std::cout << "reused connections: " << statistics.reused_connections << std::endl;
+	}
 
         return 0;
 }
@@ -0,0 +1,143 @@
+/*
+ * Copyright 2015+ Ruslan Nigmatullin <euroelessar@yandex.ru>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <thevoid/stream.hpp>
+
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+
+#include <boost/program_options.hpp>
+
+#include "timer.hpp"
+
+// Every allocation made by the process is counted, the tool is single-threaded
+static size_t allocations_count = 0;
+
+void *operator new(size_t size)
+{
+	++allocations_count;
+	if (void *result = std::malloc(size ? size : 1))
+		return result;
+	throw std::bad_alloc();
+}
+
+void operator delete(void *pointer) noexcept
+{
+	std::free(pointer);
+}
+
+using namespace ioremap;
+
+namespace {
+
+/*
+ * Completion wrapper as it was before: attributes are copied into the scope on every call.
+ */
+template <typename Method>
+struct copy_bind_handler
+{
+	swarm::logger *logger;
+	blackhole::log::attributes_t *attributes;
+	Method method;
+
+	template <typename... Args>
+	void operator() (Args &&...args)
+	{
+		blackhole::scoped_attributes_t logger_guard(*logger, blackhole::log::attributes_t(*attributes));
+		method(std::forward<Args>(args)...);
+	}
+};
+
+struct completion
+{
+	void operator() (const boost::system::error_code &error, size_t size)
+	{
+		if (!error)
+			total += size;
+	}
+
+	size_t &total;
+};
+
+template <typename Handler>
+void run_test(const char *name, Handler handler, long calls_num)
+{
+	const boost::system::error_code error;
+
+	for (long i = 0; i < 100; ++i)
+		handler(error, size_t(i));
+
+	const size_t allocations_start = allocations_count;
+	ioremap::warp::timer tm;
+
+	for (long i = 0; i < calls_num; ++i)
+		handler(error, size_t(i));
+
+	const auto usecs = tm.elapsed();
+	const size_t allocations = allocations_count - allocations_start;
+
+	std::cout << name << ": " << usecs << " usecs, performance: " << calls_num * 1000000 / usecs
+		  << ", allocations per call: " << double(allocations) / calls_num << std::endl;
+}
+
+} // unnamed namespace
+
+int main(int argc, char *argv[])
+{
+	namespace bpo = boost::program_options;
+
+	bpo::options_description generic("Completion handler overhead testing options");
+
+	long calls_num;
+
+	generic.add_options()
+		("help", "This help message")
+		("calls", bpo::value<long>(&calls_num)->default_value(1000000), "Number of completion handler calls per test")
+		;
+
+	try {
+		bpo::variables_map vm;
+		bpo::store(bpo::command_line_parser(argc, argv).options(generic).run(), vm);
+		bpo::notify(vm);
+
+		if (vm.count("help")) {
+			std::cerr << generic << std::endl;
+			return -1;
+		}
+	} catch (...) {
+		std::cerr << generic << std::endl;
+		return -1;
+	}
+
+	swarm::logger_base logger_base = swarm::utils::logger::create("/dev/null", SWARM_LOG_ERROR);
+	swarm::logger logger(logger_base, blackhole::log::attributes_t());
+
+	// The same attributes as connection sets for every request
+	blackhole::log::attributes_t attributes({
+		swarm::keyword::request_id() = 0x0123456789abcdefull,
+		blackhole::keyword::tracebit() = false
+	});
+
+	size_t total = 0;
+
+	run_test("copied attributes", copy_bind_handler<completion>{ &logger, &attributes, completion{ total } }, calls_num);
+	run_test("referenced attributes", thevoid::detail::attributes_bind(logger, attributes, completion{ total }), calls_num);
+	run_test("attributes copied by wrap", thevoid::detail::attributes_copy_bind(logger, attributes, completion{ total }), calls_num);
+
+	return total > 0 ? 0 : 1;
+}
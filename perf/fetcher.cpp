@@ -0,0 +1,166 @@
+/*
+ * Copyright 2013+ Evgeniy Polyakov <zbr@ioremap.net>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <swarm/urlfetcher/url_fetcher.hpp>
+#include <swarm/urlfetcher/boost_event_loop.hpp>
+#include <swarm/urlfetcher/stream.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <thread>
+
+#include <boost/program_options.hpp>
+
+#include "timer.hpp"
+
+// Allocations made by C++ code of the whole process, libcurl's mallocs are not counted
+static std::atomic<size_t> allocations_count(0);
+
+void *operator new(size_t size)
+{
+	++allocations_count;
+	if (void *result = std::malloc(size ? size : 1))
+		return result;
+	throw std::bad_alloc();
+}
+
+void operator delete(void *pointer) noexcept
+{
+	std::free(pointer);
+}
+
+using namespace ioremap;
+
+namespace {
+
+struct chunk_handler
+{
+	chunk_handler(long total) : finished(false), counter(0), total(total)
+	{
+	}
+
+	std::mutex mutex;
+	std::condition_variable condition;
+	bool finished;
+	std::atomic_long counter;
+	long total;
+
+	void operator() (const swarm::url_fetcher::response &, const std::string &, const boost::system::error_code &)
+	{
+		if (++counter == total) {
+			std::unique_lock<std::mutex> locker(mutex);
+			finished = true;
+			condition.notify_all();
+		}
+	}
+
+	void wait()
+	{
+		std::unique_lock<std::mutex> locker(mutex);
+		while (!finished) {
+			condition.wait(locker);
+		}
+	}
+};
+
+void run_chunk(swarm::url_fetcher &manager, const std::string &url, long requests_num)
+{
+	chunk_handler handler(requests_num);
+
+	for (long i = 0; i < requests_num; ++i) {
+		swarm::url_fetcher::request request;
+		request.set_url(url);
+		request.set_timeout(500000);
+
+		manager.get(swarm::simple_stream::create(std::ref(handler)), std::move(request));
+	}
+
+	handler.wait();
+}
+
+} // unnamed namespace
+
+int main(int argc, char *argv[])
+{
+	namespace bpo = boost::program_options;
+
+	bpo::options_description generic("Url fetcher's allocations testing options");
+
+	std::string url;
+	long requests_num, chunk_num, connections_limit;
+
+	generic.add_options()
+		("help", "This help message")
+		("url", bpo::value<std::string>(&url)->default_value("http://localhost:8080/get"), "Test URL for GET request")
+		("requests", bpo::value<long>(&requests_num)->default_value(100000), "Number of measured requests")
+		("chunk", bpo::value<long>(&chunk_num)->default_value(1000), "Send this many requests and then wait for all of them to complete")
+		("connections", bpo::value<long>(&connections_limit)->default_value(100), "Number of connections limit")
+		;
+
+	try {
+		bpo::variables_map vm;
+		bpo::store(bpo::command_line_parser(argc, argv).options(generic).run(), vm);
+		bpo::notify(vm);
+
+		if (vm.count("help") || chunk_num <= 0) {
+			std::cerr << generic << std::endl;
+			return -1;
+		}
+	} catch (...) {
+		std::cerr << generic << std::endl;
+		return -1;
+	}
+
+	auto logger_base = swarm::utils::logger::create("/dev/null", SWARM_LOG_INFO);
+	swarm::logger logger(logger_base, blackhole::log::attributes_t());
+
+	boost::asio::io_service service;
+	std::unique_ptr<boost::asio::io_service::work> work(new boost::asio::io_service::work(service));
+	swarm::boost_event_loop loop(service, logger);
+
+	swarm::url_fetcher manager(loop, logger);
+	manager.set_total_limit(connections_limit);
+
+	std::thread thread([&service] () {
+		service.run();
+	});
+
+	// Warm up connections, easy handles and request records, only steady state is measured
+	run_chunk(manager, url, chunk_num);
+
+	const size_t allocations_start = allocations_count;
+	ioremap::warp::timer tm;
+
+	for (long i = 0; i < requests_num; i += chunk_num) {
+		run_chunk(manager, url, std::min(chunk_num, requests_num - i));
+	}
+
+	const auto usecs = tm.elapsed();
+	const size_t allocations = allocations_count - allocations_start;
+
+	std::cout << "num: " << requests_num << ", performance: " << requests_num * 1000000 / usecs
+		  << ", allocations per request: " << double(allocations) / requests_num << std::endl;
+
+	work.reset();
+	service.stop();
+	thread.join();
+
+	return 0;
+}
@@ -0,0 +1,98 @@
+#!/usr/bin/env python3
+'''Minimal HTTP/2 server without TLS (h2c) to test url_fetcher's multiplexing.
+
+Responds "OK" to every request after optional delay, so requests overlap, and
+reports number of accepted connections and maximum number of simultaneous streams
+per connection on exit.
+
+Requires h2 package: pip install h2
+'''
+import argparse
+import asyncio
+
+import h2.config
+import h2.connection
+import h2.events
+import h2.exceptions
+
+
+class Statistics(object):
+    def __init__(self):
+        self.connections = 0
+        self.requests = 0
+        self.max_streams = 0
+
+
+class H2Protocol(asyncio.Protocol):
+    def __init__(self, statistics, delay):
+        self.statistics = statistics
+        self.delay = delay
+        self.transport = None
+        self.streams = 0
+        self.connection = h2.connection.H2Connection(
+            config=h2.config.H2Configuration(client_side=False))
+
+    def connection_made(self, transport):
+        self.transport = transport
+        self.statistics.connections += 1
+
+        self.connection.initiate_connection()
+        self.transport.write(self.connection.data_to_send())
+
+    def data_received(self, data):
+        try:
+            events = self.connection.receive_data(data)
+        except h2.exceptions.ProtocolError:
+            self.transport.write(self.connection.data_to_send())
+            self.transport.close()
+            return
+
+        for event in events:
+            if isinstance(event, h2.events.RequestReceived):
+                self.streams += 1
+                self.statistics.requests += 1
+                self.statistics.max_streams = max(self.statistics.max_streams, self.streams)
+            elif isinstance(event, h2.events.DataReceived):
+                self.connection.acknowledge_received_data(event.flow_controlled_length, event.stream_id)
+            elif isinstance(event, h2.events.StreamEnded):
+                asyncio.get_event_loop().call_later(self.delay, self.respond, event.stream_id)
+
+        self.transport.write(self.connection.data_to_send())
+
+    def respond(self, stream_id):
+        if self.transport.is_closing():
+            return
+
+        body = b'OK'
+        self.connection.send_headers(stream_id, [
+            (':status', '200'),
+            ('content-length', str(len(body))),
+        ])
+        self.connection.send_data(stream_id, body, end_stream=True)
+        self.transport.write(self.connection.data_to_send())
+        self.streams -= 1
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('--port', type=int, default=8081, help='port to listen')
+    parser.add_argument('--delay', type=float, default=0.01, help='delay before response, in seconds')
+    args = parser.parse_args()
+
+    statistics = Statistics()
+    loop = asyncio.get_event_loop()
+    server = loop.run_until_complete(loop.create_server(
+        lambda: H2Protocol(statistics, args.delay), 'localhost', args.port))
+
+    try:
+        loop.run_forever()
+    except KeyboardInterrupt:
+        pass
+    finally:
+        server.close()
+        print('connections: {0}, requests: {1}, max streams per connection: {2}'.format(
+            statistics.connections, statistics.requests, statistics.max_streams))
+
+
+if __name__ == '__main__':
+    main()
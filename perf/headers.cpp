@@ -0,0 +1,255 @@
+/*
+ * Copyright 2015+ Ruslan Nigmatullin <euroelessar@yandex.ru>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <swarm/http_headers.hpp>
+#include <swarm/urlfetcher/header_parser_p.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <curl/curl.h>
+
+#include <boost/program_options.hpp>
+
+#include "timer.hpp"
+
+// Every allocation made by the process is counted, the tool is single-threaded
+static size_t allocations_count = 0;
+
+void *operator new(size_t size)
+{
+	++allocations_count;
+	if (void *result = std::malloc(size ? size : 1))
+		return result;
+	throw std::bad_alloc();
+}
+
+void operator delete(void *pointer) noexcept
+{
+	std::free(pointer);
+}
+
+using namespace ioremap;
+
+namespace {
+
+/*
+ * Header lines of CDN-like reply: status line, @headers_num header lines
+ * of different lengths and the empty line, as curl passes them to the header callback.
+ */
+std::vector<std::string> generate_reply(long headers_num)
+{
+	static const char *names[] = {
+		"Date", "Content-Type", "Content-Length", "Connection", "Cache-Control",
+		"ETag", "Last-Modified", "Vary", "X-Cache", "X-Served-By",
+		"Set-Cookie", "Strict-Transport-Security", "Accept-Ranges", "Age", "Via"
+	};
+	const size_t names_num = sizeof(names) / sizeof(names[0]);
+
+	std::vector<std::string> lines;
+	lines.emplace_back("HTTP/1.1 200 OK\r\n");
+
+	for (long i = 0; i < headers_num; ++i) {
+		std::string line = names[i % names_num];
+		line += ": ";
+		line.append(8 + (i * 7) % 48, 'a' + i % 26);
+		line += "\r\n";
+		lines.emplace_back(std::move(line));
+	}
+
+	lines.emplace_back("\r\n");
+	return lines;
+}
+
+/*
+ * Mimics the former header callback of url_fetcher: redirect count is requested
+ * from curl and every line is parsed and added to headers as soon as it's received.
+ */
+struct per_line_parser
+{
+	per_line_parser() : easy(curl_easy_init()), redirect_count(0)
+	{
+	}
+
+	~per_line_parser()
+	{
+		curl_easy_cleanup(easy);
+	}
+
+	static void trim_line(const char *&begin, const char *&end)
+	{
+		while (begin < end && isspace(*begin))
+			++begin;
+		while (begin < end && isspace(*(end - 1)))
+			--end;
+	}
+
+	static std::string trimmed(const char *begin, const char *end)
+	{
+		trim_line(begin, end);
+		return std::string(begin, end);
+	}
+
+	void on_line(const char *data, size_t size)
+	{
+		long count;
+		curl_easy_getinfo(easy, CURLINFO_REDIRECT_COUNT, &count);
+
+		if (count != redirect_count) {
+			redirect_count = count;
+			headers.clear();
+		}
+
+		if (size == 2)
+			return;
+
+		const char *end = data + size;
+		const char *colon = std::find(data, end, ':');
+
+		if (colon != end) {
+			std::string field = trimmed(data, colon);
+			std::string value;
+			value.reserve(16);
+
+			const char *value_begin = colon + 1;
+			const char *value_end = std::find(value_begin, end, '\n');
+			trim_line(value_begin, value_end);
+			value.append(value_begin, value_end);
+
+			swarm::headers_entry entry = { std::move(field), std::move(value) };
+			headers.add(std::move(entry));
+		}
+	}
+
+	void process(const std::vector<std::string> &lines)
+	{
+		headers = swarm::http_headers();
+		for (auto &line : lines)
+			on_line(line.data(), line.size());
+	}
+
+	CURL *easy;
+	long redirect_count;
+	swarm::http_headers headers;
+};
+
+/*
+ * Mimics the current header callback: lines are collected to the buffer
+ * and parsed at once by the end of headers.
+ */
+struct buffered_parser
+{
+	void on_line(const char *data, size_t size)
+	{
+		if (swarm::is_status_line(data, size)) {
+			header_lines.clear();
+			return;
+		}
+
+		if (!swarm::is_headers_end(data, size)) {
+			header_lines.append(data, size);
+			return;
+		}
+
+		std::vector<swarm::headers_entry> entries;
+		swarm::parse_header_lines(header_lines.data(), header_lines.size(), entries);
+		headers.assign(std::move(entries));
+		header_lines.clear();
+	}
+
+	void process(const std::vector<std::string> &lines)
+	{
+		headers = swarm::http_headers();
+		for (auto &line : lines)
+			on_line(line.data(), line.size());
+	}
+
+	std::string header_lines;
+	swarm::http_headers headers;
+};
+
+template <typename Parser>
+void run_test(const char *name, Parser &parser, const std::vector<std::string> &lines, long responses_num)
+{
+	// Warm up the caches and the allocator, only steady state is measured
+	for (long i = 0; i < 100; ++i)
+		parser.process(lines);
+
+	const size_t allocations_start = allocations_count;
+	ioremap::warp::timer tm;
+
+	for (long i = 0; i < responses_num; ++i)
+		parser.process(lines);
+
+	const auto usecs = tm.elapsed();
+	const size_t allocations = allocations_count - allocations_start;
+
+	std::cout << name << ": " << usecs << " usecs, performance: " << responses_num * 1000000 / usecs
+		  << ", allocations per response: " << double(allocations) / responses_num
+		  << ", headers: " << parser.headers.all().size() << std::endl;
+}
+
+} // unnamed namespace
+
+int main(int argc, char *argv[])
+{
+	namespace bpo = boost::program_options;
+
+	bpo::options_description generic("Reply headers parsing testing options");
+
+	long headers_num;
+	long responses_num;
+
+	generic.add_options()
+		("help", "This help message")
+		("headers", bpo::value<long>(&headers_num)->default_value(30), "Number of headers per response")
+		("responses", bpo::value<long>(&responses_num)->default_value(100000), "Number of responses per test")
+		;
+
+	try {
+		bpo::variables_map vm;
+		bpo::store(bpo::command_line_parser(argc, argv).options(generic).run(), vm);
+		bpo::notify(vm);
+
+		if (vm.count("help")) {
+			std::cerr << generic << std::endl;
+			return -1;
+		}
+	} catch (...) {
+		std::cerr << generic << std::endl;
+		return -1;
+	}
+
+	curl_global_init(CURL_GLOBAL_ALL);
+
+	const std::vector<std::string> lines = generate_reply(headers_num);
+
+	std::cout << "headers: " << headers_num << ", responses: " << responses_num << std::endl;
+
+	per_line_parser per_line;
+	run_test("per-line parsing", per_line, lines, responses_num);
+
+	buffered_parser buffered;
+	run_test("buffered parsing", buffered, lines, responses_num);
+
+	curl_global_cleanup();
+
+	return 0;
+}
@@ -0,0 +1,164 @@
+/*
+ * Copyright 2015+ Ruslan Nigmatullin <euroelessar@yandex.ru>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <swarm/url.hpp>
+
+#include <atomic>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/program_options.hpp>
+
+#include "timer.hpp"
+
+using namespace ioremap;
+
+namespace {
+
+/*
+ * Crawler-like host mix: most of hosts are plain ASCII ones, the rest are internationalized.
+ * Popularity of hosts is skewed, so few of them are met much more often than others.
+ */
+std::vector<std::string> generate_urls(long hosts_num, double idn_share, long requests_num)
+{
+	static const char *idn_labels[] = {
+		"пример", "новости", "bücher", "straße", "日本語", "δοκιμή"
+	};
+	static const char *idn_zones[] = {
+		"рф", "рф", "de", "de", "jp", "gr"
+	};
+	const size_t idn_labels_count = sizeof(idn_labels) / sizeof(idn_labels[0]);
+
+	std::mt19937 generator(42);
+	std::uniform_real_distribution<double> distribution(0, 1);
+
+	std::vector<std::string> hosts;
+	hosts.reserve(hosts_num);
+
+	for (long i = 0; i < hosts_num; ++i) {
+		const std::string id = std::to_string(i);
+
+		if (distribution(generator) < idn_share) {
+			const size_t label = i % idn_labels_count;
+			hosts.push_back(std::string(idn_labels[label]) + id + "." + idn_zones[label]);
+		} else {
+			hosts.push_back("host" + id + ".example.com");
+		}
+	}
+
+	std::vector<std::string> urls;
+	urls.reserve(requests_num);
+
+	for (long i = 0; i < requests_num; ++i) {
+		const size_t index = size_t(hosts_num * std::pow(distribution(generator), 3));
+		urls.push_back("http://" + hosts[index] + "/some/path?id=" + std::to_string(i));
+	}
+
+	return urls;
+}
+
+/*
+ * Mimics crawler's handling of url: it's read from user input, it's host is
+ * inspected and it's serialized for fetching.
+ */
+size_t process(const std::vector<std::string> &urls)
+{
+	size_t result = 0;
+
+	for (auto it = urls.begin(); it != urls.end(); ++it) {
+		swarm::url url = swarm::url::from_user_input(*it);
+		result += url.host().size();
+		result += url.to_string().size();
+	}
+
+	return result;
+}
+
+void run_test(const char *name, const std::vector<std::string> &urls, int threads_num)
+{
+	std::atomic<size_t> checksum(0);
+	std::vector<std::thread> threads;
+
+	ioremap::warp::timer tm;
+
+	for (int i = 0; i < threads_num; ++i) {
+		threads.emplace_back([&urls, &checksum] () {
+			checksum += process(urls);
+		});
+	}
+
+	for (auto it = threads.begin(); it != threads.end(); ++it) {
+		it->join();
+	}
+
+	const auto usecs = tm.elapsed();
+	const long urls_num = long(urls.size()) * threads_num;
+
+	std::cout << name << ": " << usecs << " usecs, performance: " << urls_num * 1000000 / usecs
+		  << ", checksum: " << checksum << std::endl;
+}
+
+} // unnamed namespace
+
+int main(int argc, char *argv[])
+{
+	namespace bpo = boost::program_options;
+
+	bpo::options_description generic("IDN host conversion testing options");
+
+	long hosts_num;
+	long requests_num;
+	double idn_share;
+	int threads_num;
+	size_t cache_capacity;
+
+	generic.add_options()
+		("help", "This help message")
+		("hosts", bpo::value<long>(&hosts_num)->default_value(5000), "Number of distinct hosts")
+		("idn-share", bpo::value<double>(&idn_share)->default_value(0.2), "Share of internationalized hosts")
+		("requests", bpo::value<long>(&requests_num)->default_value(1000000), "Number of urls per thread")
+		("threads", bpo::value<int>(&threads_num)->default_value(1), "Number of threads")
+		("cache", bpo::value<size_t>(&cache_capacity)->default_value(16 * 1024), "Capacity of IDN cache")
+		;
+
+	try {
+		bpo::variables_map vm;
+		bpo::store(bpo::command_line_parser(argc, argv).options(generic).run(), vm);
+		bpo::notify(vm);
+
+		if (vm.count("help") || hosts_num <= 0 || threads_num <= 0) {
+			std::cerr << generic << std::endl;
+			return -1;
+		}
+	} catch (...) {
+		std::cerr << generic << std::endl;
+		return -1;
+	}
+
+	const std::vector<std::string> urls = generate_urls(hosts_num, idn_share, requests_num);
+
+	swarm::url::set_idn_cache_capacity(0);
+	run_test("without cache", urls, threads_num);
+
+	swarm::url::set_idn_cache_capacity(cache_capacity);
+	run_test("with cache", urls, threads_num);
+
+	return 0;
+}
@@ -0,0 +1,219 @@
+/*
+ * Copyright 2015+ Ruslan Nigmatullin <euroelessar@yandex.ru>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <swarm/logger.hpp>
+
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+
+#include <sys/time.h>
+
+#include <boost/program_options.hpp>
+
+#include "timer.hpp"
+
+// Every allocation made by the process is counted, the tool is single-threaded
+static size_t allocations_count = 0;
+
+void *operator new(size_t size)
+{
+	++allocations_count;
+	if (void *result = std::malloc(size ? size : 1))
+		return result;
+	throw std::bad_alloc();
+}
+
+void operator delete(void *pointer) noexcept
+{
+	std::free(pointer);
+}
+
+using namespace ioremap;
+
+namespace {
+
+uint64_t rand_request_id()
+{
+	uint64_t request_id = 0;
+	unsigned char *buffer = reinterpret_cast<unsigned char *>(&request_id);
+	for (size_t i = 0; i < sizeof(request_id); ++i)
+		buffer[i] = std::rand();
+	return request_id;
+}
+
+uint64_t xorshift_request_id()
+{
+	static uint64_t state = 0;
+
+	if (state == 0) {
+		struct timeval now;
+		gettimeofday(&now, NULL);
+		state = (uint64_t(now.tv_sec) * 1000000 + now.tv_usec) | 1;
+	}
+
+	state ^= state >> 12;
+	state ^= state << 25;
+	state ^= state >> 27;
+
+	return state * 0x2545f4914f6cdd1dull;
+}
+
+/*
+ * Mimics per-request logging of thevoid's connection: request's attributes are set,
+ * request line and access log are logged by INFO, handler receives it's own logger.
+ */
+struct eager_connection
+{
+	eager_connection(const swarm::logger &base) : base_logger(base), logger(base, blackhole::log::attributes_t())
+	{
+	}
+
+	void process(uint64_t request_id)
+	{
+		attributes = blackhole::log::attributes_t({
+			swarm::keyword::request_id() = request_id,
+			blackhole::keyword::tracebit() = false
+		});
+		logger = swarm::logger(base_logger, attributes);
+
+		blackhole::scoped_attributes_t guard(logger, blackhole::log::attributes_t(attributes));
+
+		BH_LOG(logger, SWARM_LOG_INFO, "received new request: method: %s, url: %s", "GET", "/ping");
+		swarm::logger handler_logger(logger, blackhole::log::attributes_t());
+		BH_LOG(handler_logger, SWARM_LOG_DEBUG, "handler started");
+		BH_LOG(logger, SWARM_LOG_INFO, "access_log_entry: method: %s, url: %s, status: %d", "GET", "/ping", 200);
+
+		attributes.clear();
+		logger = swarm::logger(base_logger, attributes);
+	}
+
+	swarm::logger base_logger;
+	swarm::logger logger;
+	blackhole::log::attributes_t attributes;
+};
+
+struct lazy_connection
+{
+	lazy_connection(const swarm::logger &base, swarm::log_level verbosity) :
+		base_logger(base), logger(base, blackhole::log::attributes_t()), verbosity(verbosity), outdated(false)
+	{
+	}
+
+	swarm::logger &logger_for(swarm::log_level level)
+	{
+		if (outdated && level >= verbosity) {
+			logger = swarm::logger(base_logger, attributes);
+			outdated = false;
+		}
+		return logger;
+	}
+
+	void process(uint64_t request_id)
+	{
+		attributes = blackhole::log::attributes_t({
+			swarm::keyword::request_id() = request_id,
+			blackhole::keyword::tracebit() = false
+		});
+		outdated = true;
+
+		blackhole::scoped_attributes_t guard(base_logger, blackhole::log::attributes_t(attributes));
+
+		BH_LOG(logger_for(SWARM_LOG_INFO), SWARM_LOG_INFO, "received new request: method: %s, url: %s", "GET", "/ping");
+		swarm::logger handler_logger(base_logger, attributes);
+		BH_LOG(handler_logger, SWARM_LOG_DEBUG, "handler started");
+		BH_LOG(logger_for(SWARM_LOG_INFO), SWARM_LOG_INFO, "access_log_entry: method: %s, url: %s, status: %d", "GET", "/ping", 200);
+
+		attributes.clear();
+		outdated = true;
+	}
+
+	swarm::logger base_logger;
+	swarm::logger logger;
+	blackhole::log::attributes_t attributes;
+	swarm::log_level verbosity;
+	bool outdated;
+};
+
+template <typename Connection, typename Generator>
+void run_test(const char *name, Connection &connection, Generator generator, long requests_num)
+{
+	// Warm up the caches and the allocator, only steady state is measured
+	for (long i = 0; i < 100; ++i)
+		connection.process(generator());
+
+	const size_t allocations_start = allocations_count;
+	ioremap::warp::timer tm;
+
+	for (long i = 0; i < requests_num; ++i)
+		connection.process(generator());
+
+	const auto usecs = tm.elapsed();
+	const size_t allocations = allocations_count - allocations_start;
+
+	std::cout << name << ": " << usecs << " usecs, performance: " << requests_num * 1000000 / usecs
+		  << ", allocations per request: " << double(allocations) / requests_num << std::endl;
+}
+
+} // unnamed namespace
+
+int main(int argc, char *argv[])
+{
+	namespace bpo = boost::program_options;
+
+	bpo::options_description generic("Per-request logging cost testing options");
+
+	long requests_num;
+	std::string log_file;
+
+	generic.add_options()
+		("help", "This help message")
+		("requests", bpo::value<long>(&requests_num)->default_value(100000), "Number of requests per test")
+		("log", bpo::value<std::string>(&log_file)->default_value("/dev/null"), "Log file")
+		;
+
+	try {
+		bpo::variables_map vm;
+		bpo::store(bpo::command_line_parser(argc, argv).options(generic).run(), vm);
+		bpo::notify(vm);
+
+		if (vm.count("help")) {
+			std::cerr << generic << std::endl;
+			return -1;
+		}
+	} catch (...) {
+		std::cerr << generic << std::endl;
+		return -1;
+	}
+
+	const swarm::log_level levels[] = { SWARM_LOG_INFO, SWARM_LOG_ERROR };
+
+	for (auto level : levels) {
+		swarm::logger_base logger_base = swarm::utils::logger::create(log_file, level);
+		swarm::logger logger(logger_base, blackhole::log::attributes_t());
+
+		std::cout << "verbosity: " << swarm::utils::logger::generate_level(level) << std::endl;
+
+		eager_connection eager(logger);
+		run_test("eager attributes, std::rand ids", eager, rand_request_id, requests_num);
+
+		lazy_connection lazy(logger, level);
+		run_test("lazy attributes, xorshift ids", lazy, xorshift_request_id, requests_num);
+	}
+
+	return 0;
+}
@@ -0,0 +1,253 @@
+/*
+ * Copyright 2015+ Ruslan Nigmatullin <euroelessar@yandex.ru>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <thevoid/request_parser_p.hpp>
+#include <swarm/logger.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <strings.h>
+
+#include <boost/program_options.hpp>
+
+#include "timer.hpp"
+
+// Every allocation made by the process is counted, the tool is single-threaded
+static size_t allocations_count = 0;
+
+void *operator new(size_t size)
+{
+	++allocations_count;
+	if (void *result = std::malloc(size ? size : 1))
+		return result;
+	throw std::bad_alloc();
+}
+
+void operator delete(void *pointer) noexcept
+{
+	std::free(pointer);
+}
+
+using namespace ioremap;
+
+namespace {
+
+const std::string request_header = "X-Request";
+const std::string trace_header = "X-Trace";
+
+std::string generate_request(size_t headers_count)
+{
+	std::string request = "GET /get?key=value&another_key=another_value HTTP/1.1\r\n"
+		"Host: localhost:8080\r\n"
+		"X-Request: 0123456789abcdef0123\r\n"
+		"X-Trace: 0\r\n";
+
+	for (size_t i = 0; i < headers_count; ++i) {
+		request += "X-Header-" + std::to_string(i) + ": some value of the header number " + std::to_string(i) + "\r\n";
+	}
+
+	request += "\r\n";
+	return request;
+}
+
+// Request streams of thevoid keep the request they receive by on_headers
+struct handler
+{
+	void on_headers(thevoid::http_request &&req)
+	{
+		request = std::move(req);
+	}
+
+	thevoid::http_request request;
+};
+
+/*
+ * Mimics per-request work of thevoid's connection before it started to reuse it's state:
+ * new request object, attributes map built from scratch, headers copied on lookup.
+ */
+struct fresh_connection
+{
+	void process(const std::string &data, handler &stream, const std::vector<std::string> &log_headers)
+	{
+		attributes.clear();
+		request = thevoid::http_request();
+		parser.reset();
+		parser.parse(request, data.c_str(), data.c_str() + data.size());
+
+		uint64_t request_id = 0;
+		if (auto request_ptr = request.headers().get(request_header)) {
+			std::string tmp = request_ptr->substr(0, 16);
+			errno = 0;
+			request_id = strtoull(tmp.c_str(), NULL, 16);
+		}
+
+		bool trace_bit = false;
+		if (auto trace_bit_ptr = request.headers().get(trace_header)) {
+			trace_bit = atoi(trace_bit_ptr->c_str()) > 0;
+		}
+
+		attributes = blackhole::log::attributes_t({
+			swarm::keyword::request_id() = request_id,
+			blackhole::keyword::tracebit() = trace_bit
+		});
+
+		std::string headers_string = "{";
+		for (const auto &log_header : log_headers) {
+			if (request.headers().has(log_header)) {
+				std::string header_value = *request.headers().get(log_header);
+				headers_string += log_header + ": \"" + header_value + "\", ";
+			}
+		}
+		headers_string += "}";
+
+		stream.on_headers(std::move(request));
+	}
+
+	thevoid::request_parser parser;
+	thevoid::http_request request;
+	blackhole::log::attributes_t attributes;
+};
+
+const std::string *find_header(const swarm::http_headers &headers, const std::string &name)
+{
+	for (const auto &entry : headers.all()) {
+		if (entry.first.size() == name.size() && strncasecmp(entry.first.c_str(), name.c_str(), name.size()) == 0)
+			return &entry.second;
+	}
+
+	return NULL;
+}
+
+/*
+ * Mimics per-request work of thevoid's connection which resets it's state in place:
+ * request is cleared, attributes are inserted to the cleared map, headers are read without copies.
+ */
+struct recycled_connection
+{
+	void process(const std::string &data, handler &stream, const std::vector<std::string> &log_headers)
+	{
+		attributes.clear();
+		request.clear();
+		parser.reset();
+		parser.parse(request, data.c_str(), data.c_str() + data.size());
+
+		uint64_t request_id = 0;
+		if (const std::string *request_ptr = find_header(request.headers(), request_header)) {
+			char tmp[17];
+			tmp[request_ptr->copy(tmp, 16)] = '\0';
+			errno = 0;
+			request_id = strtoull(tmp, NULL, 16);
+		}
+
+		bool trace_bit = false;
+		if (const std::string *trace_bit_ptr = find_header(request.headers(), trace_header)) {
+			trace_bit = atoi(trace_bit_ptr->c_str()) > 0;
+		}
+
+		attributes.insert(swarm::keyword::request_id() = request_id);
+		attributes.insert(blackhole::keyword::tracebit() = trace_bit);
+
+		headers_string.clear();
+		headers_string += "{";
+		for (const auto &log_header : log_headers) {
+			if (const std::string *header_value = find_header(request.headers(), log_header)) {
+				headers_string.append(log_header);
+				headers_string.append(": \"");
+				headers_string.append(*header_value);
+				headers_string.append("\", ");
+			}
+		}
+		headers_string += "}";
+
+		stream.on_headers(std::move(request));
+	}
+
+	thevoid::request_parser parser;
+	thevoid::http_request request;
+	blackhole::log::attributes_t attributes;
+	std::string headers_string;
+};
+
+template <typename Connection>
+void run_test(const char *name, const std::string &data, const std::vector<std::string> &log_headers, long requests_num)
+{
+	Connection connection;
+	handler stream;
+
+	// Warm up the caches and the allocator, only steady state is measured
+	for (long i = 0; i < 100; ++i)
+		connection.process(data, stream, log_headers);
+
+	const size_t allocations_start = allocations_count;
+	ioremap::warp::timer tm;
+
+	for (long i = 0; i < requests_num; ++i)
+		connection.process(data, stream, log_headers);
+
+	const auto usecs = tm.elapsed();
+	const size_t allocations = allocations_count - allocations_start;
+
+	std::cout << name << ": " << usecs << " usecs, performance: " << requests_num * 1000000 / std::max<long>(usecs, 1)
+		  << ", allocations per request: " << double(allocations) / requests_num << std::endl;
+}
+
+} // unnamed namespace
+
+int main(int argc, char *argv[])
+{
+	namespace bpo = boost::program_options;
+
+	bpo::options_description generic("Per-request connection's state testing options");
+
+	long requests_num;
+	size_t headers_count;
+
+	generic.add_options()
+		("help", "This help message")
+		("requests", bpo::value<long>(&requests_num)->default_value(100000), "Number of requests per test")
+		("headers", bpo::value<size_t>(&headers_count)->default_value(10), "Number of extra headers in the request")
+		;
+
+	try {
+		bpo::variables_map vm;
+		bpo::store(bpo::command_line_parser(argc, argv).options(generic).run(), vm);
+		bpo::notify(vm);
+
+		if (vm.count("help")) {
+			std::cerr << generic << std::endl;
+			return -1;
+		}
+	} catch (...) {
+		std::cerr << generic << std::endl;
+		return -1;
+	}
+
+	const std::string data = generate_request(headers_count);
+	const std::vector<std::string> log_headers = { "Host", "X-Request", "User-Agent" };
+
+	std::cout << "headers: " << headers_count + 3 << ", requests: " << requests_num << std::endl;
+
+	run_test<fresh_connection>("fresh request state", data, log_headers, requests_num);
+	run_test<recycled_connection>("recycled request state", data, log_headers, requests_num);
+
+	return 0;
+}
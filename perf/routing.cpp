@@ -0,0 +1,113 @@
+/*
+ * Copyright 2015+ Ruslan Nigmatullin <euroelessar@yandex.ru>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <thevoid/regex_router_p.hpp>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/program_options.hpp>
+#include <boost/regex.hpp>
+
+#include "timer.hpp"
+
+using namespace ioremap;
+
+int main(int argc, char *argv[])
+{
+	namespace bpo = boost::program_options;
+
+	bpo::options_description generic("Regex routing testing options");
+
+	long routes_num, paths_num, iterations_num;
+
+	generic.add_options()
+		("help", "This help message")
+		("routes", bpo::value<long>(&routes_num)->default_value(50), "Number of regex routes")
+		("paths", bpo::value<long>(&paths_num)->default_value(1000), "Number of different request paths")
+		("iterations", bpo::value<long>(&iterations_num)->default_value(100), "Number of passes over all paths")
+		;
+
+	try {
+		bpo::variables_map vm;
+		bpo::store(bpo::command_line_parser(argc, argv).options(generic).run(), vm);
+		bpo::notify(vm);
+
+		if (vm.count("help")) {
+			std::cerr << generic << std::endl;
+			return -1;
+		}
+	} catch (...) {
+		std::cerr << generic << std::endl;
+		return -1;
+	}
+
+	std::vector<boost::regex> sequential;
+	thevoid::regex_router combined;
+
+	for (long i = 0; i < routes_num; ++i) {
+		const std::string pattern = "/api/v" + std::to_string(i % 3) + "/resource" + std::to_string(i) + "/([0-9]+)(/.*)?";
+		sequential.emplace_back(pattern);
+		combined.add(i, pattern);
+	}
+
+	// Every second path misses all the routes, others hit random one
+	std::vector<std::string> paths;
+	for (long i = 0; i < paths_num; ++i) {
+		if (i % 2) {
+			paths.push_back("/static/file" + std::to_string(i) + ".png");
+		} else {
+			const long route = (i * 7919) % routes_num;
+			paths.push_back("/api/v" + std::to_string(route % 3) + "/resource" + std::to_string(route) + "/" + std::to_string(i));
+		}
+	}
+
+	ioremap::warp::timer tm;
+	long sequential_hits = 0;
+
+	for (long j = 0; j < iterations_num; ++j) {
+		for (auto it = paths.begin(); it != paths.end(); ++it) {
+			for (auto jt = sequential.begin(); jt != sequential.end(); ++jt) {
+				if (boost::regex_match(*it, *jt)) {
+					++sequential_hits;
+					break;
+				}
+			}
+		}
+	}
+
+	const auto sequential_usecs = tm.restart();
+	long combined_hits = 0;
+
+	for (long j = 0; j < iterations_num; ++j) {
+		for (auto it = paths.begin(); it != paths.end(); ++it) {
+			if (combined.find_first(*it) != thevoid::regex_router::npos)
+				++combined_hits;
+		}
+	}
+
+	const auto combined_usecs = tm.restart();
+	const long total = paths_num * iterations_num;
+
+	std::cout << "routes: " << routes_num << ", lookups: " << total << std::endl;
+	std::cout << "sequential: " << sequential_usecs << " usecs, performance: " << total * 1000000 / sequential_usecs
+		  << ", hits: " << sequential_hits << std::endl;
+	std::cout << "combined: " << combined_usecs << " usecs, performance: " << total * 1000000 / combined_usecs
+		  << ", hits: " << combined_hits << std::endl;
+
+	return sequential_hits == combined_hits ? 0 : 1;
+}
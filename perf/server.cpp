@@ -19,8 +19,28 @@
 #include <thevoid/server.hpp>
 #include <thevoid/stream.hpp>
 
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
 using namespace ioremap;
 
+// Allocations are counted to compare pooled and non-pooled handlers, see get_statistics
+static std::atomic<unsigned long long> allocations_count(0);
+
+void *operator new(size_t size)
+{
+	allocations_count.fetch_add(1, std::memory_order_relaxed);
+	if (void *result = std::malloc(size ? size : 1))
+		return result;
+	throw std::bad_alloc();
+}
+
+void operator delete(void *pointer) noexcept
+{
+	std::free(pointer);
+}
+
 template <typename T>
 struct on_upload : public thevoid::simple_request_stream<T>, public std::enable_shared_from_this<on_upload<T>>
 {
@@ -69,21 +89,40 @@ class http_server : public thevoid::server<http_server>
 {
 public:
 	virtual bool initialize(const rapidjson::Value &config) {
-		(void) config;
-
-		on<on_get<http_server>>(
-			options::exact_match("/get"),
-			options::methods("GET")
-		);
-		on<on_upload<http_server>>(
-			options::exact_match("/upload"),
-			options::methods("POST")
-		);
-	
+		m_pooled = config.HasMember("pooled") && config["pooled"].GetBool();
+
+		if (m_pooled) {
+			on_pooled<on_get<http_server>>(
+				options::exact_match("/get"),
+				options::methods("GET")
+			);
+			on_pooled<on_upload<http_server>>(
+				options::exact_match("/upload"),
+				options::methods("POST")
+			);
+		} else {
+			on<on_get<http_server>>(
+				options::exact_match("/get"),
+				options::methods("GET")
+			);
+			on<on_upload<http_server>>(
+				options::exact_match("/upload"),
+				options::methods("POST")
+			);
+		}
+
 		return true;
 	}
 
+	virtual std::map<std::string, std::string> get_statistics() const {
+		std::map<std::string, std::string> statistics;
+		statistics["allocations"] = std::to_string(allocations_count.load(std::memory_order_relaxed));
+		statistics["pooled"] = m_pooled ? "1" : "0";
+		return statistics;
+	}
+
 private:
+	bool m_pooled;
 };
 
 int main(int argc, char **argv)
@@ -0,0 +1,232 @@
+/*
+ * Copyright 2013+ Evgeniy Polyakov <zbr@ioremap.net>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <swarm/urlfetcher/url_fetcher.hpp>
+#include <swarm/urlfetcher/boost_event_loop.hpp>
+#include <swarm/urlfetcher/stream.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <boost/program_options.hpp>
+
+#include "timer.hpp"
+
+using namespace ioremap;
+
+namespace {
+
+struct chunk_handler
+{
+	chunk_handler(long total) : finished(false), counter(0), total(total)
+	{
+	}
+
+	std::mutex mutex;
+	std::condition_variable condition;
+	bool finished;
+	std::atomic_long counter;
+	long total;
+
+	void operator() (const swarm::url_fetcher::response &, const std::string &, const boost::system::error_code &)
+	{
+		if (++counter == total) {
+			std::unique_lock<std::mutex> locker(mutex);
+			finished = true;
+			condition.notify_all();
+		}
+	}
+
+	void wait()
+	{
+		std::unique_lock<std::mutex> locker(mutex);
+		while (!finished) {
+			condition.wait(locker);
+		}
+	}
+};
+
+struct loop_thread
+{
+	loop_thread() : work(new boost::asio::io_service::work(service))
+	{
+		thread = std::thread([this] () {
+			service.run();
+		});
+	}
+
+	void stop()
+	{
+		work.reset();
+		service.stop();
+		thread.join();
+	}
+
+	boost::asio::io_service service;
+	std::unique_ptr<boost::asio::io_service::work> work;
+	std::thread thread;
+};
+
+struct fetcher_context
+{
+	fetcher_context(boost::asio::io_service &service, const swarm::logger &logger) :
+		loop(service, logger), fetcher(loop, logger)
+	{
+	}
+
+	swarm::boost_event_loop loop;
+	swarm::url_fetcher fetcher;
+};
+
+void run_chunk(swarm::url_fetcher &fetcher, const std::string &url, long requests_num)
+{
+	chunk_handler handler(requests_num);
+
+	for (long i = 0; i < requests_num; ++i) {
+		swarm::url_fetcher::request request;
+		request.set_url(url);
+		request.set_timeout(500000);
+
+		fetcher.get(swarm::simple_stream::create(std::ref(handler)), std::move(request));
+	}
+
+	handler.wait();
+}
+
+uint64_t connections_count(swarm::url_fetcher &fetcher)
+{
+	std::promise<uint64_t> promise;
+
+	fetcher.get_host_statistics([&promise] (std::vector<swarm::url_fetcher::host_statistics> &&statistics) {
+		uint64_t connections = 0;
+		for (auto it = statistics.begin(); it != statistics.end(); ++it) {
+			connections += it->connections;
+		}
+		promise.set_value(connections);
+	});
+
+	return promise.get_future().get();
+}
+
+/*
+ * Chunks of requests are sent by fetchers in turn, like a crawler which spreads
+ * the same hosts over several fetchers. Every fetcher's connections become idle
+ * until it's next turn, so only shared ones may be reused by the others.
+ */
+void run_test(const char *name, const swarm::logger &logger, const std::shared_ptr<swarm::url_fetcher_share> &share,
+	const std::string &url, long fetchers_num, bool separate_threads, long connections_limit,
+	long requests_num, long chunk_num)
+{
+	std::vector<std::unique_ptr<loop_thread>> threads;
+	std::vector<std::unique_ptr<fetcher_context>> fetchers;
+
+	for (long i = 0; i < fetchers_num; ++i) {
+		if (i == 0 || separate_threads)
+			threads.emplace_back(new loop_thread);
+
+		fetchers.emplace_back(new fetcher_context(threads.back()->service, logger));
+		fetchers.back()->fetcher.set_total_limit(connections_limit);
+		if (share)
+			fetchers.back()->fetcher.set_share(share);
+	}
+
+	ioremap::warp::timer tm;
+
+	for (long i = 0, chunk = 0; i < requests_num; i += chunk_num, ++chunk) {
+		run_chunk(fetchers[chunk % fetchers_num]->fetcher, url, std::min(chunk_num, requests_num - i));
+	}
+
+	const auto usecs = tm.elapsed();
+
+	uint64_t connections = 0;
+	for (auto it = fetchers.begin(); it != fetchers.end(); ++it) {
+		connections += connections_count((*it)->fetcher);
+	}
+
+	std::cout << name << ": " << usecs << " usecs, performance: " << requests_num * 1000000 / usecs
+		  << ", new connections: " << connections << std::endl;
+
+	for (auto it = threads.begin(); it != threads.end(); ++it) {
+		(*it)->stop();
+	}
+}
+
+} // unnamed namespace
+
+int main(int argc, char *argv[])
+{
+	namespace bpo = boost::program_options;
+
+	bpo::options_description generic("Url fetchers' shared cache testing options");
+
+	std::string url;
+	long requests_num, chunk_num, connections_limit, fetchers_num;
+
+	generic.add_options()
+		("help", "This help message")
+		("url", bpo::value<std::string>(&url)->default_value("http://localhost:8080/get"), "Test URL for GET request")
+		("requests", bpo::value<long>(&requests_num)->default_value(100000), "Number of test calls")
+		("chunk", bpo::value<long>(&chunk_num)->default_value(100), "Send this many requests by single fetcher and then wait for all of them to complete")
+		("connections", bpo::value<long>(&connections_limit)->default_value(100), "Number of connections limit per fetcher")
+		("fetchers", bpo::value<long>(&fetchers_num)->default_value(4), "Number of url fetchers")
+		("separate-threads", "Run every fetcher's event loop in it's own thread, connections are not shared then")
+		;
+
+	bool separate_threads = false;
+
+	try {
+		bpo::variables_map vm;
+		bpo::store(bpo::command_line_parser(argc, argv).options(generic).run(), vm);
+		bpo::notify(vm);
+
+		if (vm.count("help") || chunk_num <= 0 || fetchers_num <= 0) {
+			std::cerr << generic << std::endl;
+			return -1;
+		}
+
+		separate_threads = vm.count("separate-threads");
+	} catch (...) {
+		std::cerr << generic << std::endl;
+		return -1;
+	}
+
+	auto logger_base = swarm::utils::logger::create("/dev/null", SWARM_LOG_INFO);
+	swarm::logger logger(logger_base, blackhole::log::attributes_t());
+
+	int flags = swarm::url_fetcher_share::share_dns | swarm::url_fetcher_share::share_ssl_sessions;
+	if (!separate_threads)
+		flags |= swarm::url_fetcher_share::share_connections;
+
+	auto share = std::make_shared<swarm::url_fetcher_share>(flags);
+
+	std::cout << "fetchers: " << fetchers_num << (separate_threads ? ", separate threads" : ", single thread")
+		  << ", shared: " << ((share->flags() & swarm::url_fetcher_share::share_dns) ? "dns " : "")
+		  << ((share->flags() & swarm::url_fetcher_share::share_ssl_sessions) ? "ssl-sessions " : "")
+		  << ((share->flags() & swarm::url_fetcher_share::share_connections) ? "connections" : "") << std::endl;
+
+	run_test("not shared", logger, std::shared_ptr<swarm::url_fetcher_share>(), url,
+		fetchers_num, separate_threads, connections_limit, requests_num, chunk_num);
+	run_test("shared", logger, share, url,
+		fetchers_num, separate_threads, connections_limit, requests_num, chunk_num);
+
+	return 0;
+}
@@ -31,6 +31,11 @@ namespace swarm {
 #define CONTENT_LENGTH_HEADER "Content-Length"
 #define TRANSFER_ENCODING_HEADER "Transfer-Encoding"
 #define CONTENT_TYPE_HEADER "Content-Type"
+#define DATE_HEADER "Date"
+#define EXPIRES_HEADER "Expires"
+#define ETAG_HEADER "ETag"
+#define IF_NONE_MATCH_HEADER "If-None-Match"
+#define CACHE_CONTROL_HEADER "Cache-Control"
 
 const std::string http_headers::CHUNKED_TRANSFER_ENCODING = "chunked";
 const std::string http_headers::CONNECTION_KEEP_ALIVE = "Keep-Alive";
@@ -485,6 +490,45 @@ void http_headers::set_if_modified_since(time_t time)
 	set_if_modified_since(convert_to_http_date(time));
 }
 
+boost::optional<time_t> http_headers::date() const
+{
+	if (auto http_date = get(DATE_HEADER))
+		return convert_from_http_date(*http_date);
+	return boost::none;
+}
+
+void http_headers::set_date(time_t time)
+{
+	p->set_header(DATE_HEADER, convert_to_http_date(time));
+}
+
+boost::optional<time_t> http_headers::expires() const
+{
+	if (auto http_date = get(EXPIRES_HEADER))
+		return convert_from_http_date(*http_date);
+	return boost::none;
+}
+
+boost::optional<std::string> http_headers::etag() const
+{
+	return get(ETAG_HEADER);
+}
+
+boost::optional<std::string> http_headers::if_none_match() const
+{
+	return get(IF_NONE_MATCH_HEADER);
+}
+
+void http_headers::set_if_none_match(const std::string &etag)
+{
+	p->set_header(IF_NONE_MATCH_HEADER, etag);
+}
+
+boost::optional<std::string> http_headers::cache_control() const
+{
+	return get(CACHE_CONTROL_HEADER);
+}
+
 void http_headers::set_content_length(size_t length)
 {
 	char buffer[20];
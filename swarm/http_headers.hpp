@@ -242,6 +242,47 @@ public:
 	 */
 	void set_if_modified_since(time_t time);
 
+	/*!
+	 * Returnes time the message was generated at, passed by Date HTTP header.
+	 *
+	 * \attention Returned time is number of seconds passed after start of UNIX epoch.
+	 */
+	boost::optional<time_t> date() const;
+	/*!
+	 * Sets the value of Date HTTP header to \a time.
+	 *
+	 * \attention \a Time is number of seconds passed after start of UNIX epoch.
+	 */
+	void set_date(time_t time);
+	/*!
+	 * Returnes time after which the response is stale, passed by Expires HTTP header.
+	 *
+	 * Invalid date is returned as zero, such response is already expired.
+	 *
+	 * \attention Returned time is number of seconds passed after start of UNIX epoch.
+	 */
+	boost::optional<time_t> expires() const;
+
+	/*!
+	 * \brief Returnes the value of ETag header.
+	 */
+	boost::optional<std::string> etag() const;
+	/*!
+	 * \brief Returnes the value of If-None-Match header.
+	 */
+	boost::optional<std::string> if_none_match() const;
+	/*!
+	 * \brief Sets the value of If-None-Match header to \a etag.
+	 *
+	 * If entry's ETag is equal to \a etag server should reply by Not Modified 304 code.
+	 */
+	void set_if_none_match(const std::string &etag);
+
+	/*!
+	 * \brief Returnes the value of Cache-Control header.
+	 */
+	boost::optional<std::string> cache_control() const;
+
 	/*!
 	 * \brief Sets the value of Content-Length header to \a length;
 	 */
@@ -74,7 +74,7 @@ void http_request::set_url(const swarm::url &url)
 
 void http_request::set_url(const std::string &url)
 {
-	m_data->url = std::move(swarm::url(url));
+	m_data->url = swarm::url::from_request_target(url);
 }
 
 http_headers &http_request::headers()
@@ -19,6 +19,11 @@
 #include <stdexcept>
 #include <iostream>
 #include <vector>
+#include <algorithm>
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <unordered_map>
 #include <punycode.h>
 #include <stringprep.h>
 
@@ -49,7 +54,10 @@ public:
 		has_original    = 0x04,
 		has_changes     = 0x08,
 		query_parsed    = 0x10,
-		has_human_readable = 0x20
+		has_human_readable = 0x20,
+		request_target  = 0x40,
+		has_serialized  = 0x80,
+		query_exposed   = 0x100
 	};
 
 	url_private() : state(invalid)
@@ -57,16 +65,19 @@ public:
 	}
 
 	void ensure_data() const;
+	bool parse_origin_form() const;
 	void set_uri(const UriUriA &uri);
 	void start_modifications()
 	{
 		if (state & has_changes) {
+			state &= ~has_serialized;
 			return;
 		}
 		ensure_data();
-		state = parsed | has_changes | (state & query_parsed);
+		state = parsed | has_changes | (state & (query_parsed | query_exposed));
 		original = std::string();
 		human_readable = std::string();
+		serialized = std::string();
 	}
 
 	mutable std::string scheme;
@@ -79,6 +90,7 @@ public:
 	mutable url_query query;
 	mutable std::string fragment;
 	mutable std::string human_readable;
+	mutable std::string serialized;
 
 	std::string original;
 
@@ -100,6 +112,169 @@ static char to_hex(int value)
 	return hex[value];
 }
 
+static int from_hex(char ch)
+{
+	if (ch >= '0' && ch <= '9')
+		return ch - '0';
+	if (ch >= 'a' && ch <= 'f')
+		return ch - 'a' + 10;
+	return ch - 'A' + 10;
+}
+
+//! unreserved = ALPHA / DIGIT / "-" / "." / "_" / "~"
+static bool is_unreserved(char ch)
+{
+	return (ch >= 'a' && ch <= 'z')
+		|| (ch >= 'A' && ch <= 'Z')
+		|| (ch >= '0' && ch <= '9')
+		|| ch == '-' || ch == '.' || ch == '_' || ch == '~';
+}
+
+//! pchar = unreserved / pct-encoded / sub-delims / ":" / "@", percent-encoding is checked separately
+static bool is_plain_pchar(char ch)
+{
+	if (is_unreserved(ch))
+		return true;
+
+	switch (ch) {
+	case '!': case '$': case '&': case '\'': case '(': case ')':
+	case '*': case '+': case ',': case ';': case '=':
+	case ':': case '@':
+		return true;
+	default:
+		return false;
+	}
+}
+
+/*
+ * Returns true if there is percent-encoded character at \a position of \a text and stores it to \a result.
+ *
+ * Only encodings which are not changed by uriparser's normalization are accepted,
+ * that is upper-case hex digits of not unreserved character.
+ */
+static bool parse_normalized_percent(const std::string &text, size_t position, char &result)
+{
+	if (position + 2 >= text.size())
+		return false;
+
+	const char high = text[position + 1];
+	const char low = text[position + 2];
+
+	if (!is_hex(high) || !is_hex(low) || (high >= 'a' && high <= 'f') || (low >= 'a' && low <= 'f'))
+		return false;
+
+	// Encoded zero is left for uriparser as it terminates C strings
+	result = char(from_hex(high) * 16 + from_hex(low));
+	return result != '\0' && !is_unreserved(result);
+}
+
+/*
+ * Bounded LRU cache of host conversions.
+ *
+ * Hosts are distributed over independently locked shards, so threads parsing urls
+ * of different hosts rarely wait for each other. Capacity is shared equally between shards.
+ */
+class host_cache
+{
+public:
+	enum {
+		shards_count = 16,
+		default_capacity = 16 * 1024
+	};
+
+	host_cache() : m_shard_capacity(default_capacity / shards_count)
+	{
+	}
+
+	bool find(const std::string &host, std::string &result)
+	{
+		if (m_shard_capacity.load(std::memory_order_relaxed) == 0)
+			return false;
+
+		shard &cache = shard_for(host);
+		std::lock_guard<std::mutex> lock(cache.mutex);
+
+		auto it = cache.index.find(host);
+		if (it == cache.index.end())
+			return false;
+
+		// Move the entry to the front, so least recently used ones are at the back
+		cache.entries.splice(cache.entries.begin(), cache.entries, it->second);
+		result = it->second->second;
+		return true;
+	}
+
+	void insert(const std::string &host, const std::string &result)
+	{
+		const size_t capacity = m_shard_capacity.load(std::memory_order_relaxed);
+		if (capacity == 0)
+			return;
+
+		shard &cache = shard_for(host);
+		std::lock_guard<std::mutex> lock(cache.mutex);
+
+		if (cache.index.find(host) != cache.index.end())
+			return;
+
+		cache.entries.emplace_front(host, result);
+		cache.index.emplace(host, cache.entries.begin());
+
+		shrink(cache, capacity);
+	}
+
+	void set_capacity(size_t capacity)
+	{
+		const size_t shard_capacity = (capacity + shards_count - 1) / shards_count;
+		m_shard_capacity.store(shard_capacity, std::memory_order_relaxed);
+
+		for (size_t i = 0; i < shards_count; ++i) {
+			std::lock_guard<std::mutex> lock(m_shards[i].mutex);
+			shrink(m_shards[i], shard_capacity);
+		}
+	}
+
+private:
+	typedef std::list<std::pair<std::string, std::string>> entries_list;
+
+	struct shard
+	{
+		std::mutex mutex;
+		entries_list entries;
+		std::unordered_map<std::string, entries_list::iterator> index;
+	};
+
+	shard &shard_for(const std::string &host)
+	{
+		return m_shards[std::hash<std::string>()(host) % shards_count];
+	}
+
+	static void shrink(shard &cache, size_t capacity)
+	{
+		while (cache.index.size() > capacity) {
+			cache.index.erase(cache.entries.back().first);
+			cache.entries.pop_back();
+		}
+	}
+
+	std::atomic<size_t> m_shard_capacity;
+	shard m_shards[shards_count];
+};
+
+static host_cache &encoded_hosts()
+{
+	static host_cache cache;
+	return cache;
+}
+
+static host_cache &decoded_hosts()
+{
+	static host_cache cache;
+	return cache;
+}
+
+static std::string encode_host_nocache(const std::string &host);
+static std::string decode_host_nocache(const std::string &host);
+
 //! Returns puny-encoded host if it's not rfc-compatible
 static std::string encode_host(const std::string &host)
 {
@@ -119,6 +294,34 @@ static std::string encode_host(const std::string &host)
 		return host;
 	}
 
+	std::string result;
+	if (!encoded_hosts().find(host, result)) {
+		result = encode_host_nocache(host);
+		encoded_hosts().insert(host, result);
+	}
+	return result;
+}
+
+//! Returns puny-decoded host if it's puny-encoded
+static std::string decode_host(const std::string &host)
+{
+	// Only labels starting with "xn--" are puny-encoded, trailing dot is removed by full decoding
+	if (host.compare(0, 4, "xn--", 4) != 0
+		&& host.find(".xn--") == std::string::npos
+		&& (host.empty() || host[host.size() - 1] != '.')) {
+		return host;
+	}
+
+	std::string result;
+	if (!decoded_hosts().find(host, result)) {
+		result = decode_host_nocache(host);
+		decoded_hosts().insert(host, result);
+	}
+	return result;
+}
+
+static std::string encode_host_nocache(const std::string &host)
+{
 	std::string new_host;
 	std::vector<char> buffer;
 
@@ -156,8 +359,7 @@ static std::string encode_host(const std::string &host)
 	return new_host;
 }
 
-//! Returns puny-decoded host if it's puny-encoded
-static std::string decode_host(const std::string &host)
+static std::string decode_host_nocache(const std::string &host)
 {
 	if (host.empty()) {
 		return host;
@@ -330,6 +532,9 @@ void url_private::ensure_data() const
 	if (state & parsed)
 		return;
 
+	if ((state & request_target) && parse_origin_form())
+		return;
+
 	UriUriA uri;
 	UriParserStateA parser_state;
 	parser_state.uri = &uri;
@@ -352,6 +557,99 @@ void url_private::ensure_data() const
 	const_cast<url_private *>(this)->set_uri(uri);
 }
 
+/*
+ * Parses origin-form request target, i.e. "/path?query", in a single pass.
+ *
+ * Path components are percent-decoded while they are split. Returns false without
+ * changing the url if target has any other form or would be changed by uriparser's
+ * normalization (dot segments, fragment, non-canonical percent-encoding, etc.),
+ * such targets are parsed by uriparser.
+ */
+bool url_private::parse_origin_form() const
+{
+	const std::string &target = original;
+	const size_t size = target.size();
+
+	if (size == 0 || target[0] != '/' || (size > 1 && target[1] == '/'))
+		return false;
+
+	std::string result_path(1, '/');
+	std::vector<std::string> result_components;
+	std::string component;
+
+	size_t position = 1;
+	size_t segment_start = 1;
+
+	for (;; ++position) {
+		const bool at_end = position == size || target[position] == '?';
+
+		if (at_end || target[position] == '/') {
+			const char *segment = target.data() + segment_start;
+			const size_t segment_size = position - segment_start;
+
+			// Dot segments are removed by normalization
+			if ((segment_size == 1 && segment[0] == '.')
+				|| (segment_size == 2 && segment[0] == '.' && segment[1] == '.')) {
+				return false;
+			}
+
+			// Path "/" has no components, while "/a/" has two of them: "a" and ""
+			if (!at_end || !result_components.empty() || segment_size > 0) {
+				if (!result_components.empty())
+					result_path += '/';
+				result_path += component;
+				result_components.push_back(component);
+				component.clear();
+			}
+
+			if (at_end)
+				break;
+
+			segment_start = position + 1;
+			continue;
+		}
+
+		char ch = target[position];
+		if (ch == '%') {
+			if (!parse_normalized_percent(target, position, ch))
+				return false;
+			position += 2;
+		} else if (!is_plain_pchar(ch)) {
+			return false;
+		}
+
+		component += ch;
+	}
+
+	// query = *( pchar / "/" / "?" ), it's kept encoded
+	const size_t query_start = position;
+	for (++position; position < size; ++position) {
+		char ch = target[position];
+		if (ch == '%') {
+			if (!parse_normalized_percent(target, position, ch))
+				return false;
+			position += 2;
+		} else if (!is_plain_pchar(ch) && ch != '/' && ch != '?') {
+			return false;
+		}
+	}
+
+	if (query_start < size)
+		raw_query.assign(target, query_start + 1, std::string::npos);
+	else
+		raw_query.clear();
+
+	path.swap(result_path);
+	path_components.swap(result_components);
+	scheme.clear();
+	host.clear();
+	fragment.clear();
+	port = boost::none;
+
+	state |= parsed;
+	return true;
+}
+
 void url_private::set_uri(const UriUriA &uri)
 {
 	try {
@@ -440,6 +738,19 @@ url url::from_user_input(const std::string &url)
 	return std::move(swarm::url(encode_url(url)));
 }
 
+url url::from_request_target(const std::string &target)
+{
+	swarm::url result(target);
+	result.p->state |= url_private::request_target;
+	return std::move(result);
+}
+
+void url::set_idn_cache_capacity(size_t capacity)
+{
+	encoded_hosts().set_capacity(capacity);
+	decoded_hosts().set_capacity(capacity);
+}
+
 const std::string &url::original() const
 {
 	return p->original;
@@ -490,7 +801,7 @@ public:
 			m_path_segments[i - 1].next = &m_path_segments[i];
 		}
 
-		m_uri.pathHead = &m_path_segments[0];
+		m_uri.pathHead = m_path_segments.empty() ? NULL : &m_path_segments[0];
 	}
 
 	uri_generator(const uri_generator &other) = delete;
@@ -516,6 +827,10 @@ std::string url::to_string() const
 		return std::string();
 	}
 
+	if (p->state & url_private::has_serialized) {
+		return p->serialized;
+	}
+
 	uri_generator uri(*p);
 
 	int chars_required = 0;
@@ -536,6 +851,12 @@ std::string url::to_string() const
 
 	result.resize(result_size - 1);
 
+	// Query returned by non-const query() may be changed at any moment, so it can't be cached
+	if (!(p->state & url_private::query_exposed)) {
+		p->serialized = result;
+		p->state |= url_private::has_serialized;
+	}
+
 	return result;
 }
 
@@ -589,6 +910,134 @@ std::string url::to_human_readable() const
 	return result;
 }
 
+static void to_lower_ascii(std::string &text)
+{
+	for (auto it = text.begin(); it != text.end(); ++it) {
+		if (*it >= 'A' && *it <= 'Z')
+			*it += 'a' - 'A';
+	}
+}
+
+static uint16_t default_port(const std::string &scheme)
+{
+	if (scheme == "http" || scheme == "ws")
+		return 80;
+	if (scheme == "https" || scheme == "wss")
+		return 443;
+	if (scheme == "ftp")
+		return 21;
+	return 0;
+}
+
+/*
+ * Removes "." and ".." segments from path like remove_dot_segments of RFC 3986 does.
+ * Trailing dot segment leaves empty one, so "/a/b/.." becomes "/a/".
+ */
+static void remove_dot_segments(std::vector<std::string> &components)
+{
+	size_t count = 0;
+
+	for (size_t i = 0; i < components.size(); ++i) {
+		const bool is_last = (i + 1 == components.size());
+
+		if (components[i] == "..") {
+			if (count > 0)
+				--count;
+		} else if (components[i] != ".") {
+			if (count != i)
+				components[count].swap(components[i]);
+			++count;
+			continue;
+		}
+
+		if (is_last)
+			components[count++].clear();
+	}
+
+	components.resize(count);
+}
+
+std::string url::to_canonical(int flags) const
+{
+	if (!is_valid()) {
+		return std::string();
+	}
+
+	url_query query = url::query();
+
+	swarm::url result(*this);
+	url_private &data = *result.p;
+	data.start_modifications();
+
+	to_lower_ascii(data.scheme);
+	to_lower_ascii(data.host);
+
+	if (data.port && *data.port == default_port(data.scheme)) {
+		data.port = boost::none;
+	}
+
+	remove_dot_segments(data.path_components);
+
+	const bool absolute = !data.host.empty() || data.path.compare(0, 1, "/", 1) == 0;
+	if (!data.host.empty() && data.path_components.empty()) {
+		data.path_components.emplace_back();
+	}
+
+	data.path = absolute ? "/" : "";
+	for (auto it = data.path_components.begin(); it != data.path_components.end(); ++it) {
+		if (it != data.path_components.begin())
+			data.path += "/";
+		data.path += *it;
+	}
+
+	data.fragment = std::string();
+
+	if (flags & canonical_sort_query) {
+		std::vector<std::pair<std::string, std::string>> items;
+		items.reserve(query.count());
+		for (size_t i = 0; i < query.count(); ++i) {
+			items.push_back(query.item(i));
+		}
+
+		std::stable_sort(items.begin(), items.end(), [] (const std::pair<std::string, std::string> &first,
+				const std::pair<std::string, std::string> &second) {
+			return first.first < second.first;
+		});
+
+		query = url_query();
+		for (auto it = items.begin(); it != items.end(); ++it) {
+			query.add_item(it->first, it->second);
+		}
+	}
+
+	// Query is always composed from it's items to normalize it's percent-encoding
+	data.query = std::move(query);
+	data.raw_query = std::string();
+	data.state |= url_private::query_parsed;
+
+	return result.to_string();
+}
+
+uint64_t url::fingerprint(int flags) const
+{
+	const std::string canonical = to_canonical(flags);
+
+	// FNV-1a, the result is mixed by the finalizer of MurmurHash3 to spread low-entropy inputs over all bits
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (auto it = canonical.begin(); it != canonical.end(); ++it) {
+		hash ^= static_cast<unsigned char>(*it);
+		hash *= 0x100000001b3ull;
+	}
+
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdull;
+	hash ^= hash >> 33;
+	hash *= 0xc4ceb9fe1a85ec53ull;
+	hash ^= hash >> 33;
+
+	return hash;
+}
+
 url url::resolved(const url &relative) const
 {
 	p->ensure_data();
@@ -704,6 +1153,7 @@ url_query &url::query()
 	}
 
 	p->start_modifications();
+	p->state |= url_private::query_exposed;
 
 	return p->query;
 }
@@ -711,6 +1161,7 @@ url_query &url::query()
 void url::set_query(const std::string &query)
 {
 	p->start_modifications();
+	p->state &= ~url_private::query_parsed;
 	p->query = std::move(url_query());
 	p->raw_query = query;
 }
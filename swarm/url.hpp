@@ -17,6 +17,7 @@
 #ifndef COCAINE_CRAWLER_NETWORK_URL_H
 #define COCAINE_CRAWLER_NETWORK_URL_H
 
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <vector>
@@ -82,15 +83,73 @@ public:
 	 */
 	static url from_user_input(const std::string &url);
 
+	/*!
+	 * \brief Create url from HTTP request's \a target.
+	 *
+	 * Origin-form targets, i.e. "/path?query", are parsed lazily by single pass
+	 * without copying them through uriparser. All other forms are parsed as by url(const std::string &),
+	 * results are the same in both cases.
+	 */
+	static url from_request_target(const std::string &target);
+
+	/*!
+	 * \brief Set maximum number of internationalized hosts which conversions are cached.
+	 *
+	 * Punycode encoding and decoding of recently used hosts is cached by process-wide
+	 * thread-safe LRU cache of 16384 hosts by default, ASCII-only hosts are never cached.
+	 * Zero \a capacity disables the cache.
+	 */
+	static void set_idn_cache_capacity(size_t capacity);
+
 	/*!
 	 * \brief Returns original string this url was constructed by.
 	 */
 	const std::string &original() const;
 	/*!
 	 * \brief Return url encoded by percent encoding.
+	 *
+	 * Result is cached until the next modification of the url. It's not cached
+	 * after non-const query() was called as the query may be changed by returned reference.
 	 */
 	std::string to_string() const;
 
+	/*!
+	 * \brief Flags controlling the canonical form of the url.
+	 *
+	 * \sa to_canonical
+	 */
+	enum canonical_flags {
+		canonical_default    = 0x00,
+		//! Sort query items by their keys, order of items with equal keys is preserved
+		canonical_sort_query = 0x01
+	};
+
+	/*!
+	 * \brief Returns canonical form of the url encoded by percent encoding.
+	 *
+	 * Urls referencing the same resource are likely to have the same canonical form:
+	 * \li scheme and host are lower-cased (only ASCII letters, host is compared in it's decoded form),
+	 * \li port is omitted if it is default for the scheme (80 for http and ws, 443 for https and wss, 21 for ftp),
+	 * \li "." and ".." path segments are removed,
+	 * \li empty path is replaced by "/" if host is defined,
+	 * \li fragment and empty query are omitted,
+	 * \li query items are sorted by keys if \a flags contain canonical_sort_query.
+	 *
+	 * Percent-encoding is normalized the same way as by to_string.
+	 * Returns empty string for invalid url.
+	 */
+	std::string to_canonical(int flags = canonical_default) const;
+
+	/*!
+	 * \brief Returns 64-bit hash of canonical form of the url.
+	 *
+	 * Suitable for deduplication and routing, but not as cryptographic hash.
+	 * Value is stable between processes and hosts.
+	 *
+	 * \sa to_canonical
+	 */
+	uint64_t fingerprint(int flags = canonical_default) const;
+
 	/*!
 	 * \brief Returns human readable url representation
 	 */
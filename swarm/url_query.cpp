@@ -18,16 +18,205 @@
 
 #include <uriparser/Uri.h>
 
+#include <cstring>
+#include <unordered_map>
 #include <vector>
 #include <string>
 
 namespace ioremap {
 namespace swarm {
 
+/*
+ * Query is parsed lazily: on first access the raw string is split into the table
+ * of offsets and every item is decoded only when it's requested.
+ * Decoding follows uriDissectQueryMallocA: items are separated by '&', key and value
+ * by the first '=', '+' is decoded as space, items with empty key and without value are skipped.
+ */
 class network_query_list_private
 {
 public:
-	std::vector<std::pair<std::string, std::string> > items;
+	enum {
+		// Lists with more items are looked up by hash index
+		index_threshold = 8
+	};
+
+	struct entry
+	{
+		size_t key_begin;
+		size_t key_end;
+		size_t value_end;
+		bool key_decoded;
+		bool value_decoded;
+	};
+
+	network_query_list_private() : parsed(true), index_valid(false)
+	{
+	}
+
+	void set_raw(const std::string &query)
+	{
+		raw = query;
+		parsed = false;
+		entries.clear();
+		items.clear();
+		invalidate_index();
+	}
+
+	void ensure_parsed()
+	{
+		if (parsed)
+			return;
+
+		parsed = true;
+
+		size_t begin = 0;
+		while (begin <= raw.size()) {
+			size_t end = raw.find('&', begin);
+			if (end == std::string::npos)
+				end = raw.size();
+
+			size_t equals = raw.find('=', begin);
+			if (equals == std::string::npos || equals > end)
+				equals = end;
+
+			if (equals != begin || equals != end) {
+				entry item = { begin, equals, end, false, false };
+				entries.push_back(item);
+			}
+
+			begin = end + 1;
+		}
+
+		items.resize(entries.size());
+	}
+
+	const std::string &key(size_t index)
+	{
+		entry &item = entries[index];
+		if (!item.key_decoded) {
+			decode(item.key_begin, item.key_end, items[index].first);
+			item.key_decoded = true;
+		}
+		return items[index].first;
+	}
+
+	const std::pair<std::string, std::string> &item(size_t index)
+	{
+		entry &item = entries[index];
+		key(index);
+		if (!item.value_decoded) {
+			if (item.key_end != item.value_end)
+				decode(item.key_end + 1, item.value_end, items[index].second);
+			item.value_decoded = true;
+		}
+		return items[index];
+	}
+
+	void add(const std::string &key, const std::string &value)
+	{
+		ensure_parsed();
+
+		entry item = { 0, 0, 0, true, true };
+		entries.push_back(item);
+		items.emplace_back(key, value);
+
+		if (index_valid)
+			index.insert(std::make_pair(key, items.size() - 1));
+	}
+
+	void remove(size_t index)
+	{
+		ensure_parsed();
+
+		entries.erase(entries.begin() + index);
+		items.erase(items.begin() + index);
+		invalidate_index();
+	}
+
+	size_t find(const char *name, size_t name_size)
+	{
+		ensure_parsed();
+
+		if (entries.size() > index_threshold) {
+			ensure_index();
+			auto it = index.find(std::string(name, name_size));
+			return it == index.end() ? entries.size() : it->second;
+		}
+
+		for (size_t i = 0; i < entries.size(); ++i) {
+			const std::string &item_key = key(i);
+			if (item_key.size() == name_size && item_key.compare(0, name_size, name, name_size) == 0)
+				return i;
+		}
+
+		return entries.size();
+	}
+
+	std::string raw;
+	bool parsed;
+	std::vector<entry> entries;
+	std::vector<std::pair<std::string, std::string>> items;
+
+private:
+	void ensure_index()
+	{
+		if (index_valid)
+			return;
+
+		// The first item wins for repeated keys, as by linear search
+		index.clear();
+		index.reserve(entries.size());
+		for (size_t i = 0; i < entries.size(); ++i)
+			index.insert(std::make_pair(key(i), i));
+
+		index_valid = true;
+	}
+
+	void invalidate_index()
+	{
+		index.clear();
+		index_valid = false;
+	}
+
+	void decode(size_t begin, size_t end, std::string &result) const
+	{
+		result.clear();
+		result.reserve(end - begin);
+
+		for (size_t i = begin; i < end; ++i) {
+			const char ch = raw[i];
+
+			if (ch == '+') {
+				result += ' ';
+			} else if (ch == '%' && i + 2 < end && is_hex(raw[i + 1]) && is_hex(raw[i + 2])) {
+				const char decoded = char(from_hex(raw[i + 1]) * 16 + from_hex(raw[i + 2]));
+				// Items were C strings, so they ended at decoded zero
+				if (decoded == '\0')
+					return;
+				result += decoded;
+				i += 2;
+			} else {
+				result += ch;
+			}
+		}
+	}
+
+	static bool is_hex(char ch)
+	{
+		return (ch >= '0' && ch <= '9') || (ch >= 'a' && ch <= 'f') || (ch >= 'A' && ch <= 'F');
+	}
+
+	static int from_hex(char ch)
+	{
+		if (ch >= '0' && ch <= '9')
+			return ch - '0';
+		if (ch >= 'a' && ch <= 'f')
+			return ch - 'a' + 10;
+		return ch - 'A' + 10;
+	}
+
+	std::unordered_map<std::string, size_t> index;
+	bool index_valid;
 };
 
 url_query::url_query() : p(new network_query_list_private)
@@ -70,37 +259,26 @@ url_query &url_query::operator =(const url_query &other)
 
 void url_query::set_query(const std::string &query)
 {
-	int item_count = 0;
-	UriQueryListA *query_list = NULL;
-
-	uriDissectQueryMallocA(&query_list, &item_count,
-			       query.c_str(), query.c_str() + query.size());
-
-	p->items.clear();
-	p->items.reserve(item_count);
-
-	for (auto it = query_list; it; it = it->next) {
-		p->items.emplace_back(it->key, it->value ? it->value : std::string());
-	}
-
-	uriFreeQueryListA(query_list);
+	p->set_raw(query);
 }
 
 std::string url_query::to_string() const
 {
-	if (p->items.empty())
+	p->ensure_parsed();
+
+	if (p->entries.empty())
 		return std::string();
 
-	std::vector<UriQueryListA> items(p->items.size());
+	std::vector<UriQueryListA> items(p->entries.size());
 
-	for (size_t i = 0; i < p->items.size(); ++i) {
+	for (size_t i = 0; i < p->entries.size(); ++i) {
 		auto &list_entry = items[i];
-		auto &item = p->items[i];
+		auto &item = p->item(i);
 
 		list_entry.key = item.first.c_str();
 		list_entry.value = item.second.c_str();
 
-		if (i + 1 < p->items.size())
+		if (i + 1 < p->entries.size())
 			list_entry.next = &items[i + 1];
 		else
 			list_entry.next = NULL;
@@ -119,52 +297,57 @@ std::string url_query::to_string() const
 
 size_t url_query::count() const
 {
-	return p->items.size();
+	p->ensure_parsed();
+	return p->entries.size();
 }
 
 const std::pair<std::string, std::string> &url_query::item(size_t index) const
 {
-	return p->items[index];
+	p->ensure_parsed();
+	return p->item(index);
 }
 
 void url_query::add_item(const std::string &key, const std::string &value)
 {
-	p->items.emplace_back(key, value);
+	p->add(key, value);
 }
 
 void url_query::remove_item(size_t index)
 {
-	p->items.erase(p->items.begin() + index);
+	p->remove(index);
 }
 
 bool url_query::has_item(const std::string &key) const
 {
-	for (size_t i = 0; i < p->items.size(); ++i) {
-		if (p->items[i].first == key)
-			return true;
-	}
-	return false;
+	return p->find(key.c_str(), key.size()) != p->entries.size();
 }
 
 boost::optional<std::string> url_query::item_value(const std::string &key) const
 {
-	for (size_t i = 0; i < p->items.size(); ++i) {
-		if (p->items[i].first == key)
-			return p->items[i].second;
-	}
-	return boost::none;
+	const size_t index = p->find(key.c_str(), key.size());
+	if (index == p->entries.size())
+		return boost::none;
+	return p->item(index).second;
 }
 
 boost::optional<std::string> url_query::item_value(const char *key) const
 {
-	const size_t key_size = strlen(key);
+	const size_t index = p->find(key, strlen(key));
+	if (index == p->entries.size())
+		return boost::none;
+	return p->item(index).second;
+}
+
+std::vector<std::string> url_query::item_values(const std::string &key) const
+{
+	p->ensure_parsed();
 
-	for (size_t i = 0; i < p->items.size(); ++i) {
-		const auto &item = p->items[i];
-		if (item.first.compare(0, item.first.size(), key, key_size) == 0)
-			return item.second;
+	std::vector<std::string> result;
+	for (size_t i = 0; i < p->entries.size(); ++i) {
+		if (p->key(i) == key)
+			result.push_back(p->item(i).second);
 	}
-	return boost::none;
+	return result;
 }
 
 } // namespace swarm
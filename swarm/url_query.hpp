@@ -20,6 +20,7 @@
 #include <memory>
 #include <utility>
 #include <string>
+#include <vector>
 
 #include <boost/optional.hpp>
 #include <boost/lexical_cast.hpp>
@@ -34,6 +35,9 @@ class network_query_list_private;
  *
  * Url query list is usually an &-separated list of key-value pairs.
  *
+ * Query is parsed lazily on the first access, every item is decoded only when it's requested.
+ * Queries with many items are looked up by hash index.
+ *
  * \sa url
  */
 class url_query
@@ -114,6 +118,9 @@ public:
 	 * \brief Returnes item stored by \a key.
 	 *
 	 * If there is no such item invalid boost::optional is returned.
+	 * If there are several items with the same \a key the first one is returned.
+	 *
+	 * \sa item_values
 	 */
 	boost::optional<std::string> item_value(const std::string &key) const;
 	/*!
@@ -121,6 +128,11 @@ public:
 	 */
 	boost::optional<std::string> item_value(const char *key) const;
 
+	/*!
+	 * \brief Returnes values of all items stored by \a key in order of their appearance.
+	 */
+	std::vector<std::string> item_values(const std::string &key) const;
+
 	/*!
 	 * \overload
 	 *
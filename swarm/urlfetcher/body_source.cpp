@@ -0,0 +1,222 @@
+/*
+ * Copyright 2015+ Ruslan Nigmatullin <euroelessar@yandex.ru>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "body_source.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <unistd.h>
+
+namespace ioremap {
+namespace swarm {
+
+const size_t body_source::read_pause = size_t(-1);
+const size_t body_source::read_abort = size_t(-2);
+
+body_source::body_source() : m_manager(NULL), m_request(NULL)
+{
+}
+
+body_source::~body_source()
+{
+}
+
+bool body_source::rewind()
+{
+	return false;
+}
+
+buffers_body_source::buffers_body_source(std::vector<boost::asio::const_buffer> &&buffers,
+	const std::shared_ptr<void> &owner) :
+	m_buffers(std::move(buffers)), m_owner(owner), m_size(0), m_index(0), m_offset(0)
+{
+	for (auto it = m_buffers.begin(); it != m_buffers.end(); ++it) {
+		m_size += boost::asio::buffer_size(*it);
+	}
+}
+
+int64_t buffers_body_source::size() const
+{
+	return m_size;
+}
+
+size_t buffers_body_source::read(const boost::asio::mutable_buffer &buffer)
+{
+	char *data = boost::asio::buffer_cast<char *>(buffer);
+	const size_t size = boost::asio::buffer_size(buffer);
+	size_t result = 0;
+
+	while (result < size && m_index < m_buffers.size()) {
+		const char *source = boost::asio::buffer_cast<const char *>(m_buffers[m_index]);
+		const size_t source_size = boost::asio::buffer_size(m_buffers[m_index]);
+		const size_t count = std::min(size - result, source_size - m_offset);
+
+		memcpy(data + result, source + m_offset, count);
+		result += count;
+		m_offset += count;
+
+		if (m_offset == source_size) {
+			++m_index;
+			m_offset = 0;
+		}
+	}
+
+	return result;
+}
+
+bool buffers_body_source::rewind()
+{
+	m_index = 0;
+	m_offset = 0;
+	return true;
+}
+
+file_body_source::file_body_source(int fd, int64_t offset, int64_t size, bool close_fd) :
+	m_fd(fd), m_offset(offset), m_size(size), m_position(0), m_close_fd(close_fd)
+{
+}
+
+file_body_source::~file_body_source()
+{
+	if (m_close_fd)
+		::close(m_fd);
+}
+
+int64_t file_body_source::size() const
+{
+	return m_size;
+}
+
+size_t file_body_source::read(const boost::asio::mutable_buffer &buffer)
+{
+	const size_t size = std::min<int64_t>(boost::asio::buffer_size(buffer), m_size - m_position);
+	if (size == 0)
+		return 0;
+
+	ssize_t result;
+	do {
+		result = ::pread(m_fd, boost::asio::buffer_cast<char *>(buffer), size, m_offset + m_position);
+	} while (result < 0 && errno == EINTR);
+
+	// File is shorter than it was promised, so the request can't be finished
+	if (result <= 0)
+		return read_abort;
+
+	m_position += result;
+	return result;
+}
+
+bool file_body_source::rewind()
+{
+	m_position = 0;
+	return true;
+}
+
+queue_body_source::queue_body_source(int64_t size, const consumed_handler_func &consumed_handler) :
+	m_offset(0), m_buffered(0), m_size(size), m_finished(false), m_aborted(false),
+	m_consumed_handler(consumed_handler)
+{
+}
+
+void queue_body_source::append(std::string &&data)
+{
+	if (data.empty())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_buffered += data.size();
+		m_chunks.emplace_back(std::move(data));
+	}
+
+	resume();
+}
+
+void queue_body_source::finish()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_finished = true;
+	}
+
+	resume();
+}
+
+void queue_body_source::abort()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_aborted = true;
+	}
+
+	resume();
+}
+
+size_t queue_body_source::buffered_size() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_buffered;
+}
+
+int64_t queue_body_source::size() const
+{
+	return m_size;
+}
+
+size_t queue_body_source::read(const boost::asio::mutable_buffer &buffer)
+{
+	char *data = boost::asio::buffer_cast<char *>(buffer);
+	const size_t size = boost::asio::buffer_size(buffer);
+	size_t result = 0;
+	size_t buffered = 0;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		if (m_aborted)
+			return read_abort;
+
+		while (result < size && !m_chunks.empty()) {
+			const std::string &chunk = m_chunks.front();
+			const size_t count = std::min(size - result, chunk.size() - m_offset);
+
+			memcpy(data + result, chunk.data() + m_offset, count);
+			result += count;
+			m_offset += count;
+
+			if (m_offset == chunk.size()) {
+				m_chunks.pop_front();
+				m_offset = 0;
+			}
+		}
+
+		if (result == 0)
+			return m_finished ? 0 : read_pause;
+
+		m_buffered -= result;
+		buffered = m_buffered;
+	}
+
+	if (m_consumed_handler)
+		m_consumed_handler(buffered);
+
+	return result;
+}
+
+} // namespace swarm
+} // namespace ioremap
@@ -0,0 +1,194 @@
+/*
+ * Copyright 2015+ Ruslan Nigmatullin <euroelessar@yandex.ru>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef IOREMAP_SWARM_BODY_SOURCE_HPP
+#define IOREMAP_SWARM_BODY_SOURCE_HPP
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <boost/asio/buffer.hpp>
+
+namespace ioremap {
+namespace swarm {
+
+class network_manager_private;
+
+/*!
+ * \brief The body_source class is an interface for providing request's body by parts.
+ *
+ * Body is read by url fetcher's event loop only when connection is ready to send it,
+ * so the whole body doesn't need to be in memory. If there is no data available yet
+ * read may return read_pause, the upload is continued after resume is called.
+ *
+ * Body source may be used by single request at a time.
+ */
+class body_source
+{
+public:
+	//! Returned by read if there is no data yet, upload is paused until resume is called
+	static const size_t read_pause;
+	//! Returned by read to abort the request
+	static const size_t read_abort;
+
+	body_source();
+	virtual ~body_source();
+
+	/*!
+	 * \brief Returns size of the body or -1 if it's unknown.
+	 *
+	 * Body of unknown size is sent by chunked transfer encoding.
+	 */
+	virtual int64_t size() const = 0;
+	/*!
+	 * \brief Reads next part of the body into \a buffer.
+	 *
+	 * Returns number of read bytes, zero at the end of the body, read_pause or read_abort.
+	 * It's called from the event loop's thread.
+	 */
+	virtual size_t read(const boost::asio::mutable_buffer &buffer) = 0;
+	/*!
+	 * \brief Restarts reading from the beginning of the body.
+	 *
+	 * It's needed if the body has to be sent again, i.e. after redirect.
+	 * Returns false if it's impossible, which is default implementation.
+	 */
+	virtual bool rewind();
+
+	/*!
+	 * \brief Continues upload paused by read_pause.
+	 *
+	 * Call it once new data is available. It's safe to call it from any thread and
+	 * at any moment, it does nothing if upload is not paused.
+	 */
+	void resume();
+
+private:
+	body_source(const body_source &other) = delete;
+	body_source &operator =(const body_source &other) = delete;
+
+	friend class network_manager_private;
+
+	std::mutex m_mutex;
+	network_manager_private *m_manager;
+	void *m_request;
+};
+
+/*!
+ * \brief The buffers_body_source class sends sequence of buffers without copying them to single one.
+ *
+ * Memory of buffers must be valid until request is finished, \a owner is kept alive till then.
+ */
+class buffers_body_source : public body_source
+{
+public:
+	buffers_body_source(std::vector<boost::asio::const_buffer> &&buffers,
+		const std::shared_ptr<void> &owner = std::shared_ptr<void>());
+
+	virtual int64_t size() const;
+	virtual size_t read(const boost::asio::mutable_buffer &buffer);
+	virtual bool rewind();
+
+private:
+	std::vector<boost::asio::const_buffer> m_buffers;
+	std::shared_ptr<void> m_owner;
+	int64_t m_size;
+	size_t m_index;
+	size_t m_offset;
+};
+
+/*!
+ * \brief The file_body_source class sends \a size bytes of file \a fd starting from \a offset.
+ *
+ * File is read by parts, so the upload uses bounded memory independently of it's size.
+ * If \a close_fd is true file descriptor is closed by destructor.
+ */
+class file_body_source : public body_source
+{
+public:
+	file_body_source(int fd, int64_t offset, int64_t size, bool close_fd = false);
+	~file_body_source();
+
+	virtual int64_t size() const;
+	virtual size_t read(const boost::asio::mutable_buffer &buffer);
+	virtual bool rewind();
+
+private:
+	int m_fd;
+	int64_t m_offset;
+	int64_t m_size;
+	int64_t m_position;
+	bool m_close_fd;
+};
+
+/*!
+ * \brief The queue_body_source class sends data as soon as it's appended by the producer.
+ *
+ * It's useful for proxying of uploads: producer appends chunks as they arrive and is notified
+ * by \a consumed_handler with number of still buffered bytes once part of them is sent,
+ * so it may stop receiving new data while too much of it is buffered.
+ *
+ * All methods except read and rewind are thread safe, \a consumed_handler is called
+ * from the event loop's thread.
+ */
+class queue_body_source : public body_source
+{
+public:
+	typedef std::function<void (size_t buffered)> consumed_handler_func;
+
+	queue_body_source(int64_t size = -1, const consumed_handler_func &consumed_handler = consumed_handler_func());
+
+	/*!
+	 * \brief Appends \a data to the end of the body.
+	 */
+	void append(std::string &&data);
+	/*!
+	 * \brief Marks the end of the body.
+	 */
+	void finish();
+	/*!
+	 * \brief Aborts the request, i.e. if the producer has failed to receive the body.
+	 */
+	void abort();
+
+	/*!
+	 * \brief Returns number of appended but not sent yet bytes.
+	 */
+	size_t buffered_size() const;
+
+	virtual int64_t size() const;
+	virtual size_t read(const boost::asio::mutable_buffer &buffer);
+
+private:
+	mutable std::mutex m_mutex;
+	std::deque<std::string> m_chunks;
+	size_t m_offset;
+	size_t m_buffered;
+	int64_t m_size;
+	bool m_finished;
+	bool m_aborted;
+	consumed_handler_func m_consumed_handler;
+};
+
+} // namespace swarm
+} // namespace ioremap
+
+#endif // IOREMAP_SWARM_BODY_SOURCE_HPP
@@ -157,8 +157,13 @@ int boost_event_loop::timer_request(long timeout_ms)
 	if (timeout_ms == 0) {
 		m_service.post(std::bind(&event_listener::on_timer, listener()));
 	} else if (timeout_ms > 0) {
+		event_listener *listener = this->listener();
 		m_timer.expires_from_now(boost::posix_time::millisec(timeout_ms));
-		m_timer.async_wait(std::bind(&event_listener::on_timer, listener()));
+		m_timer.async_wait([listener] (const boost::system::error_code &error) {
+			// Previous wait is cancelled by every request, it must not be reported as expired
+			if (error != boost::asio::error::operation_aborted)
+				listener->on_timer();
+		});
 	}
 
 	return 0;
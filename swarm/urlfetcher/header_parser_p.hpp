@@ -0,0 +1,107 @@
+/*
+ * Copyright 2015+ Ruslan Nigmatullin <euroelessar@yandex.ru>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef IOREMAP_SWARM_HEADER_PARSER_P_HPP
+#define IOREMAP_SWARM_HEADER_PARSER_P_HPP
+
+#include "../http_headers.hpp"
+
+#include <ctype.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace ioremap {
+namespace swarm {
+
+/*
+ * Reply's header lines are collected by curl's header callback and parsed at once
+ * by the end of headers, so headers of redirects and 100 Continue replies cost nothing
+ * but copying of their lines.
+ */
+
+static inline void trim_header_part(const char *&begin, const char *&end)
+{
+	while (begin < end && isspace(static_cast<unsigned char>(*begin)))
+		++begin;
+	while (begin < end && isspace(static_cast<unsigned char>(*(end - 1))))
+		--end;
+}
+
+// Returns whether the line starts a new reply, i.e. "HTTP/1.1 200 OK" or "HTTP/2 200"
+static inline bool is_status_line(const char *data, size_t size)
+{
+	return size >= 5 && memcmp(data, "HTTP/", 5) == 0;
+}
+
+// Returns whether the line ends headers of the reply
+static inline bool is_headers_end(const char *data, size_t size)
+{
+	return (size == 2 && data[0] == '\r' && data[1] == '\n') || (size == 1 && data[0] == '\n');
+}
+
+/*
+ * Parses header lines terminated by LF or CRLF and appends them to the headers.
+ * Lines started by whitespace continue the previous value (obs-fold of RFC 7230),
+ * they are joined by single space. Lines without colon are skipped.
+ */
+static inline void parse_header_lines(const char *data, size_t size, std::vector<headers_entry> &headers)
+{
+	const char *end = data + size;
+	headers.reserve(headers.size() + std::count(data, end, '\n'));
+
+	while (data < end) {
+		const char *lf = static_cast<const char *>(memchr(data, '\n', end - data));
+		const char *line_end = lf ? lf : end;
+
+		const char *begin = data;
+		data = lf ? lf + 1 : end;
+
+		if ((*begin == ' ' || *begin == '\t') && !headers.empty()) {
+			trim_header_part(begin, line_end);
+			if (begin == line_end)
+				continue;
+
+			std::string &value = headers.back().second;
+			if (!value.empty())
+				value += ' ';
+			value.append(begin, line_end);
+			continue;
+		}
+
+		const char *colon = static_cast<const char *>(memchr(begin, ':', line_end - begin));
+		if (!colon)
+			continue;
+
+		const char *name_end = colon;
+		const char *value_begin = colon + 1;
+		trim_header_part(begin, name_end);
+		trim_header_part(value_begin, line_end);
+
+		headers.emplace_back(std::piecewise_construct,
+			std::forward_as_tuple(begin, name_end),
+			std::forward_as_tuple(value_begin, line_end));
+	}
+}
+
+} // namespace swarm
+} // namespace ioremap
+
+#endif // IOREMAP_SWARM_HEADER_PARSER_P_HPP
@@ -0,0 +1,669 @@
+/*
+ * Copyright 2015+ Ruslan Nigmatullin <euroelessar@yandex.ru>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "response_cache_p.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+namespace ioremap {
+namespace swarm {
+
+static bool is_header(const headers_entry &entry, const char *name)
+{
+	return strcasecmp(entry.first.c_str(), name) == 0;
+}
+
+static std::string trimmed(const std::string &str, size_t begin, size_t end)
+{
+	while (begin < end && (str[begin] == ' ' || str[begin] == '\t'))
+		++begin;
+	while (end > begin && (str[end - 1] == ' ' || str[end - 1] == '\t'))
+		--end;
+	return str.substr(begin, end - begin);
+}
+
+cache_control::cache_control(const http_headers &headers) : no_store(false), no_cache(false)
+{
+	bool has_cache_control = false;
+	bool has_pragma_no_cache = false;
+
+	const auto &entries = headers.all();
+	for (auto it = entries.begin(); it != entries.end(); ++it) {
+		if (is_header(*it, "Pragma")) {
+			has_pragma_no_cache |= strcasecmp(trimmed(it->second, 0, it->second.size()).c_str(), "no-cache") == 0;
+			continue;
+		}
+
+		if (!is_header(*it, "Cache-Control"))
+			continue;
+
+		has_cache_control = true;
+		const std::string &value = it->second;
+
+		for (size_t begin = 0; begin < value.size();) {
+			size_t end = value.find(',', begin);
+			if (end == std::string::npos)
+				end = value.size();
+
+			const std::string directive = trimmed(value, begin, end);
+			begin = end + 1;
+
+			if (strcasecmp(directive.c_str(), "no-store") == 0) {
+				no_store = true;
+			} else if (strncasecmp(directive.c_str(), "no-cache", 8) == 0) {
+				// Field names of no-cache are ignored, whole reply is revalidated
+				no_cache = true;
+			} else if (strncasecmp(directive.c_str(), "max-age=", 8) == 0) {
+				const char *number = directive.c_str() + 8;
+				if (*number == '"')
+					++number;
+				max_age = std::max(0l, atol(number));
+			}
+		}
+	}
+
+	// Pragma is used only by HTTP/1.0 clients and servers which don't send Cache-Control
+	if (!has_cache_control && has_pragma_no_cache)
+		no_cache = true;
+}
+
+bool is_cacheable_request(const http_headers &headers)
+{
+	const auto &entries = headers.all();
+	for (auto it = entries.begin(); it != entries.end(); ++it) {
+		if (is_header(*it, "If-None-Match")
+			|| is_header(*it, "If-Modified-Since")
+			|| is_header(*it, "If-Match")
+			|| is_header(*it, "If-Unmodified-Since")
+			|| is_header(*it, "If-Range")
+			|| is_header(*it, "Range")
+			|| is_header(*it, "Authorization")) {
+			return false;
+		}
+	}
+
+	return !cache_control(headers).no_store;
+}
+
+boost::optional<time_t> response_expires(int code, const http_headers &headers, time_t now)
+{
+	switch (code) {
+	case 200:
+	case 203:
+	case 300:
+	case 301:
+	case 404:
+	case 410:
+		break;
+	default:
+		return boost::none;
+	}
+
+	const cache_control control(headers);
+	// Replies which differ by request's headers would need a key per variant
+	if (control.no_store || headers.has("Vary"))
+		return boost::none;
+
+	const bool has_validators = headers.has("ETag") || headers.has("Last-Modified");
+	const time_t date = headers.date().get_value_or(now);
+
+	long lifetime = 0;
+	if (control.no_cache) {
+		lifetime = 0;
+	} else if (control.max_age) {
+		lifetime = *control.max_age;
+	} else if (auto expires = headers.expires()) {
+		lifetime = *expires - date;
+	} else if (auto last_modified = headers.last_modified()) {
+		lifetime = std::max<long>(0, date - *last_modified) / 10;
+	}
+
+	if (auto age = headers.get("Age"))
+		lifetime -= atol(age->c_str());
+
+	if (lifetime <= 0 && !has_validators)
+		return boost::none;
+
+	return now + std::max(0l, lifetime);
+}
+
+void merge_not_modified(http_headers &headers, const http_headers &not_modified)
+{
+	const auto &entries = not_modified.all();
+	std::vector<std::string> replaced;
+
+	for (auto it = entries.begin(); it != entries.end(); ++it) {
+		// Not Modified reply describes the cached one, but not it's body
+		if (is_header(*it, "Content-Length") || is_header(*it, "Transfer-Encoding") || is_header(*it, "Content-Encoding"))
+			continue;
+
+		// Every header present in Not Modified reply replaces all cached values of it
+		if (std::find(replaced.begin(), replaced.end(), it->first) == replaced.end()) {
+			headers.remove(it->first);
+			replaced.push_back(it->first);
+		}
+		headers.add(*it);
+	}
+}
+
+cached_response::cached_response() : code(0), date(0), expires(0)
+{
+}
+
+size_t cached_response::size() const
+{
+	size_t result = sizeof(cached_response) + url.to_string().size() + body.size();
+
+	const auto &entries = headers.all();
+	for (auto it = entries.begin(); it != entries.end(); ++it) {
+		result += sizeof(headers_entry) + it->first.size() + it->second.size();
+	}
+
+	return result;
+}
+
+response_cache::~response_cache()
+{
+}
+
+/*
+ * Disk tier stores every entry in the file named by hash of the key.
+ * File is a sequence of length-prefixed strings: key, url, code, date, expires,
+ * number of headers, headers' names and values and finally the body.
+ */
+namespace {
+
+const char disk_format_tag[] = "swarm-cache-1";
+
+void write_string(FILE *file, const std::string &str)
+{
+	fprintf(file, "%zu\n", str.size());
+	fwrite(str.data(), 1, str.size(), file);
+	fputc('\n', file);
+}
+
+bool read_string(FILE *file, std::string &str)
+{
+	size_t size;
+	if (fscanf(file, "%zu", &size) != 1 || fgetc(file) != '\n')
+		return false;
+
+	str.resize(size);
+	return fread(&str[0], 1, size, file) == size && fgetc(file) == '\n';
+}
+
+bool read_number(FILE *file, long long &number)
+{
+	std::string str;
+	if (!read_string(file, str))
+		return false;
+
+	char *end = NULL;
+	number = strtoll(str.c_str(), &end, 10);
+	return !str.empty() && *end == '\0';
+}
+
+bool write_entry(const std::string &path, const std::string &key, const cached_response &response)
+{
+	// Entry is written to the temporary file first, so readers never see partial files
+	const std::string tmp_path = path + ".tmp";
+
+	FILE *file = fopen(tmp_path.c_str(), "wb");
+	if (!file)
+		return false;
+
+	const auto &headers = response.headers.all();
+
+	write_string(file, disk_format_tag);
+	write_string(file, key);
+	write_string(file, response.url.to_string());
+	write_string(file, std::to_string(response.code));
+	write_string(file, std::to_string(static_cast<long long>(response.date)));
+	write_string(file, std::to_string(static_cast<long long>(response.expires)));
+	write_string(file, std::to_string(headers.size()));
+	for (auto it = headers.begin(); it != headers.end(); ++it) {
+		write_string(file, it->first);
+		write_string(file, it->second);
+	}
+	write_string(file, response.body);
+
+	const bool success = !ferror(file);
+	if (fclose(file) != 0 || !success || rename(tmp_path.c_str(), path.c_str()) != 0) {
+		unlink(tmp_path.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+std::shared_ptr<cached_response> read_entry(const std::string &path, const std::string &key)
+{
+	FILE *file = fopen(path.c_str(), "rb");
+	if (!file)
+		return std::shared_ptr<cached_response>();
+
+	auto response = std::make_shared<cached_response>();
+	std::string tag;
+	std::string file_key;
+	std::string url;
+	long long code = 0;
+	long long date = 0;
+	long long expires = 0;
+	long long count = 0;
+
+	bool success = read_string(file, tag) && tag == disk_format_tag
+		&& read_string(file, file_key) && file_key == key
+		&& read_string(file, url)
+		&& read_number(file, code)
+		&& read_number(file, date)
+		&& read_number(file, expires)
+		&& read_number(file, count);
+
+	std::vector<headers_entry> headers;
+	for (long long i = 0; success && i < count; ++i) {
+		headers_entry entry;
+		success = read_string(file, entry.first) && read_string(file, entry.second);
+		headers.emplace_back(std::move(entry));
+	}
+
+	success = success && read_string(file, response->body);
+	fclose(file);
+
+	if (!success)
+		return std::shared_ptr<cached_response>();
+
+	response->url = swarm::url(url);
+	response->code = code;
+	response->date = date;
+	response->expires = expires;
+	response->headers.assign(std::move(headers));
+
+	return response;
+}
+
+} // namespace
+
+/*
+ * Memory tier is used by event loops' threads under the mutex. Disk tier belongs to it's own thread,
+ * which does all file operations, so neither event loops nor other fetchers sharing the cache wait
+ * for the disk. Entries are written in the background after they are put to memory, entries missed
+ * in memory are loaded back in the background and serve the following requests.
+ */
+class lru_response_cache_private
+{
+public:
+	typedef std::pair<std::string, std::shared_ptr<const cached_response>> memory_entry;
+	typedef std::pair<std::string, size_t> disk_entry;
+
+	struct disk_task
+	{
+		enum type_t {
+			load_entry,
+			store_entry,
+			remove_entry
+		};
+
+		type_t type;
+		std::string key;
+		std::shared_ptr<const cached_response> response;
+		// Generation of the load, it's outdated once the key is put or removed
+		uint64_t generation;
+	};
+
+	lru_response_cache_private(size_t memory_limit, const std::string &directory, size_t disk_limit) :
+		memory_limit(memory_limit), memory_size(0),
+		directory(directory), disk_limit(directory.empty() ? 0 : disk_limit), disk_size(0),
+		queue_size(0), queue_limit(std::max(memory_limit, disk_limit) / 4), last_generation(0), stopped(false)
+	{
+	}
+
+	// Most recently used entries are in the front of the lists
+	void touch_memory(std::list<memory_entry>::iterator it)
+	{
+		memory_lru.splice(memory_lru.begin(), memory_lru, it);
+	}
+
+	void remove_memory(const std::string &key)
+	{
+		auto it = memory_index.find(key);
+		if (it == memory_index.end())
+			return;
+
+		memory_size -= it->second->second->size();
+		memory_lru.erase(it->second);
+		memory_index.erase(it);
+	}
+
+	void put_memory(const std::string &key, const std::shared_ptr<const cached_response> &response)
+	{
+		remove_memory(key);
+
+		const size_t size = response->size();
+		if (size > memory_limit)
+			return;
+
+		memory_lru.emplace_front(key, response);
+		memory_index[key] = memory_lru.begin();
+		memory_size += size;
+
+		while (memory_size > memory_limit) {
+			memory_entry &oldest = memory_lru.back();
+			memory_size -= oldest.second->size();
+			memory_index.erase(oldest.first);
+			memory_lru.pop_back();
+		}
+	}
+
+	// Must be called under the mutex
+	void push_task(disk_task::type_t type, const std::string &key, const std::shared_ptr<const cached_response> &response)
+	{
+		uint64_t generation = 0;
+
+		if (type == disk_task::load_entry) {
+			// Concurrent misses of the same key are served by the single load
+			auto result = loading.emplace(key, last_generation + 1);
+			if (!result.second)
+				return;
+			generation = ++last_generation;
+		} else {
+			// Pending load would bring back the file older than the memory
+			loading.erase(key);
+		}
+
+		if (type == disk_task::store_entry) {
+			// Replies are kept in memory only while the disk doesn't keep up with them,
+			// the previous file must not be loaded instead of them
+			const size_t size = response->size();
+			if (queue_size + size > queue_limit) {
+				push_task(disk_task::remove_entry, key, std::shared_ptr<const cached_response>());
+				return;
+			}
+			queue_size += size;
+		}
+
+		disk_task task = { type, key, response, generation };
+		tasks.emplace_back(std::move(task));
+		condition.notify_one();
+	}
+
+	void run()
+	{
+		load_directory();
+
+		std::unique_lock<std::mutex> lock(mutex);
+		for (;;) {
+			condition.wait(lock, [this] () { return stopped || !tasks.empty(); });
+			if (tasks.empty())
+				break;
+
+			disk_task task = std::move(tasks.front());
+			tasks.pop_front();
+
+			if (task.type == disk_task::store_entry)
+				queue_size -= task.response->size();
+
+			// Pending writes are flushed on destruction, but nobody waits for loads anymore
+			if (task.type == disk_task::load_entry && (stopped || !is_current_load(task))) {
+				finish_load(task);
+				continue;
+			}
+
+			lock.unlock();
+			std::shared_ptr<const cached_response> response = process_task(task);
+			lock.lock();
+
+			if (task.type == disk_task::load_entry) {
+				// Key put or removed while the file was read is newer than the file
+				if (response && is_current_load(task) && memory_index.find(task.key) == memory_index.end())
+					put_memory(task.key, response);
+				finish_load(task);
+			}
+		}
+	}
+
+	bool is_current_load(const disk_task &task) const
+	{
+		auto it = loading.find(task.key);
+		return it != loading.end() && it->second == task.generation;
+	}
+
+	void finish_load(const disk_task &task)
+	{
+		if (is_current_load(task))
+			loading.erase(task.key);
+	}
+
+	// Disk tier's methods below are called only by the disk thread
+	std::shared_ptr<const cached_response> process_task(const disk_task &task)
+	{
+		const std::string name = file_name(task.key);
+
+		switch (task.type) {
+		case disk_task::load_entry: {
+			auto it = disk_index.find(name);
+			if (it == disk_index.end())
+				return std::shared_ptr<const cached_response>();
+
+			// File may belong to another key with the same hash, then it's kept
+			std::shared_ptr<const cached_response> response = read_entry(file_path(name), task.key);
+			if (response)
+				touch_disk(name, it->second->second);
+			return response;
+		}
+		case disk_task::store_entry:
+			if (write_entry(file_path(name), task.key, *task.response)) {
+				boost::system::error_code error;
+				const auto size = boost::filesystem::file_size(file_path(name), error);
+				touch_disk(name, error ? task.response->size() : size);
+			} else {
+				remove_disk(name);
+			}
+			break;
+		case disk_task::remove_entry:
+			remove_disk(name);
+			break;
+		}
+
+		return std::shared_ptr<const cached_response>();
+	}
+
+	static std::string file_name(const std::string &key)
+	{
+		char buffer[32];
+		snprintf(buffer, sizeof(buffer), "%016llx", static_cast<unsigned long long>(std::hash<std::string>()(key)));
+		return buffer;
+	}
+
+	std::string file_path(const std::string &name) const
+	{
+		return directory + "/" + name;
+	}
+
+	void touch_disk(const std::string &name, size_t size)
+	{
+		auto it = disk_index.find(name);
+		if (it != disk_index.end()) {
+			disk_size -= it->second->second;
+			disk_lru.erase(it->second);
+			disk_index.erase(it);
+		}
+
+		disk_lru.emplace_front(name, size);
+		disk_index[name] = disk_lru.begin();
+		disk_size += size;
+
+		while (disk_size > disk_limit && !disk_lru.empty()) {
+			disk_entry &oldest = disk_lru.back();
+			unlink(file_path(oldest.first).c_str());
+			disk_size -= oldest.second;
+			disk_index.erase(oldest.first);
+			disk_lru.pop_back();
+		}
+	}
+
+	void remove_disk(const std::string &name)
+	{
+		auto it = disk_index.find(name);
+		if (it == disk_index.end())
+			return;
+
+		unlink(file_path(name).c_str());
+		disk_size -= it->second->second;
+		disk_lru.erase(it->second);
+		disk_index.erase(it);
+	}
+
+	// Files of the previous run are added to the index from the oldest to the newest one
+	void load_directory()
+	{
+		namespace fs = boost::filesystem;
+
+		boost::system::error_code error;
+		fs::create_directories(directory, error);
+
+		std::vector<std::pair<time_t, disk_entry>> files;
+		for (fs::directory_iterator it(directory, error), end; !error && it != end; it.increment(error)) {
+			const std::string name = it->path().filename().string();
+
+			if (name.size() != 16 || name.find_first_not_of("0123456789abcdef") != std::string::npos) {
+				// Temporary files are left by interrupted writes
+				if (name.size() > 4 && name.compare(name.size() - 4, 4, ".tmp") == 0)
+					fs::remove(it->path(), error);
+				continue;
+			}
+
+			boost::system::error_code file_error;
+			const auto size = fs::file_size(it->path(), file_error);
+			const auto time = fs::last_write_time(it->path(), file_error);
+			if (!file_error)
+				files.emplace_back(time, disk_entry(name, size));
+		}
+
+		std::sort(files.begin(), files.end(), [] (const std::pair<time_t, disk_entry> &first,
+				const std::pair<time_t, disk_entry> &second) {
+			return first.first < second.first;
+		});
+
+		for (auto it = files.begin(); it != files.end(); ++it) {
+			touch_disk(it->second.first, it->second.second);
+		}
+	}
+
+	std::mutex mutex;
+
+	size_t memory_limit;
+	size_t memory_size;
+	std::list<memory_entry> memory_lru;
+	std::unordered_map<std::string, std::list<memory_entry>::iterator> memory_index;
+
+	std::string directory;
+	size_t disk_limit;
+	size_t disk_size;
+	std::list<disk_entry> disk_lru;
+	std::unordered_map<std::string, std::list<disk_entry>::iterator> disk_index;
+
+	// Tasks of the disk thread, guarded by the mutex
+	std::deque<disk_task> tasks;
+	// Generations of pending loads by keys
+	std::unordered_map<std::string, uint64_t> loading;
+	// Total size of replies waiting to be written
+	size_t queue_size;
+	size_t queue_limit;
+	uint64_t last_generation;
+	bool stopped;
+	std::condition_variable condition;
+	std::thread thread;
+};
+
+lru_response_cache::lru_response_cache(size_t memory_limit, const std::string &directory, size_t disk_limit) :
+	p(new lru_response_cache_private(memory_limit, directory, disk_limit))
+{
+	if (p->disk_limit != 0)
+		p->thread = std::thread(std::bind(&lru_response_cache_private::run, p));
+}
+
+lru_response_cache::~lru_response_cache()
+{
+	if (p->thread.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(p->mutex);
+			p->stopped = true;
+		}
+		p->condition.notify_one();
+		p->thread.join();
+	}
+
+	delete p;
+}
+
+std::shared_ptr<const cached_response> lru_response_cache::get(const std::string &key)
+{
+	std::lock_guard<std::mutex> lock(p->mutex);
+
+	auto it = p->memory_index.find(key);
+	if (it != p->memory_index.end()) {
+		p->touch_memory(it->second);
+		return it->second->second;
+	}
+
+	// The miss is sent to the server, the file is read for the next requests
+	if (p->disk_limit != 0)
+		p->push_task(lru_response_cache_private::disk_task::load_entry, key, std::shared_ptr<const cached_response>());
+
+	return std::shared_ptr<const cached_response>();
+}
+
+void lru_response_cache::put(const std::string &key, const std::shared_ptr<const cached_response> &response)
+{
+	std::lock_guard<std::mutex> lock(p->mutex);
+
+	p->put_memory(key, response);
+
+	if (p->disk_limit != 0)
+		p->push_task(lru_response_cache_private::disk_task::store_entry, key, response);
+}
+
+void lru_response_cache::remove(const std::string &key)
+{
+	std::lock_guard<std::mutex> lock(p->mutex);
+
+	p->remove_memory(key);
+	if (p->disk_limit != 0)
+		p->push_task(lru_response_cache_private::disk_task::remove_entry, key, std::shared_ptr<const cached_response>());
+}
+
+size_t lru_response_cache::max_entry_size() const
+{
+	return std::max(p->memory_limit, p->disk_limit) / 8;
+}
+
+} // namespace swarm
+} // namespace ioremap
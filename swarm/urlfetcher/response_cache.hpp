@@ -0,0 +1,129 @@
+/*
+ * Copyright 2015+ Ruslan Nigmatullin <euroelessar@yandex.ru>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef IOREMAP_SWARM_RESPONSE_CACHE_HPP
+#define IOREMAP_SWARM_RESPONSE_CACHE_HPP
+
+#include <ctime>
+#include <memory>
+#include <string>
+
+#include "../http_headers.hpp"
+#include "../url.hpp"
+
+namespace ioremap {
+namespace swarm {
+
+/*!
+ * \brief The cached_response struct is a reply stored by response_cache.
+ */
+struct cached_response
+{
+	cached_response();
+
+	int code;
+	//! Url the reply was received from, it differs from the key if redirects were followed
+	swarm::url url;
+	http_headers headers;
+	std::string body;
+	//! Time the reply was received or revalidated last time, seconds since UNIX epoch
+	time_t date;
+	//! Time after which the reply must be revalidated before use, seconds since UNIX epoch
+	time_t expires;
+
+	//! Approximate size of the entry in bytes
+	size_t size() const;
+};
+
+/*!
+ * \brief The response_cache class is an interface of storage of replies to GET requests.
+ *
+ * Cache is passed to url_fetcher::set_cache and may be shared by several url fetchers,
+ * so implementations must be thread safe. Methods are called from event loops' threads.
+ *
+ * Url fetcher decides which replies are stored and when they are fresh according to
+ * Cache-Control, Expires and Last-Modified headers. Stale replies are revalidated by
+ * If-None-Match and If-Modified-Since requests, Not Modified replies are passed to streams
+ * as cached ones.
+ */
+class response_cache
+{
+public:
+	virtual ~response_cache();
+
+	/*!
+	 * \brief Returns reply stored by \a key, which is request's url, or empty pointer.
+	 */
+	virtual std::shared_ptr<const cached_response> get(const std::string &key) = 0;
+	/*!
+	 * \brief Stores \a response by \a key replacing the previous one.
+	 */
+	virtual void put(const std::string &key, const std::shared_ptr<const cached_response> &response) = 0;
+	/*!
+	 * \brief Removes reply stored by \a key.
+	 */
+	virtual void remove(const std::string &key) = 0;
+	/*!
+	 * \brief Returns maximum size of the reply's body which may be stored.
+	 *
+	 * Bodies of cacheable replies are collected by url fetcher until they exceed it.
+	 */
+	virtual size_t max_entry_size() const = 0;
+};
+
+class lru_response_cache_private;
+
+/*!
+ * \brief The lru_response_cache class keeps recently used replies in memory and optionally on disk.
+ *
+ * Least recently used replies are evicted once total size exceeds the limit. If directory is set,
+ * every reply is also written to it's own file there, so replies evicted from memory are loaded
+ * back. Files left by the previous run are used too.
+ *
+ * Disk tier's files are read and written by the cache's own thread, so event loops never wait
+ * for the disk. Miss in memory is loaded in the background and serves the following requests,
+ * the missed request itself is sent to the server. Replies are not written while the disk
+ * falls behind by more than quarter of the largest limit.
+ */
+class lru_response_cache : public response_cache
+{
+public:
+	/*!
+	 * \brief Constructs cache of at most \a memory_limit bytes in memory.
+	 *
+	 * If \a directory is not empty, at most \a disk_limit bytes of files are kept there.
+	 * Replies larger than eighth part of the largest limit are not stored.
+	 * Pending writes are flushed by the destructor.
+	 */
+	explicit lru_response_cache(size_t memory_limit, const std::string &directory = std::string(), size_t disk_limit = 0);
+	~lru_response_cache();
+
+	std::shared_ptr<const cached_response> get(const std::string &key);
+	void put(const std::string &key, const std::shared_ptr<const cached_response> &response);
+	void remove(const std::string &key);
+	size_t max_entry_size() const;
+
+private:
+	lru_response_cache(const lru_response_cache &other) = delete;
+	lru_response_cache &operator =(const lru_response_cache &other) = delete;
+
+	lru_response_cache_private *p;
+};
+
+} // namespace swarm
+} // namespace ioremap
+
+#endif // IOREMAP_SWARM_RESPONSE_CACHE_HPP
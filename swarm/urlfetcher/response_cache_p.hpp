@@ -0,0 +1,59 @@
+/*
+ * Copyright 2015+ Ruslan Nigmatullin <euroelessar@yandex.ru>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef IOREMAP_SWARM_RESPONSE_CACHE_P_HPP
+#define IOREMAP_SWARM_RESPONSE_CACHE_P_HPP
+
+#include "response_cache.hpp"
+
+#include <boost/optional.hpp>
+
+namespace ioremap {
+namespace swarm {
+
+/*
+ * Directives of Cache-Control header which matter for the client's cache.
+ */
+struct cache_control
+{
+	cache_control(const http_headers &headers);
+
+	bool no_store;
+	bool no_cache;
+	boost::optional<long> max_age;
+};
+
+/*
+ * Returns whether the request may be served by the cache. Requests with their own conditions
+ * or ranges are always sent to the server.
+ */
+bool is_cacheable_request(const http_headers &headers);
+
+/*
+ * Returns time until which the reply is fresh, or none if it must not be stored.
+ * Replies without explicit lifetime are fresh for tenth part of time since their last modification.
+ */
+boost::optional<time_t> response_expires(int code, const http_headers &headers, time_t now);
+
+/*
+ * Updates headers of the cached reply by ones of Not Modified reply.
+ */
+void merge_not_modified(http_headers &headers, const http_headers &not_modified);
+
+} // namespace swarm
+} // namespace ioremap
+
+#endif // IOREMAP_SWARM_RESPONSE_CACHE_P_HPP
@@ -0,0 +1,330 @@
+/*
+ * Copyright 2015+ Ruslan Nigmatullin <euroelessar@yandex.ru>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sharded_url_fetcher.hpp"
+#include "boost_event_loop.hpp"
+
+#include <algorithm>
+#include <future>
+#include <iterator>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+namespace ioremap {
+namespace swarm {
+
+class url_fetcher_shard
+{
+public:
+	url_fetcher_shard(const swarm::logger &logger) :
+		work(new boost::asio::io_service::work(service)),
+		loop(service, logger),
+		fetcher(loop, logger)
+	{
+	}
+
+	void start()
+	{
+		thread = std::thread([this] () {
+			service.run();
+		});
+	}
+
+	void stop()
+	{
+		work.reset();
+		service.stop();
+		if (thread.joinable())
+			thread.join();
+	}
+
+	boost::asio::io_service service;
+	std::unique_ptr<boost::asio::io_service::work> work;
+	boost_event_loop loop;
+	url_fetcher fetcher;
+	std::thread thread;
+};
+
+sharded_url_fetcher::sharded_url_fetcher(size_t shards, const swarm::logger &logger, routing_policy policy) :
+	m_policy(policy), m_next(0)
+{
+	if (shards == 0)
+		shards = std::max(1u, std::thread::hardware_concurrency());
+
+	try {
+		for (size_t i = 0; i < shards; ++i) {
+			m_shards.emplace_back(new url_fetcher_shard(logger));
+			m_shards.back()->start();
+		}
+	} catch (...) {
+		for (auto it = m_shards.begin(); it != m_shards.end(); ++it) {
+			(*it)->stop();
+		}
+		throw;
+	}
+}
+
+sharded_url_fetcher::~sharded_url_fetcher()
+{
+	// Url fetchers are destroyed only after all threads are stopped
+	for (auto it = m_shards.begin(); it != m_shards.end(); ++it) {
+		(*it)->stop();
+	}
+}
+
+size_t sharded_url_fetcher::shards() const
+{
+	return m_shards.size();
+}
+
+void sharded_url_fetcher::set_total_limit(long active_connections)
+{
+	for_each_shard([active_connections] (url_fetcher &fetcher) {
+		fetcher.set_total_limit(active_connections);
+	});
+}
+
+void sharded_url_fetcher::set_host_limit(long active_connections)
+{
+	for_each_shard([active_connections] (url_fetcher &fetcher) {
+		fetcher.set_host_limit(active_connections);
+	});
+}
+
+void sharded_url_fetcher::set_http2_mode(url_fetcher::http2_mode mode)
+{
+	for_each_shard([mode] (url_fetcher &fetcher) {
+		fetcher.set_http2_mode(mode);
+	});
+}
+
+void sharded_url_fetcher::set_max_streams(long streams)
+{
+	for_each_shard([streams] (url_fetcher &fetcher) {
+		fetcher.set_max_streams(streams);
+	});
+}
+
+void sharded_url_fetcher::set_share(const std::shared_ptr<url_fetcher_share> &share)
+{
+	if (share && (share->flags() & url_fetcher_share::share_connections) && m_shards.size() > 1)
+		throw std::invalid_argument("connections can't be shared between shards' threads");
+
+	for_each_shard([share] (url_fetcher &fetcher) {
+		fetcher.set_share(share);
+	});
+}
+
+void sharded_url_fetcher::set_cache(const std::shared_ptr<response_cache> &cache)
+{
+	for_each_shard([cache] (url_fetcher &fetcher) {
+		fetcher.set_cache(cache);
+	});
+}
+
+void sharded_url_fetcher::get_host_statistics(const std::function<void (std::vector<url_fetcher::host_statistics> &&)> &handler)
+{
+	struct statistics_collector
+	{
+		std::mutex mutex;
+		std::vector<url_fetcher::host_statistics> statistics;
+		size_t remaining;
+		std::function<void (std::vector<url_fetcher::host_statistics> &&)> handler;
+	};
+
+	auto collector = std::make_shared<statistics_collector>();
+	collector->remaining = m_shards.size();
+	collector->handler = handler;
+
+	// Handler is called by the thread of the shard which reports the last
+	for (auto it = m_shards.begin(); it != m_shards.end(); ++it) {
+		(*it)->fetcher.get_host_statistics([collector] (std::vector<url_fetcher::host_statistics> &&statistics) {
+			std::unique_lock<std::mutex> lock(collector->mutex);
+			std::move(statistics.begin(), statistics.end(), std::back_inserter(collector->statistics));
+
+			if (--collector->remaining == 0) {
+				lock.unlock();
+				collector->handler(std::move(collector->statistics));
+			}
+		});
+	}
+}
+
+void sharded_url_fetcher::get_timing_statistics(const std::function<void (url_fetcher::timing_statistics &&)> &handler)
+{
+	struct statistics_collector
+	{
+		std::mutex mutex;
+		url_fetcher::timing_statistics statistics;
+		size_t remaining;
+		std::function<void (url_fetcher::timing_statistics &&)> handler;
+	};
+
+	auto collector = std::make_shared<statistics_collector>();
+	collector->remaining = m_shards.size();
+	collector->handler = handler;
+
+	for (auto it = m_shards.begin(); it != m_shards.end(); ++it) {
+		(*it)->fetcher.get_timing_statistics([collector] (url_fetcher::timing_statistics &&statistics) {
+			std::unique_lock<std::mutex> lock(collector->mutex);
+			collector->statistics.add(statistics);
+
+			if (--collector->remaining == 0) {
+				lock.unlock();
+				collector->handler(std::move(collector->statistics));
+			}
+		});
+	}
+}
+
+long sharded_url_fetcher::pending_requests() const
+{
+	long result = 0;
+	for (auto it = m_shards.begin(); it != m_shards.end(); ++it) {
+		result += (*it)->fetcher.pending_requests();
+	}
+	return result;
+}
+
+url_fetcher &sharded_url_fetcher::route(const url_fetcher::request &request)
+{
+	if (m_shards.size() == 1)
+		return m_shards.front()->fetcher;
+
+	if (m_policy == route_by_host) {
+		const size_t hash = std::hash<std::string>()(request.url().host());
+		return m_shards[hash % m_shards.size()]->fetcher;
+	}
+
+	// Search is started from different shards, so equally loaded ones are used in turn
+	const size_t start = m_next++;
+	url_fetcher *result = NULL;
+	long min_pending = 0;
+
+	for (size_t i = 0; i < m_shards.size(); ++i) {
+		url_fetcher &fetcher = m_shards[(start + i) % m_shards.size()]->fetcher;
+		const long pending = fetcher.pending_requests();
+
+		if (!result || pending < min_pending) {
+			result = &fetcher;
+			min_pending = pending;
+		}
+	}
+
+	return *result;
+}
+
+void sharded_url_fetcher::for_each_shard(const std::function<void (url_fetcher &)> &func)
+{
+	// Tasks may outlive the call if it's made by shard's thread
+	auto shared_func = std::make_shared<std::function<void (url_fetcher &)>>(func);
+	const std::thread::id current_thread = std::this_thread::get_id();
+	bool called_by_shard = false;
+	std::vector<std::future<void>> results;
+
+	for (auto it = m_shards.begin(); it != m_shards.end(); ++it) {
+		url_fetcher &fetcher = (*it)->fetcher;
+
+		// Shard's thread can't wait for the task posted to itself
+		if ((*it)->thread.get_id() == current_thread) {
+			called_by_shard = true;
+			func(fetcher);
+			continue;
+		}
+
+		auto promise = std::make_shared<std::promise<void>>();
+		results.emplace_back(promise->get_future());
+
+		(*it)->loop.post([promise, &fetcher, shared_func] () {
+			(*shared_func)(fetcher);
+			promise->set_value();
+		});
+	}
+
+	/*
+	 * Other shards may wait for this one the same time, e.g. if their streams change settings too,
+	 * so shard's thread doesn't wait for them, they apply the settings by their threads soon.
+	 */
+	if (called_by_shard)
+		return;
+
+	for (auto it = results.begin(); it != results.end(); ++it) {
+		it->get();
+	}
+}
+
+void sharded_url_fetcher::get(const std::shared_ptr<base_stream> &stream, url_fetcher::request &&request)
+{
+	route(request).get(stream, std::move(request));
+}
+
+void sharded_url_fetcher::head(const std::shared_ptr<base_stream> &stream, url_fetcher::request &&request)
+{
+	route(request).head(stream, std::move(request));
+}
+
+void sharded_url_fetcher::options(const std::shared_ptr<base_stream> &stream, url_fetcher::request &&request)
+{
+	route(request).options(stream, std::move(request));
+}
+
+void sharded_url_fetcher::post(const std::shared_ptr<base_stream> &stream, url_fetcher::request &&request, std::string &&body)
+{
+	route(request).post(stream, std::move(request), std::move(body));
+}
+
+void sharded_url_fetcher::post(const std::shared_ptr<base_stream> &stream, url_fetcher::request &&request,
+	const std::shared_ptr<body_source> &body)
+{
+	route(request).post(stream, std::move(request), body);
+}
+
+void sharded_url_fetcher::put(const std::shared_ptr<base_stream> &stream, url_fetcher::request &&request, std::string &&body)
+{
+	route(request).put(stream, std::move(request), std::move(body));
+}
+
+void sharded_url_fetcher::put(const std::shared_ptr<base_stream> &stream, url_fetcher::request &&request,
+	const std::shared_ptr<body_source> &body)
+{
+	route(request).put(stream, std::move(request), body);
+}
+
+void sharded_url_fetcher::del(const std::shared_ptr<base_stream> &stream, url_fetcher::request &&request, std::string &&body)
+{
+	route(request).del(stream, std::move(request), std::move(body));
+}
+
+void sharded_url_fetcher::del(const std::shared_ptr<base_stream> &stream, url_fetcher::request &&request,
+	const std::shared_ptr<body_source> &body)
+{
+	route(request).del(stream, std::move(request), body);
+}
+
+void sharded_url_fetcher::patch(const std::shared_ptr<base_stream> &stream, url_fetcher::request &&request, std::string &&body)
+{
+	route(request).patch(stream, std::move(request), std::move(body));
+}
+
+void sharded_url_fetcher::patch(const std::shared_ptr<base_stream> &stream, url_fetcher::request &&request,
+	const std::shared_ptr<body_source> &body)
+{
+	route(request).patch(stream, std::move(request), body);
+}
+
+} // namespace swarm
+} // namespace ioremap
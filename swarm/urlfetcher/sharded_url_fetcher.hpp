@@ -0,0 +1,189 @@
+/*
+ * Copyright 2015+ Ruslan Nigmatullin <euroelessar@yandex.ru>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef IOREMAP_SWARM_SHARDED_URL_FETCHER_HPP
+#define IOREMAP_SWARM_SHARDED_URL_FETCHER_HPP
+
+#include "url_fetcher.hpp"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace ioremap {
+namespace swarm {
+
+class url_fetcher_shard;
+
+/*!
+ * \brief The sharded_url_fetcher class runs several url fetchers, each in it's own thread.
+ *
+ * Single url fetcher is limited by one core, sharded one spreads requests among
+ * it's shards and provides the same API for making requests.
+ *
+ * All methods are thread safe. Settings are applied to every shard by it's thread before
+ * the setter returns. If the setter is called by shard's thread, e.g. from stream's callback,
+ * it's applied to that shard at once and to the other shards asynchronously.
+ */
+class sharded_url_fetcher
+{
+public:
+	enum routing_policy {
+		//! Requests to the same host are sent by the same shard, so they reuse it's connections
+		route_by_host,
+		//! Request is sent by the shard with least number of pending requests
+		route_least_loaded
+	};
+
+	/*!
+	 * \brief Constructs and starts \a shards url fetchers with \a logger.
+	 *
+	 * Number of shards is equal to number of CPU cores if \a shards is zero.
+	 */
+	sharded_url_fetcher(size_t shards, const swarm::logger &logger, routing_policy policy = route_by_host);
+	/*!
+	 * \brief Stops all shards, not finished requests are dropped.
+	 */
+	~sharded_url_fetcher();
+
+	size_t shards() const;
+
+	/*!
+	 * \brief Set limit of simultaneously running requests by every shard.
+	 *
+	 * \sa url_fetcher::set_total_limit
+	 */
+	void set_total_limit(long active_connections);
+	/*!
+	 * \brief Set limit of simultaneously running requests to the same host by every shard.
+	 *
+	 * It's a total limit per host only for route_by_host policy.
+	 *
+	 * \sa url_fetcher::set_host_limit
+	 */
+	void set_host_limit(long active_connections);
+	/*!
+	 * \sa url_fetcher::set_http2_mode
+	 */
+	void set_http2_mode(url_fetcher::http2_mode mode);
+	/*!
+	 * \sa url_fetcher::set_max_streams
+	 */
+	void set_max_streams(long streams);
+	/*!
+	 * \brief Makes shards to share cache of hosts and TLS sessions \a share.
+	 *
+	 * Shards run in different threads, so \a share must not contain connections,
+	 * std::invalid_argument is thrown otherwise.
+	 *
+	 * \sa url_fetcher::set_share
+	 */
+	void set_share(const std::shared_ptr<url_fetcher_share> &share);
+	/*!
+	 * \brief Makes all shards to store replies in the same \a cache.
+	 *
+	 * \sa url_fetcher::set_cache
+	 */
+	void set_cache(const std::shared_ptr<response_cache> &cache);
+	/*!
+	 * \brief Calls \a handler with statistics of hosts of all shards.
+	 *
+	 * Host is reported by every shard which sent requests to it.
+	 *
+	 * \sa url_fetcher::get_host_statistics
+	 */
+	void get_host_statistics(const std::function<void (std::vector<url_fetcher::host_statistics> &&)> &handler);
+	/*!
+	 * \brief Calls \a handler with timing statistics of all shards summed up.
+	 *
+	 * \sa url_fetcher::get_timing_statistics
+	 */
+	void get_timing_statistics(const std::function<void (url_fetcher::timing_statistics &&)> &handler);
+
+	/*!
+	 * \brief Returns number of requests submitted but not finished yet by all shards.
+	 */
+	long pending_requests() const;
+
+	/*!
+	 * \sa url_fetcher::get
+	 */
+	void get(const std::shared_ptr<base_stream> &stream, url_fetcher::request &&request);
+	/*!
+	 * \sa url_fetcher::head
+	 */
+	void head(const std::shared_ptr<base_stream> &stream, url_fetcher::request &&request);
+	/*!
+	 * \sa url_fetcher::options
+	 */
+	void options(const std::shared_ptr<base_stream> &stream, url_fetcher::request &&request);
+	/*!
+	 * \sa url_fetcher::post
+	 */
+	void post(const std::shared_ptr<base_stream> &stream, url_fetcher::request &&request, std::string &&body);
+	/*!
+	 * \sa url_fetcher::post
+	 */
+	void post(const std::shared_ptr<base_stream> &stream, url_fetcher::request &&request,
+		const std::shared_ptr<body_source> &body);
+	/*!
+	 * \sa url_fetcher::put
+	 */
+	void put(const std::shared_ptr<base_stream> &stream, url_fetcher::request &&request, std::string &&body);
+	/*!
+	 * \sa url_fetcher::put
+	 */
+	void put(const std::shared_ptr<base_stream> &stream, url_fetcher::request &&request,
+		const std::shared_ptr<body_source> &body);
+	/*!
+	 * \sa url_fetcher::del
+	 */
+	void del(const std::shared_ptr<base_stream> &stream, url_fetcher::request &&request, std::string &&body);
+	/*!
+	 * \sa url_fetcher::del
+	 */
+	void del(const std::shared_ptr<base_stream> &stream, url_fetcher::request &&request,
+		const std::shared_ptr<body_source> &body);
+	/*!
+	 * \sa url_fetcher::patch
+	 */
+	void patch(const std::shared_ptr<base_stream> &stream, url_fetcher::request &&request, std::string &&body);
+	/*!
+	 * \sa url_fetcher::patch
+	 */
+	void patch(const std::shared_ptr<base_stream> &stream, url_fetcher::request &&request,
+		const std::shared_ptr<body_source> &body);
+
+private:
+	sharded_url_fetcher(const sharded_url_fetcher &other) = delete;
+	sharded_url_fetcher &operator =(const sharded_url_fetcher &other) = delete;
+
+	url_fetcher &route(const url_fetcher::request &request);
+	/*
+	 * Calls \a func for every shard's url fetcher from it's thread and waits for all of them.
+	 * Shard's thread calls it for it's own shard inline and doesn't wait for the others.
+	 */
+	void for_each_shard(const std::function<void (url_fetcher &)> &func);
+
+	std::vector<std::unique_ptr<url_fetcher_shard>> m_shards;
+	routing_policy m_policy;
+	std::atomic_size_t m_next;
+};
+
+} // namespace swarm
+} // namespace ioremap
+
+#endif // IOREMAP_SWARM_SHARDED_URL_FETCHER_HPP
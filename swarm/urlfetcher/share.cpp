@@ -0,0 +1,57 @@
+/*
+ * Copyright 2015+ Ruslan Nigmatullin <euroelessar@yandex.ru>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "share_p.hpp"
+
+#define MAKE_VERSION(major, minor, patch) (((major) << 16) | ((minor) << 8) | (patch))
+#define IF_CURL_VERSION(major, minor, patch) if (curl_version_info(CURLVERSION_NOW)->version_num >= MAKE_VERSION((major), (minor), (patch)))
+
+namespace ioremap {
+namespace swarm {
+
+url_fetcher_share::url_fetcher_share(int flags) : p(new url_fetcher_share_private)
+{
+	if (p->share) {
+		curl_share_setopt(p->share, CURLSHOPT_LOCKFUNC, url_fetcher_share_private::lock);
+		curl_share_setopt(p->share, CURLSHOPT_UNLOCKFUNC, url_fetcher_share_private::unlock);
+		curl_share_setopt(p->share, CURLSHOPT_USERDATA, p);
+	}
+
+	if (flags & share_dns)
+		p->enable(share_dns, CURL_LOCK_DATA_DNS);
+	if (flags & share_ssl_sessions)
+		p->enable(share_ssl_sessions, CURL_LOCK_DATA_SSL_SESSION);
+#if LIBCURL_VERSION_NUM >= MAKE_VERSION(7, 57, 0)
+	if (flags & share_connections) {
+		IF_CURL_VERSION(7, 57, 0) {
+			p->enable(share_connections, CURL_LOCK_DATA_CONNECT);
+		}
+	}
+#endif
+}
+
+url_fetcher_share::~url_fetcher_share()
+{
+	delete p;
+}
+
+int url_fetcher_share::flags() const
+{
+	return p->flags;
+}
+
+} // namespace swarm
+} // namespace ioremap
@@ -0,0 +1,74 @@
+/*
+ * Copyright 2015+ Ruslan Nigmatullin <euroelessar@yandex.ru>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef IOREMAP_SWARM_SHARE_HPP
+#define IOREMAP_SWARM_SHARE_HPP
+
+namespace ioremap {
+namespace swarm {
+
+class network_manager_private;
+class url_fetcher_share_private;
+
+/*!
+ * \brief The url_fetcher_share class is a cache shared by several url fetchers.
+ *
+ * Applications which run several url fetchers, i.e. one per event loop's thread,
+ * otherwise resolve the same hosts and do full TLS handshakes by every fetcher.
+ * Share is passed to url_fetcher::set_share and kept alive by all fetchers using it,
+ * access to it is guarded by mutexes.
+ */
+class url_fetcher_share
+{
+public:
+	enum share_flags {
+		//! Resolved addresses of hosts
+		share_dns = 0x01,
+		//! TLS session ids, so handshakes of new connections are abbreviated
+		share_ssl_sessions = 0x02,
+		/*!
+		 * Idle connections, requires libcurl 7.57.
+		 *
+		 * \attention libcurl doesn't support sharing connections between concurrent threads,
+		 * so all fetchers using such share must run their event loops in the same thread.
+		 */
+		share_connections = 0x04
+	};
+
+	/*!
+	 * \brief Constructs share of data specified by bitmask of share_flags \a flags.
+	 */
+	explicit url_fetcher_share(int flags = share_dns | share_ssl_sessions);
+	~url_fetcher_share();
+
+	/*!
+	 * \brief Returns bitmask of share_flags supported by libcurl from those passed to the constructor.
+	 */
+	int flags() const;
+
+private:
+	url_fetcher_share(const url_fetcher_share &other) = delete;
+	url_fetcher_share &operator =(const url_fetcher_share &other) = delete;
+
+	friend class network_manager_private;
+
+	url_fetcher_share_private *p;
+};
+
+} // namespace swarm
+} // namespace ioremap
+
+#endif // IOREMAP_SWARM_SHARE_HPP
@@ -0,0 +1,67 @@
+/*
+ * Copyright 2015+ Ruslan Nigmatullin <euroelessar@yandex.ru>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef IOREMAP_SWARM_SHARE_P_HPP
+#define IOREMAP_SWARM_SHARE_P_HPP
+
+#include "share.hpp"
+
+#include <mutex>
+
+#include <curl/curl.h>
+
+namespace ioremap {
+namespace swarm {
+
+class url_fetcher_share_private
+{
+public:
+	url_fetcher_share_private() : share(curl_share_init()), flags(0)
+	{
+	}
+
+	~url_fetcher_share_private()
+	{
+		if (share)
+			curl_share_cleanup(share);
+	}
+
+	void enable(int flag, curl_lock_data data)
+	{
+		if (share && curl_share_setopt(share, CURLSHOPT_SHARE, data) == CURLSHE_OK)
+			flags |= flag;
+	}
+
+	static void lock(CURL *, curl_lock_data data, curl_lock_access, void *userptr)
+	{
+		static_cast<url_fetcher_share_private *>(userptr)->mutexes[data].lock();
+	}
+
+	static void unlock(CURL *, curl_lock_data data, void *userptr)
+	{
+		static_cast<url_fetcher_share_private *>(userptr)->mutexes[data].unlock();
+	}
+
+	CURLSH *share;
+	int flags;
+	// Every kind of shared data is guarded separately, so i.e. dns lookups don't wait for tls sessions
+	std::mutex mutexes[CURL_LOCK_DATA_LAST];
+};
+
+} // namespace swarm
+} // namespace ioremap
+
+#endif // IOREMAP_SWARM_SHARE_P_HPP
@@ -15,6 +15,9 @@
  */
 
 #include "url_fetcher.hpp"
+#include "share_p.hpp"
+#include "response_cache_p.hpp"
+#include "header_parser_p.hpp"
 #include "../http_request_p.hpp"
 #include "../http_response_p.hpp"
 
@@ -25,10 +28,16 @@
 #include <iostream>
 #include <mutex>
 #include <blackhole/utils/atomic.hpp>
-
-#include <queue>
-#include <list>
-#include <set>
+#include <boost/intrusive/list.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/optional.hpp>
+
+#include <map>
+#include <random>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 #include <algorithm>
 
 #ifndef BOOST_SYSTEM_NOEXCEPT
@@ -42,6 +51,8 @@ namespace ioremap {
 namespace swarm {
 
 typedef std::chrono::high_resolution_clock clock;
+typedef std::chrono::steady_clock timer_clock;
+typedef std::multimap<timer_clock::time_point, std::function<void ()>> timer_map;
 
 enum http_command {
 	GET,
@@ -55,22 +66,77 @@ enum http_command {
 
 std::atomic_int alive(0);
 
-class network_connection_info
+/*
+ * Microsecond timings are reported by libcurl since 7.61,
+ * older versions report seconds as double.
+ */
+#if LIBCURL_VERSION_NUM >= MAKE_VERSION(7, 61, 0)
+#  define TIME_INFO(info) info, info##_T
+#else
+#  define TIME_INFO(info) info, info
+#endif
+
+static int64_t get_time_info(CURL *easy, CURLINFO seconds_info, CURLINFO microseconds_info)
 {
-public:
-	typedef std::unique_ptr<network_connection_info> ptr;
+#if LIBCURL_VERSION_NUM >= MAKE_VERSION(7, 61, 0)
+	IF_CURL_VERSION(7, 61, 0) {
+		curl_off_t value = 0;
+		curl_easy_getinfo(easy, microseconds_info, &value);
+		return value;
+	}
+#else
+	(void) microseconds_info;
+#endif
 
-	network_connection_info(const swarm::logger &log, const std::string &url) :
-		easy(NULL), logger(log, blackhole::log::attributes_t({ keyword::url() = url })),
-		redirect_count(0), on_headers_called(false)
+	double value = 0;
+	curl_easy_getinfo(easy, seconds_info, &value);
+	return static_cast<int64_t>(value * 1000000);
+}
+
+static url_fetcher::transfer_timings get_timings(CURL *easy, int64_t queue)
+{
+	url_fetcher::transfer_timings timings;
+	timings.queue = queue;
+	timings.name_lookup = get_time_info(easy, TIME_INFO(CURLINFO_NAMELOOKUP_TIME));
+	timings.connect = get_time_info(easy, TIME_INFO(CURLINFO_CONNECT_TIME));
+	timings.app_connect = get_time_info(easy, TIME_INFO(CURLINFO_APPCONNECT_TIME));
+	timings.pre_transfer = get_time_info(easy, TIME_INFO(CURLINFO_PRETRANSFER_TIME));
+	timings.start_transfer = get_time_info(easy, TIME_INFO(CURLINFO_STARTTRANSFER_TIME));
+	timings.total = get_time_info(easy, TIME_INFO(CURLINFO_TOTAL_TIME));
+
+	long connects = 0;
+	curl_easy_getinfo(easy, CURLINFO_NUM_CONNECTS, &connects);
+	timings.reused_connection = connects == 0;
+
+	return timings;
+}
+
+struct network_host_info;
+
+/*
+ * Record of the request for it's whole lifetime: it's created by url_fetcher's method,
+ * passed to the event loop's thread, may wait in the host's queue and finally
+ * tracks the running transfer. Records are allocated by network_request_slab.
+ */
+class network_request_info
+{
+public:
+	network_request_info(const swarm::logger &log) :
+		request(boost::none), command(GET), begin(clock::now()),
+		easy(NULL), headers_list(NULL), host(NULL), queue_wait(0), logger(log, blackhole::log::attributes_t()),
+		paused(CURLPAUSE_CONT), on_headers_called(false), reply_started(false), cancelled(false)
 	{
-		BH_LOG(logger, SWARM_LOG_DEBUG, "Created network_connection_info: %p", this);
-		//        error[0] = '\0';
 	}
-	~network_connection_info()
+	~network_request_info()
 	{
-		curl_easy_cleanup(easy);
-		BH_LOG(logger, SWARM_LOG_DEBUG, "Destroyed network_connection_info: %p", this);
+		/*
+		 * Easy handle is returned to the manager's pool after successfull transfer,
+		 * it's destroyed here only if the request has failed to start.
+		 */
+		if (easy)
+			curl_easy_cleanup(easy);
+		curl_slist_free_all(headers_list);
+		BH_LOG(logger, SWARM_LOG_DEBUG, "Destroyed network_request_info: %p", this);
 		//                error[CURL_ERROR_SIZE - 1] = '\0';
 	}
 
@@ -79,6 +145,10 @@ public:
 		if (on_headers_called)
 			return;
 
+		// Transfer may fail in the middle of headers
+		if (!header_lines.empty())
+			parse_headers();
+
 		long code;
 		curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &code);
 		char *effective_url = NULL;
@@ -87,39 +157,292 @@ public:
 		on_headers_called = true;
 		reply.set_code(code);
 		reply.set_url(effective_url);
+		reply.set_timings(get_timings(easy, queue_wait));
+
+		if (cache)
+			prepare_cache_entry();
+
+		if (revalidated) {
+			auto cached_body = revalidated;
+			stream->on_headers(std::move(reply));
+			if (!cached_body->body.empty())
+				stream->on_data(boost::asio::buffer(cached_body->body));
+			return;
+		}
+
 		stream->on_headers(std::move(reply));
 	}
 
+	// Replaces reply's headers by ones of the current reply's header lines
+	void parse_headers()
+	{
+		std::vector<headers_entry> headers;
+		parse_header_lines(header_lines.data(), header_lines.size(), headers);
+		reply.headers().assign(std::move(headers));
+		header_lines.clear();
+	}
+
+	/*
+	 * Not Modified reply to revalidation is replaced by the cached one, which is stored again
+	 * with updated headers. Other cacheable replies are collected to cache_entry while they are received.
+	 */
+	void prepare_cache_entry()
+	{
+		const time_t now = time(NULL);
+		// Reply is passed to the stream right after, so the key is kept for store_cache_entry
+		cache_key = reply.request().url().to_string();
+		const std::string &key = cache_key;
+
+		if (cached && reply.code() == 304) {
+			auto entry = std::make_shared<cached_response>(*cached);
+			merge_not_modified(entry->headers, reply.headers());
+			entry->date = now;
+
+			reply.set_code(entry->code);
+			reply.set_url(entry->url);
+			reply.set_headers(entry->headers);
+
+			if (auto expires = response_expires(entry->code, entry->headers, now)) {
+				entry->expires = *expires;
+				cache->put(key, entry);
+			} else {
+				cache->remove(key);
+			}
+
+			revalidated = entry;
+			return;
+		}
+
+		if (auto expires = response_expires(reply.code(), reply.headers(), now)) {
+			cache_entry = std::make_shared<cached_response>();
+			cache_entry->code = reply.code();
+			cache_entry->url = reply.url();
+			cache_entry->headers = reply.headers();
+			cache_entry->date = now;
+			cache_entry->expires = *expires;
+			if (auto content_length = reply.headers().content_length())
+				cache_entry->body.reserve(std::min(*content_length, cache->max_entry_size() + 1));
+		} else if (cached && reply.code() != 0 && reply.code() < 500) {
+			// Server has replaced the resource by the one which can't be cached
+			cache->remove(key);
+		}
+	}
+
+	void append_cache_entry(const char *data, size_t size)
+	{
+		if (cache_entry->body.size() + size > cache->max_entry_size()) {
+			cache_entry.reset();
+			return;
+		}
+
+		cache_entry->body.append(data, size);
+	}
+
+	// Stores the reply once it's fully received
+	void store_cache_entry()
+	{
+		if (cache_entry) {
+			cache->put(cache_key, cache_entry);
+			cache_entry.reset();
+		}
+	}
+
+	url_fetcher::request request;
+	http_command command;
+	std::string body;
+	// Body provided by parts, it's used instead of body if set
+	std::shared_ptr<body_source> upload;
+	std::shared_ptr<base_stream> stream;
+	std::chrono::time_point<clock> begin;
+
 	CURL *easy;
+	// List of request's headers, it must be alive until the transfer is finished
+	struct curl_slist *headers_list;
+	network_host_info *host;
+	// Time the request has spent in the queue, in microseconds
+	int64_t queue_wait;
 	swarm::logger logger;
 	url_fetcher::response reply;
-	std::shared_ptr<base_stream> stream;
-	std::string body;
-	long redirect_count;
+	// Header lines of the current reply which are not parsed yet
+	std::string header_lines;
+	// Directions of the transfer paused by the stream or the body source, bitmask of CURLPAUSE_RECV and CURLPAUSE_SEND
+	int paused;
 	bool on_headers_called;
+	// Cache of the manager if the request is cacheable GET
+	std::shared_ptr<response_cache> cache;
+	// Stale cached reply the request revalidates and the same reply with updated headers if it's not modified
+	std::shared_ptr<const cached_response> cached;
+	std::shared_ptr<const cached_response> revalidated;
+	// Reply being received which will be stored to the cache
+	std::shared_ptr<cached_response> cache_entry;
+	// Key of the reply in the cache, it's set by prepare_cache_entry
+	std::string cache_key;
+	// First byte of the reply is received
+	bool reply_started;
+	// Request was cancelled before it has started, it's dropped once it reaches the event loop or leaves the queue
+	bool cancelled;
+	// Timer of the deadline while the request is queued or of the first byte's timeout while it's running
+	boost::optional<timer_map::iterator> timer;
+
+	// Request is linked into incoming list, host's queue or list of running requests, at most one of them
+	boost::intrusive::list_member_hook<> link;
 
 	//    char error[CURL_ERROR_SIZE];
 };
 
+typedef boost::intrusive::list<network_request_info,
+	boost::intrusive::member_hook<network_request_info, boost::intrusive::list_member_hook<>, &network_request_info::link>
+> network_request_list;
+
+/*
+ * Requests to the same host and port.
+ */
+struct network_host_info
+{
+	network_host_info() : active(0), started(0), total_wait(0), finished(0), connections(0), http2_finished(0),
+		ready(false), idle(false)
+	{
+	}
+
+	std::string name;
+	long active;
+	network_request_list requests;
+	// Number of started requests and total time they have spent in the queue
+	uint64_t started;
+	int64_t total_wait;
+	// Number of finished requests, connections opened by them and requests performed by HTTP/2
+	uint64_t finished;
+	uint64_t connections;
+	uint64_t http2_finished;
+	// Host has queued requests and free connection slot, so it's linked into the round-robin list
+	bool ready;
+	// Host has neither running nor queued requests, so it's linked into the list of idle hosts
+	bool idle;
+
+	boost::intrusive::list_member_hook<> link;
+};
+
+typedef boost::intrusive::list<network_host_info,
+	boost::intrusive::member_hook<network_host_info, boost::intrusive::list_member_hook<>, &network_host_info::link>
+> network_host_list;
+
+/*
+ * Thread-safe allocator of request records. Memory is allocated by slabs of records
+ * and is not returned until destruction, so steady-state flow of requests allocates no records.
+ */
+class network_request_slab
+{
+public:
+	enum {
+		records_per_slab = 64
+	};
+
+	network_request_slab() : m_free(NULL)
+	{
+	}
+
+	~network_request_slab()
+	{
+		for (auto it = m_slabs.begin(); it != m_slabs.end(); ++it) {
+			::operator delete(*it);
+		}
+	}
+
+	network_request_slab(const network_request_slab &other) = delete;
+	network_request_slab &operator =(const network_request_slab &other) = delete;
+
+	void *allocate()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		if (!m_free) {
+			m_slabs.reserve(m_slabs.size() + 1);
+
+			char *slab = static_cast<char *>(::operator new(records_per_slab * sizeof(network_request_info)));
+			m_slabs.push_back(slab);
+
+			for (size_t i = 0; i < records_per_slab; ++i) {
+				push(slab + i * sizeof(network_request_info));
+			}
+		}
+
+		free_block *block = m_free;
+		m_free = block->next;
+		return block;
+	}
+
+	void deallocate(void *memory)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		push(memory);
+	}
+
+private:
+	struct free_block
+	{
+		free_block *next;
+	};
+
+	void push(void *memory)
+	{
+		free_block *block = static_cast<free_block *>(memory);
+		block->next = m_free;
+		m_free = block;
+	}
+
+	std::mutex m_mutex;
+	free_block *m_free;
+	std::vector<char *> m_slabs;
+};
+
 class network_manager_private : public event_listener
 {
 public:
+	enum {
+		default_easy_pool_limit = 1024,
+		idle_hosts_limit = 1024
+	};
+
 	network_manager_private(event_loop &loop, const swarm::logger &logger) :
 		loop(loop), logger(logger, blackhole::log::attributes_t()), still_running(0), prev_running(0),
-		active_connections(0), active_connections_limit(std::numeric_limits<long>::max())
+		active_connections(0), pending_requests(0), active_connections_limit(std::numeric_limits<long>::max()),
+		host_connections_limit(std::numeric_limits<long>::max()), http2(url_fetcher::http2_disabled),
+		random(std::random_device()()), easy_pool_limit(default_easy_pool_limit)
 	{
 		loop.set_listener(this);
 	}
 
 	~network_manager_private()
 	{
-		for (auto it = infos.begin(); it != infos.end(); ++it) {
-			network_connection_info *info = *it;
-			CURLMcode code = curl_multi_remove_handle(multi, info->easy);
+		// Timers are dropped at once, so records don't cancel them one by one
+		for (auto it = active_requests.begin(); it != active_requests.end(); ++it) {
+			it->timer = boost::none;
+		}
+		for (auto it = hosts.begin(); it != hosts.end(); ++it) {
+			for (auto jt = it->second.requests.begin(); jt != it->second.requests.end(); ++jt) {
+				jt->timer = boost::none;
+			}
+		}
+		timers.clear();
+
+		for (auto it = active_requests.begin(); it != active_requests.end(); ++it) {
+			CURLMcode code = curl_multi_remove_handle(multi, it->easy);
 			if (code != CURLM_OK) {
-				BH_LOG(info->logger, SWARM_LOG_ERROR, "Failed to remove easy handle: %s", curl_multi_strerror(code));
+				BH_LOG(it->logger, SWARM_LOG_ERROR, "Failed to remove easy handle: %s", curl_multi_strerror(code));
 			}
-			delete info;
+		}
+		active_requests.clear_and_dispose(request_destroyer(this));
+
+		ready_hosts.clear();
+		idle_hosts.clear();
+		for (auto it = hosts.begin(); it != hosts.end(); ++it) {
+			it->second.requests.clear_and_dispose(request_destroyer(this));
+		}
+
+		incoming_requests.clear_and_dispose(request_destroyer(this));
+
+		for (auto it = easy_pool.begin(); it != easy_pool.end(); ++it) {
+			curl_easy_cleanup(*it);
 		}
 
 		curl_multi_cleanup(multi);
@@ -149,32 +472,295 @@ public:
 		check_run_count();
 	}
 
+	/*
+	 * Event loop has single timer, so it's shared by curl and the manager's own timers.
+	 * It may fire earlier than needed, so only expired ones are handled.
+	 */
 	void on_timer()
 	{
-		CURLMcode rc;
-		do {
-			rc = curl_multi_socket_action(multi, CURL_SOCKET_TIMEOUT, 0, &still_running);
-		} while (rc == CURLM_CALL_MULTI_PERFORM);
-		BH_LOG(logger, SWARM_LOG_DEBUG, "on_timer, rc: %d", int(rc));
+		timer_deadline = boost::none;
+		const auto now = timer_clock::now();
 
-		check_run_count();
+		while (!timers.empty() && timers.begin()->first <= now) {
+			std::function<void ()> handler = std::move(timers.begin()->second);
+			timers.erase(timers.begin());
+			handler();
+		}
+
+		if (curl_deadline && *curl_deadline <= now) {
+			curl_deadline = boost::none;
+
+			CURLMcode rc;
+			do {
+				rc = curl_multi_socket_action(multi, CURL_SOCKET_TIMEOUT, 0, &still_running);
+			} while (rc == CURLM_CALL_MULTI_PERFORM);
+			BH_LOG(logger, SWARM_LOG_DEBUG, "on_timer, rc: %d", int(rc));
+
+			// Curl doesn't report the timeout again if it's not changed by the call
+			long timeout_ms = -1;
+			if (!curl_deadline && curl_multi_timeout(multi, &timeout_ms) == CURLM_OK && timeout_ms >= 0)
+				curl_deadline = timer_clock::now() + std::chrono::milliseconds(timeout_ms);
+
+			check_run_count();
+		}
+
+		update_timer();
+	}
+
+	// Calls the handler from the event loop's thread after timeout_ms milliseconds
+	timer_map::iterator add_timer(long timeout_ms, std::function<void ()> &&handler)
+	{
+		auto it = timers.emplace(timer_clock::now() + std::chrono::milliseconds(timeout_ms), std::move(handler));
+		update_timer();
+		return it;
+	}
+
+	// Timer must not be fired yet, handlers are removed before they are called
+	void cancel_timer(timer_map::iterator it)
+	{
+		timers.erase(it);
+		update_timer();
 	}
 
-	struct request_info
+	// Sets the event loop's timer to the nearest deadline of curl and the manager's timers
+	void update_timer()
 	{
-		typedef std::shared_ptr<request_info> ptr;
+		boost::optional<timer_clock::time_point> deadline = curl_deadline;
+		if (!timers.empty() && (!deadline || timers.begin()->first < *deadline))
+			deadline = timers.begin()->first;
 
-		request_info() : request(boost::none), begin(clock::now())
+		if (deadline == timer_deadline)
+			return;
+
+		timer_deadline = deadline;
+
+		long timeout_ms = -1;
+		if (deadline) {
+			const auto timeout = *deadline - timer_clock::now();
+			// Rounded up, otherwise the timer fires before the deadline
+			timeout_ms = std::max<long>(0, std::chrono::duration_cast<std::chrono::milliseconds>(
+				timeout + std::chrono::milliseconds(1) - timer_clock::duration(1)).count());
+		}
+
+		loop.timer_request(timeout_ms);
+	}
+
+	struct request_destroyer
+	{
+		request_destroyer(network_manager_private *manager) : manager(manager)
 		{
 		}
 
-		url_fetcher::request request;
-		http_command command;
-		std::string body;
-		std::shared_ptr<base_stream> stream;
-		std::chrono::time_point<clock> begin;
+		void operator() (network_request_info *request) const
+		{
+			manager->destroy_request(request);
+		}
+
+		network_manager_private *manager;
 	};
 
+	network_request_info *create_request()
+	{
+		void *memory = slab.allocate();
+
+		try {
+			return new (memory) network_request_info(logger);
+		} catch (...) {
+			slab.deallocate(memory);
+			throw;
+		}
+	}
+
+	void destroy_request(network_request_info *request)
+	{
+		if (request->upload) {
+			std::lock_guard<std::mutex> lock(request->upload->m_mutex);
+			request->upload->m_manager = NULL;
+			request->upload->m_request = NULL;
+		}
+		if (request->stream)
+			detach_stream(request);
+		if (request->timer)
+			cancel_timer(*request->timer);
+		paused_requests.erase(request);
+
+		request->~network_request_info();
+		slab.deallocate(request);
+		--pending_requests;
+	}
+
+	// Stream's flow control is bound to the request while it's running
+	void attach_stream(network_request_info *request)
+	{
+		std::lock_guard<std::mutex> lock(request->stream->m_mutex);
+		request->stream->m_manager = this;
+		request->stream->m_request = request;
+	}
+
+	void detach_stream(network_request_info *request)
+	{
+		std::lock_guard<std::mutex> lock(request->stream->m_mutex);
+		request->stream->m_manager = NULL;
+		request->stream->m_request = NULL;
+	}
+
+	// Passes the rest of the running request to another stream
+	void switch_stream(network_request_info *request, const std::shared_ptr<base_stream> &stream)
+	{
+		detach_stream(request);
+		request->stream = stream;
+		attach_stream(request);
+	}
+
+	void submit(const std::shared_ptr<base_stream> &stream, url_fetcher::request &&request,
+		http_command command, std::string &&body, const std::shared_ptr<body_source> &upload = std::shared_ptr<body_source>());
+
+	/*
+	 * Passes the request to the event loop's thread. Loop is woken up only by the first
+	 * of requests submitted until it gets to them, so they are processed by single call.
+	 */
+	network_request_info *enqueue(const std::shared_ptr<base_stream> &stream, url_fetcher::request &&request,
+		http_command command, std::string &&body, const std::shared_ptr<body_source> &upload = std::shared_ptr<body_source>())
+	{
+		network_request_info *info = create_request();
+		++pending_requests;
+		info->stream = stream;
+		info->request = std::move(request);
+		info->command = command;
+		info->body = std::move(body);
+		info->upload = upload;
+
+		bool need_wake_up;
+		{
+			std::lock_guard<std::mutex> lock(incoming_mutex);
+			need_wake_up = incoming_requests.empty();
+			incoming_requests.push_back(*info);
+		}
+
+		if (need_wake_up) {
+			loop.post([this] () {
+				process_incoming();
+			});
+		}
+
+		return info;
+	}
+
+	/*
+	 * Aborts the request from the event loop's thread, it's stream gets the error, ECANCELED by default.
+	 * Running transfer is stopped at once, so it must not be called from curl's callbacks.
+	 */
+	void cancel_request(network_request_info *request,
+		const boost::system::error_code &error = make_posix_error(ECANCELED))
+	{
+		network_host_info *host = request->host;
+		if (!host) {
+			request->cancelled = true;
+			return;
+		}
+
+		BH_LOG(request->logger, SWARM_LOG_DEBUG, "Cancelled network_request_info: %p, error: %s",
+			request, error.message().c_str());
+
+		curl_multi_remove_handle(multi, request->easy);
+		active_requests.erase(active_requests.iterator_to(*request));
+		--active_connections;
+		--host->active;
+		schedule_host(*host);
+
+		try {
+			request->stream->on_close(error);
+		} catch (...) {
+			destroy_request(request);
+			release_host(*host);
+
+			throw;
+		}
+
+		release_easy(request->easy);
+		request->easy = NULL;
+		destroy_request(request);
+		release_host(*host);
+
+		process_queued();
+	}
+
+	// Destroys the request which has not started
+	void fail_request(network_request_info *request, const boost::system::error_code &error)
+	{
+		std::unique_ptr<network_request_info, request_destroyer> info(request, request_destroyer(this));
+		info->stream->on_close(error);
+	}
+
+	// Milliseconds left till the deadline, which is counted since the request's submission
+	static long deadline_left(const network_request_info *request, long deadline)
+	{
+		return deadline - std::chrono::duration_cast<std::chrono::milliseconds>(clock::now() - request->begin).count();
+	}
+
+	// Queued request fails once it's deadline passes, so it doesn't wait for the free connection in vain
+	void set_queue_deadline(network_host_info &host, network_request_info *request, long timeout_ms)
+	{
+		network_host_info *host_ptr = &host;
+
+		request->timer = add_timer(timeout_ms, [this, host_ptr, request] () {
+			request->timer = boost::none;
+			host_ptr->requests.erase(host_ptr->requests.iterator_to(*request));
+
+			if (host_ptr->ready && host_ptr->requests.empty()) {
+				ready_hosts.erase(ready_hosts.iterator_to(*host_ptr));
+				host_ptr->ready = false;
+			}
+
+			BH_LOG(request->logger, SWARM_LOG_DEBUG, "Queued network_request_info: %p has missed it's deadline", request);
+			fail_request(request, make_posix_error(ETIMEDOUT));
+			release_host(*host_ptr);
+		});
+	}
+
+	void set_first_byte_timeout(network_request_info *request, long timeout_ms)
+	{
+		request->timer = add_timer(timeout_ms, [this, request] () {
+			request->timer = boost::none;
+
+			if (!request->reply_started)
+				cancel_request(request, make_posix_error(ETIMEDOUT));
+		});
+	}
+
+	void process_incoming()
+	{
+		network_request_list requests;
+		{
+			std::lock_guard<std::mutex> lock(incoming_mutex);
+			requests.swap(incoming_requests);
+		}
+
+		try {
+			while (!requests.empty()) {
+				network_request_info &request = requests.front();
+				requests.pop_front();
+				process_info(&request);
+			}
+		} catch (...) {
+			// Requests which were not processed yet are returned to be processed by the next call
+			bool need_wake_up;
+			{
+				std::lock_guard<std::mutex> lock(incoming_mutex);
+				need_wake_up = incoming_requests.empty() && !requests.empty();
+				incoming_requests.splice(incoming_requests.begin(), requests);
+			}
+
+			if (need_wake_up) {
+				loop.post([this] () {
+					process_incoming();
+				});
+			}
+
+			throw;
+		}
+	}
+
 	struct multi_error_category : public boost::system::error_category
 	{
 	public:
@@ -238,34 +824,449 @@ public:
 		return boost::system::error_code(err, easy_category());
 	}
 
-	void process_info(const request_info::ptr &request)
+	/*
+	 * Returns easy handle with request-independent options already set.
+	 * Handles are reused between requests, so their allocation is avoided.
+	 */
+	CURL *acquire_easy()
 	{
-		if (active_connections >= active_connections_limit) {
-			requests.push(request);
+		if (!easy_pool.empty()) {
+			CURL *easy = easy_pool.back();
+			easy_pool.pop_back();
+			return easy;
+		}
+
+		CURL *easy = curl_easy_init();
+		if (easy)
+			setup_easy(easy);
+		return easy;
+	}
+
+	/*
+	 * Resets request's options of \a easy and returns it to the pool.
+	 * Easy handle must be already removed from the multi handle.
+	 */
+	void release_easy(CURL *easy)
+	{
+		if (easy_pool.size() >= easy_pool_limit) {
+			curl_easy_cleanup(easy);
 			return;
 		}
 
-		process_info_nocheck(request);
+		curl_easy_reset(easy);
+		setup_easy(easy);
+		easy_pool.push_back(easy);
 	}
 
-	void process_info_nocheck(const request_info::ptr &request)
+	void setup_easy(CURL *easy)
+	{
+		curl_easy_setopt(easy, CURLOPT_VERBOSE, 0L);
+
+		if (share)
+			curl_easy_setopt(easy, CURLOPT_SHARE, share->p->share);
+
+		/*
+		 * Shared connection may be closed by another fetcher, even after the one which
+		 * opened it is destroyed, so it's socket must not be bound to our event loop.
+		 */
+		const bool shared_connections = share && (share->flags() & url_fetcher_share::share_connections);
+
+#if LIBCURL_VERSION_NUM >= MAKE_VERSION(7, 21, 7)
+		IF_CURL_VERSION(7, 21, 7) if (!shared_connections) {
+			/*
+			 * If CURL don't support CURLOPT_CLOSESOCKETFUNCTION yet or connections are shared
+			 * we should fallback to dup-method to prevent memory leak
+			 */
+			curl_easy_setopt(easy, CURLOPT_OPENSOCKETFUNCTION, network_manager_private::open_callback);
+			curl_easy_setopt(easy, CURLOPT_OPENSOCKETDATA, &loop);
+			curl_easy_setopt(easy, CURLOPT_CLOSESOCKETFUNCTION, network_manager_private::close_callback);
+			curl_easy_setopt(easy, CURLOPT_CLOSESOCKETDATA, &loop);
+		}
+#endif
+		curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, network_manager_private::write_callback);
+		curl_easy_setopt(easy, CURLOPT_HEADERFUNCTION, network_manager_private::header_callback);
+		curl_easy_setopt(easy, CURLOPT_NOSIGNAL, 1L);
+	}
+
+	void setup_http2(CURL *easy)
+	{
+		if (http2 == url_fetcher::http2_disabled)
+			return;
+
+#if LIBCURL_VERSION_NUM >= MAKE_VERSION(7, 49, 0)
+		IF_CURL_VERSION(7, 49, 0) {
+			curl_easy_setopt(easy, CURLOPT_HTTP_VERSION, http2 == url_fetcher::http2_prior_knowledge
+				? long(CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE)
+				: long(CURL_HTTP_VERSION_2TLS));
+		}
+#elif LIBCURL_VERSION_NUM >= MAKE_VERSION(7, 43, 0)
+		IF_CURL_VERSION(7, 43, 0) {
+			curl_easy_setopt(easy, CURLOPT_HTTP_VERSION, long(CURL_HTTP_VERSION_2_0));
+		}
+#endif
+
+#if LIBCURL_VERSION_NUM >= MAKE_VERSION(7, 43, 0)
+		IF_CURL_VERSION(7, 43, 0) {
+			// Wait for connection which may be multiplexed instead of opening new one
+			curl_easy_setopt(easy, CURLOPT_PIPEWAIT, 1L);
+		}
+#endif
+	}
+
+	void update_host_statistics(network_host_info &host, CURL *easy)
+	{
+		++host.finished;
+
+		long connects = 0;
+		curl_easy_getinfo(easy, CURLINFO_NUM_CONNECTS, &connects);
+		host.connections += connects;
+
+#if LIBCURL_VERSION_NUM >= MAKE_VERSION(7, 50, 0)
+		IF_CURL_VERSION(7, 50, 0) {
+			long version = 0;
+			curl_easy_getinfo(easy, CURLINFO_HTTP_VERSION, &version);
+			if (version == CURL_HTTP_VERSION_2_0)
+				++host.http2_finished;
+		}
+#endif
+	}
+
+	// Phases' durations are differences of libcurl's cumulative times
+	void update_timing_statistics(network_request_info *request, CURL *easy)
+	{
+		const url_fetcher::transfer_timings t = get_timings(easy, request->queue_wait);
+
+		timings.queue.add(t.queue);
+		timings.total.add(t.total);
+
+		if (t.reused_connection) {
+			++timings.reused_connections;
+		} else {
+			if (t.name_lookup > 0)
+				timings.name_lookup.add(t.name_lookup);
+			if (t.connect > 0)
+				timings.connect.add(t.connect - t.name_lookup);
+			if (t.app_connect > 0)
+				timings.tls.add(t.app_connect - t.connect);
+		}
+
+		if (t.start_transfer > 0)
+			timings.server.add(t.start_transfer - t.pre_transfer);
+	}
+
+	void report_timing_statistics(const std::function<void (url_fetcher::timing_statistics &&)> &handler)
+	{
+		url_fetcher::timing_statistics result = timings;
+		handler(std::move(result));
+	}
+
+	/*
+	 * Makes curl to read request's body by parts from it's body_source.
+	 * Unlike PUT, POST of unknown size must be asked for chunked encoding explicitly.
+	 */
+	void setup_upload(network_request_info *info)
+	{
+		{
+			std::lock_guard<std::mutex> lock(info->upload->m_mutex);
+			info->upload->m_manager = this;
+			info->upload->m_request = info;
+		}
+
+		const curl_off_t size = info->upload->size();
+
+		curl_easy_setopt(info->easy, CURLOPT_READFUNCTION, network_manager_private::read_callback);
+		curl_easy_setopt(info->easy, CURLOPT_READDATA, info);
+		curl_easy_setopt(info->easy, CURLOPT_SEEKFUNCTION, network_manager_private::seek_callback);
+		curl_easy_setopt(info->easy, CURLOPT_SEEKDATA, info);
+
+		switch (info->command) {
+		case POST:
+			curl_easy_setopt(info->easy, CURLOPT_POST, 1L);
+			curl_easy_setopt(info->easy, CURLOPT_POSTFIELDSIZE_LARGE, size);
+			if (size < 0)
+				info->headers_list = curl_slist_append(info->headers_list, "Transfer-Encoding: chunked");
+			break;
+		case PUT:
+		case DELETE:
+		case PATCH:
+			curl_easy_setopt(info->easy, CURLOPT_UPLOAD, 1L);
+			curl_easy_setopt(info->easy, CURLOPT_INFILESIZE_LARGE, size);
+			if (info->command == DELETE)
+				curl_easy_setopt(info->easy, CURLOPT_CUSTOMREQUEST, "DELETE");
+			else if (info->command == PATCH)
+				curl_easy_setopt(info->easy, CURLOPT_CUSTOMREQUEST, "PATCH");
+			break;
+		default:
+			break;
+		}
+	}
+
+	void pause_transfer(network_request_info *request, int direction)
+	{
+		request->paused |= direction;
+		paused_requests.insert(request);
+	}
+
+	/*
+	 * Request may be already finished and it's record reused by another one,
+	 * so it's looked up in the set of paused requests and checked for the same stream or source.
+	 * Curl may call the callbacks and pause the transfer again from inside of curl_easy_pause.
+	 */
+	void continue_transfer(network_request_info *request, int direction)
+	{
+		request->paused &= ~direction;
+		if (request->paused == CURLPAUSE_CONT)
+			paused_requests.erase(request);
+		curl_easy_pause(request->easy, request->paused);
+	}
+
+	// Called by body_source::resume from the event loop's thread
+	void resume_upload(network_request_info *request, body_source *source)
+	{
+		auto it = paused_requests.find(request);
+		if (it == paused_requests.end() || request->upload.get() != source || !(request->paused & CURLPAUSE_SEND))
+			return;
+
+		continue_transfer(request, CURLPAUSE_SEND);
+	}
+
+	// Called by base_stream's resume or consume from the event loop's thread
+	void resume_download(network_request_info *request, base_stream *stream)
+	{
+		auto it = paused_requests.find(request);
+		if (it == paused_requests.end() || request->stream.get() != stream || !(request->paused & CURLPAUSE_RECV))
+			return;
+
+		continue_transfer(request, CURLPAUSE_RECV);
+	}
+
+	static std::string host_key(const swarm::url &url)
+	{
+		std::string key = url.host();
+		if (url.port()) {
+			key += ':';
+			key += boost::lexical_cast<std::string>(*url.port());
+		}
+		return key;
+	}
+
+	network_host_info &find_host(const swarm::url &url)
+	{
+		std::string key = host_key(url);
+
+		auto it = hosts.find(key);
+		if (it == hosts.end()) {
+			it = hosts.emplace(std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple()).first;
+			it->second.name = std::move(key);
+		}
+
+		network_host_info &host = it->second;
+		if (host.idle) {
+			host.idle = false;
+			idle_hosts.erase(idle_hosts.iterator_to(host));
+		}
+
+		return host;
+	}
+
+	// Puts the host to the end of round-robin list if it's request can be started
+	void schedule_host(network_host_info &host)
+	{
+		if (!host.ready && !host.requests.empty() && host.active < host_connections_limit) {
+			host.ready = true;
+			ready_hosts.push_back(host);
+		}
+	}
+
+	/*
+	 * Moves the host to the list of idle ones if it has nothing to do.
+	 * Few recently used idle hosts are kept, so requests to them don't allocate new entries.
+	 */
+	void release_host(network_host_info &host)
+	{
+		if (host.active != 0 || !host.requests.empty() || host.ready || host.idle)
+			return;
+
+		host.idle = true;
+		idle_hosts.push_back(host);
+
+		if (idle_hosts.size() > idle_hosts_limit) {
+			network_host_info &oldest = idle_hosts.front();
+			idle_hosts.pop_front();
+
+			const std::string name = oldest.name;
+			hosts.erase(name);
+		}
+	}
+
+	void process_info(network_request_info *request)
+	{
+		if (request->cancelled) {
+			fail_request(request, make_posix_error(ECANCELED));
+			return;
+		}
+
+		const long deadline = request->request.deadline();
+		if (deadline > 0 && deadline_left(request, deadline) <= 0) {
+			fail_request(request, make_posix_error(ETIMEDOUT));
+			return;
+		}
+
+		if (cache && request->command == GET && !request->upload && lookup_cache(request))
+			return;
+
+		network_host_info &host = find_host(request->request.url());
+
+		if (active_connections < active_connections_limit
+			&& host.active < host_connections_limit
+			&& host.requests.empty()) {
+			start_request(host, request);
+			release_host(host);
+			return;
+		}
+
+		host.requests.push_back(*request);
+		schedule_host(host);
+
+		if (deadline > 0)
+			set_queue_deadline(host, request, deadline_left(request, deadline));
+	}
+
+	/*
+	 * Serves the request by fresh cached reply or makes it conditional if the cached reply is stale.
+	 * Returns true if the request is finished.
+	 */
+	bool lookup_cache(network_request_info *request)
+	{
+		http_headers &headers = request->request.headers();
+		if (!is_cacheable_request(headers))
+			return false;
+
+		request->cache = cache;
+
+		auto cached = cache->get(request->request.url().to_string());
+		if (!cached)
+			return false;
+
+		if (cached->expires > time(NULL) && !cache_control(headers).no_cache) {
+			serve_cached(request, cached);
+			return true;
+		}
+
+		const auto etag = cached->headers.etag();
+		const auto last_modified = cached->headers.last_modified_string();
+		if (etag)
+			headers.set_if_none_match(*etag);
+		if (last_modified)
+			headers.set_if_modified_since(*last_modified);
+		if (etag || last_modified)
+			request->cached = cached;
+
+		return false;
+	}
+
+	void serve_cached(network_request_info *request, const std::shared_ptr<const cached_response> &cached)
+	{
+		std::unique_ptr<network_request_info, request_destroyer> info(request, request_destroyer(this));
+		BH_LOG(info->logger, SWARM_LOG_DEBUG, "Served from cache: %s", cached->url.to_string().c_str());
+
+		info->reply.set_request(std::move(info->request));
+		info->reply.set_code(cached->code);
+		info->reply.set_url(cached->url);
+		info->reply.set_headers(cached->headers);
+		info->on_headers_called = true;
+
+		info->stream->on_headers(std::move(info->reply));
+		if (!cached->body.empty())
+			info->stream->on_data(boost::asio::buffer(cached->body));
+		info->stream->on_close(boost::system::error_code());
+	}
+
+	// Starts queued requests of ready hosts one by one while there are free connection slots
+	void process_queued()
+	{
+		while (!ready_hosts.empty() && active_connections < active_connections_limit) {
+			network_host_info &host = ready_hosts.front();
+			ready_hosts.pop_front();
+			host.ready = false;
+
+			network_request_info &request = host.requests.front();
+			host.requests.pop_front();
+
+			start_request(host, &request);
+			schedule_host(host);
+			release_host(host);
+		}
+	}
+
+	void start_request(network_host_info &host, network_request_info *request)
+	{
+		if (request->timer) {
+			cancel_timer(*request->timer);
+			request->timer = boost::none;
+		}
+
+		if (request->cancelled) {
+			fail_request(request, make_posix_error(ECANCELED));
+			return;
+		}
+
+		++host.started;
+		request->queue_wait = std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - request->begin).count();
+		host.total_wait += request->queue_wait;
+
+		process_info_nocheck(request, host);
+	}
+
+	void report_host_statistics(const std::function<void (std::vector<url_fetcher::host_statistics> &&)> &handler)
+	{
+		const auto now = clock::now();
+
+		std::vector<url_fetcher::host_statistics> result;
+		result.reserve(hosts.size());
+
+		for (auto it = hosts.begin(); it != hosts.end(); ++it) {
+			const network_host_info &host = it->second;
+
+			url_fetcher::host_statistics statistics;
+			statistics.host = host.name;
+			statistics.active = host.active;
+			statistics.queued = host.requests.size();
+			statistics.oldest_wait = host.requests.empty() ? 0
+				: std::chrono::duration_cast<std::chrono::microseconds>(now - host.requests.front().begin).count();
+			statistics.started = host.started;
+			statistics.total_wait = host.total_wait;
+			statistics.finished = host.finished;
+			statistics.connections = host.connections;
+			statistics.http2_finished = host.http2_finished;
+
+			result.emplace_back(std::move(statistics));
+		}
+
+		handler(std::move(result));
+	}
+
+	void process_info_nocheck(network_request_info *request, network_host_info &host)
 	{
 //		auto tmp = clock::now();
 
-		network_connection_info::ptr info(new network_connection_info(logger, request->request.url().to_string()));
-		info->easy = curl_easy_init();
-		info->reply.set_request(std::move(request->request));
+		std::unique_ptr<network_request_info, request_destroyer> info(request, request_destroyer(this));
+		info->logger = swarm::logger(logger, blackhole::log::attributes_t({ keyword::url() = info->request.url().to_string() }));
+		BH_LOG(info->logger, SWARM_LOG_DEBUG, "Started network_request_info: %p", info.get());
+
+		info->easy = acquire_easy();
+		info->reply.set_request(std::move(info->request));
 		info->reply.set_url(info->reply.request().url());
 		info->reply.set_code(200);
-		info->stream = request->stream;
-		info->body = std::move(request->body);
 		if (!info->easy) {
 			info->stream->on_close(make_multi_error(multi_error_category::failed_to_create_easy_handle));
 			return;
 		}
 
-		struct curl_slist *headers_list = NULL;
-		const auto &headers = request->request.headers().all();
+		attach_stream(info.get());
+
+		// Request is already moved to the reply, so headers are taken from there
+		const auto &headers = info->reply.request().headers().all();
 		std::string line;
 		for (auto it = headers.begin(); it != headers.end(); ++it) {
 			line.clear();
@@ -273,10 +1274,12 @@ public:
 			line += ": ";
 			line += it->second;
 
-			headers_list = curl_slist_append(headers_list, line.c_str());
+			info->headers_list = curl_slist_append(info->headers_list, line.c_str());
 		}
 
-		switch (request->command) {
+		if (info->upload) {
+			setup_upload(info.get());
+		} else switch (info->command) {
 		case HEAD:
 			curl_easy_setopt(info->easy, CURLOPT_NOBODY, 1l);
 			break;
@@ -309,33 +1312,32 @@ public:
 			break;
 		}
 
-		curl_easy_setopt(info->easy, CURLOPT_HTTPHEADER, headers_list);
+		curl_easy_setopt(info->easy, CURLOPT_HTTPHEADER, info->headers_list);
 
 		if (!info->reply.request().verify_ssl_peers()) {
 			curl_easy_setopt(info->easy, CURLOPT_SSL_VERIFYPEER, 0L);
 			curl_easy_setopt(info->easy, CURLOPT_SSL_VERIFYHOST, 0L);
 		}
 
-		curl_easy_setopt(info->easy, CURLOPT_VERBOSE, 0L);
 		curl_easy_setopt(info->easy, CURLOPT_URL, info->reply.request().url().to_string().c_str());
-		curl_easy_setopt(info->easy, CURLOPT_TIMEOUT_MS, info->reply.request().timeout());
+		const url_fetcher::request &request_options = info->reply.request();
 
-#if LIBCURL_VERSION_NUM >= MAKE_VERSION(7, 21, 7)
-		IF_CURL_VERSION(7, 21, 7) {
-			/*
-			 * If CURL don't support CURLOPT_CLOSESOCKETFUNCTION yet we should fallback
-			 * to dup-method to prevent memory leak
-			 */
-			curl_easy_setopt(info->easy, CURLOPT_OPENSOCKETFUNCTION, network_manager_private::open_callback);
-			curl_easy_setopt(info->easy, CURLOPT_OPENSOCKETDATA, &loop);
-			curl_easy_setopt(info->easy, CURLOPT_CLOSESOCKETFUNCTION, network_manager_private::close_callback);
-			curl_easy_setopt(info->easy, CURLOPT_CLOSESOCKETDATA, &loop);
+		long timeout = request_options.timeout();
+		if (request_options.deadline() > 0) {
+			// Running request can't outlive it's deadline, expired one fails at once
+			const long left = std::max(1l, deadline_left(info.get(), request_options.deadline()));
+			timeout = timeout > 0 ? std::min(timeout, left) : left;
 		}
-#endif
-		curl_easy_setopt(info->easy, CURLOPT_WRITEFUNCTION, network_manager_private::write_callback);
-		curl_easy_setopt(info->easy, CURLOPT_HEADERFUNCTION, network_manager_private::header_callback);
+		curl_easy_setopt(info->easy, CURLOPT_TIMEOUT_MS, timeout);
+
+		if (request_options.connect_timeout() > 0)
+			curl_easy_setopt(info->easy, CURLOPT_CONNECTTIMEOUT_MS, request_options.connect_timeout());
+		if (request_options.low_speed_limit() > 0) {
+			curl_easy_setopt(info->easy, CURLOPT_LOW_SPEED_LIMIT, request_options.low_speed_limit());
+			curl_easy_setopt(info->easy, CURLOPT_LOW_SPEED_TIME, request_options.low_speed_time());
+		}
+		setup_http2(info->easy);
 		curl_easy_setopt(info->easy, CURLOPT_HEADERDATA, info.get());
-		curl_easy_setopt(info->easy, CURLOPT_NOSIGNAL, 1L);
 		//            curl_easy_setopt(info->easy, CURLOPT_ERRORBUFFER, info->error);
 
 		/*
@@ -355,12 +1357,16 @@ public:
 //			  << std::endl;
 		if (err == CURLM_OK) {
 			++active_connections;
+			++host.active;
+			info->host = &host;
+			if (info->reply.request().first_byte_timeout() > 0)
+				set_first_byte_timeout(info.get(), info->reply.request().first_byte_timeout());
 			/*
 			 * We saved info's content in info->easy and stored it in multi handler,
 			 * which will free it, so we just forget about info's content here.
-			 * Info's destructor (~network_connection_info()) will not be called.
+			 * Info will be destroyed once the transfer is finished.
 			 */
-			infos.insert(info.release());
+			active_requests.push_back(*info.release());
 		} else {
 			/*
 			 * If exception is being thrown, info will be deleted and easy handler will be destroyed,
@@ -376,7 +1382,7 @@ public:
 		char *effective_url = NULL;
 		CURLMsg *msg;
 		int messsages_left;
-		network_connection_info *info = NULL;
+		network_request_info *info = NULL;
 		CURL*easy;
 		CURLcode res;
 
@@ -404,14 +1410,22 @@ public:
 			curl_easy_getinfo(easy, CURLINFO_PRIVATE, &info);
 			curl_easy_getinfo(easy, CURLINFO_EFFECTIVE_URL, &effective_url);
 
+			network_host_info *host = info->host;
+
 			try {
 				info->ensure_headers_sent();
 
 				--active_connections;
+				--host->active;
+				update_host_statistics(*host, easy);
+				update_timing_statistics(info, easy);
+				schedule_host(*host);
 				long err = 0;
 				curl_easy_getinfo(easy, CURLINFO_OS_ERRNO, &err);
 
 				if (msg->data.result == CURLE_OK) {
+					if (info->cache_entry)
+						info->store_cache_entry();
 					info->stream->on_close(boost::system::error_code());
 				} else if (err) {
 					info->stream->on_close(make_posix_error(err));
@@ -420,165 +1434,560 @@ public:
 				}
 			} catch (...) {
 				curl_multi_remove_handle(multi, easy);
-				infos.erase(info);
-				delete info;
+				active_requests.erase(active_requests.iterator_to(*info));
+				destroy_request(info);
+				release_host(*host);
+
+				throw;
+			}
+
+			curl_multi_remove_handle(multi, easy);
+			active_requests.erase(active_requests.iterator_to(*info));
+			release_easy(easy);
+			info->easy = NULL;
+			destroy_request(info);
+			release_host(*host);
+		} while (easy);
+
+		process_queued();
+	}
+
+	static int open_callback(event_loop *loop, curlsocktype purpose, struct curl_sockaddr *address)
+	{
+		if (purpose != CURLSOCKTYPE_IPCXN) {
+			return CURL_SOCKET_BAD;
+		}
+		return loop->open_socket(address->family, address->socktype, address->protocol);
+	}
+
+	static int close_callback(event_loop *loop, curl_socket_t item)
+	{
+		return loop->close_socket(item);
+	}
+
+	static int socket_callback(CURL *e, curl_socket_t s, int what, network_manager_private *manager, void *data)
+	{
+		(void) e;
+
+		event_loop::poll_option option;
+
+		switch (what) {
+			case CURL_POLL_REMOVE:
+				option = event_loop::poll_remove;
+				break;
+			case CURL_POLL_IN:
+				option = event_loop::poll_in;
+				break;
+			case CURL_POLL_OUT:
+				option = event_loop::poll_out;
+				break;
+			case CURL_POLL_INOUT:
+				option = event_loop::poll_all;
+				break;
+			default:
+				BH_LOG(manager->logger, SWARM_LOG_INFO, "socket_callback, unknown what: %d", what);
+				return 0;
+		}
+
+		return manager->loop.socket_request(s, option, data);
+	}
+
+	static int timer_callback(CURLM *multi, long timeout_ms, network_manager_private *manager)
+	{
+		(void) multi;
+
+		if (timeout_ms >= 0)
+			manager->curl_deadline = timer_clock::now() + std::chrono::milliseconds(timeout_ms);
+		else
+			manager->curl_deadline = boost::none;
+
+		manager->update_timer();
+		return 0;
+	}
+
+	/*
+	 * Chunk refused by CURL_WRITEFUNC_PAUSE is kept by curl and passed again
+	 * once the transfer is continued, the rest of the reply stays in the socket.
+	 */
+	static size_t write_callback(char *data, size_t size, size_t nmemb, network_request_info *info)
+	{
+		info->ensure_headers_sent();
+		BH_LOG(info->logger, SWARM_LOG_DEBUG, "write_callback, size: %llu, nmemb: %llu", size, nmemb);
+		const size_t real_size = size * nmemb;
+		base_stream &stream = *info->stream;
+
+		{
+			std::lock_guard<std::mutex> lock(stream.m_mutex);
+			if (stream.is_paused_nolock()) {
+				BH_LOG(info->logger, SWARM_LOG_DEBUG, "write_callback, paused, buffered: %llu", stream.m_buffered);
+				stream.m_manager->pause_transfer(info, CURLPAUSE_RECV);
+				return CURL_WRITEFUNC_PAUSE;
+			}
+		}
+
+		stream.on_data(boost::asio::buffer(data, real_size));
+		if (info->cache_entry)
+			info->append_cache_entry(data, real_size);
+
+		std::lock_guard<std::mutex> lock(stream.m_mutex);
+		stream.m_buffered += real_size;
+		if (stream.m_high_water_mark && stream.m_buffered > stream.m_high_water_mark)
+			stream.m_over_limit = true;
+
+		return real_size;
+	}
+
+	static size_t read_callback(char *data, size_t size, size_t nmemb, network_request_info *info)
+	{
+		size_t result;
+
+		try {
+			result = info->upload->read(boost::asio::buffer(data, size * nmemb));
+		} catch (std::exception &e) {
+			BH_LOG(info->logger, SWARM_LOG_ERROR, "read_callback, failed to read body: %s", e.what());
+			return CURL_READFUNC_ABORT;
+		}
+
+		if (result == body_source::read_pause) {
+			info->upload->m_manager->pause_transfer(info, CURLPAUSE_SEND);
+			return CURL_READFUNC_PAUSE;
+		} else if (result == body_source::read_abort) {
+			return CURL_READFUNC_ABORT;
+		}
+
+		BH_LOG(info->logger, SWARM_LOG_DEBUG, "read_callback, size: %llu", result);
+		return result;
+	}
+
+	static int seek_callback(network_request_info *info, curl_off_t offset, int origin)
+	{
+		if (offset == 0 && origin == SEEK_SET && info->upload->rewind())
+			return CURL_SEEKFUNC_OK;
+
+		return CURL_SEEKFUNC_CANTSEEK;
+	}
+
+	/*
+	 * Curl passes header lines of every reply including redirects and 100 Continue ones,
+	 * they are collected until the end of headers and parsed at once.
+	 */
+	static size_t header_callback(char *data, size_t size, size_t nmemb, network_request_info *info) {
+		const size_t real_size = size * nmemb;
+		info->reply_started = true;
+
+		// Trailers of chunked reply are not passed to the stream
+		if (info->on_headers_called)
+			return real_size;
+
+		// Status line starts the next reply
+		if (is_status_line(data, real_size)) {
+			info->header_lines.clear();
+			return real_size;
+		}
+
+		if (!is_headers_end(data, real_size)) {
+			info->header_lines.append(data, real_size);
+			return real_size;
+		}
+
+		info->parse_headers();
+
+		long code;
+		curl_easy_getinfo(info->easy, CURLINFO_RESPONSE_CODE, &code);
+
+		/*
+		 * Informational reply is followed by the real one, as well as the redirect which is followed.
+		 * Proxy's reply to CONNECT has no response code.
+		 */
+		const bool informational = code < 200;
+		const bool redirect = code >= 300 && code < 400
+			&& info->reply.request().follow_location()
+			&& info->reply.headers().has("Location");
+
+		if (!informational && !redirect)
+			info->ensure_headers_sent();
+
+		return real_size;
+	}
+
+	event_loop &loop;
+	swarm::logger logger;
+	int still_running;
+	int prev_running;
+	std::atomic_long active_connections;
+	std::atomic_long pending_requests;
+	long active_connections_limit;
+	long host_connections_limit;
+	url_fetcher::http2_mode http2;
+	// Memory of records must outlive all lists of requests
+	network_request_slab slab;
+	std::mutex incoming_mutex;
+	// Requests submitted by url_fetcher's methods but not processed by the event loop's thread yet
+	network_request_list incoming_requests;
+	std::unordered_map<std::string, network_host_info> hosts;
+	// Hosts which queued requests can be started, they are served in round-robin order
+	network_host_list ready_hosts;
+	network_host_list idle_hosts;
+	network_request_list active_requests;
+	/*
+	 * Requests which body sources have no data yet or which streams don't accept data,
+	 * they are continued by body_source::resume or base_stream::resume
+	 */
+	std::unordered_set<network_request_info *> paused_requests;
+	std::shared_ptr<url_fetcher_share> share;
+	std::shared_ptr<response_cache> cache;
+	// Durations of phases of finished transfers
+	url_fetcher::timing_statistics timings;
+	// Handlers of add_timer by their deadlines
+	timer_map timers;
+	// Deadline requested by curl and the one the event loop's timer is set to
+	boost::optional<timer_clock::time_point> curl_deadline;
+	boost::optional<timer_clock::time_point> timer_deadline;
+	// Source of backoff's jitter
+	std::minstd_rand random;
+	// Idle easy handles, number of them is limited by maximum number of simultaneous requests
+	std::vector<CURL *> easy_pool;
+	size_t easy_pool_limit;
+	CURLM *multi;
+};
+
+class request_attempts;
+
+/*
+ * Stream of single attempt of the request with retry policy. Attempt's reply is dropped
+ * unless it wins, then the rest of it is passed directly to the user's stream.
+ */
+class attempt_stream : public base_stream
+{
+public:
+	enum attempt_state {
+		attempt_running,
+		attempt_failed,
+		attempt_cancelled
+	};
+
+	attempt_stream(const std::shared_ptr<request_attempts> &owner) :
+		owner(owner), record(NULL), response(boost::none), has_response(false), state(attempt_running)
+	{
+	}
+
+	virtual void on_headers(url_fetcher::response &&response);
+	virtual void on_data(const boost::asio::const_buffer &buffer);
+	virtual void on_close(const boost::system::error_code &error);
+
+	std::shared_ptr<request_attempts> owner;
+	// Request's record, it's valid until the attempt is closed or wins
+	network_request_info *record;
+	// Headers of the failed attempt, they are passed to the user if it's the last one
+	url_fetcher::response response;
+	bool has_response;
+	attempt_state state;
+};
+
+/*
+ * Performs the request by attempts according to it's retry_policy. Lives in the event loop's thread,
+ * it's owned by running attempts and by pending timers.
+ */
+class request_attempts : public std::enable_shared_from_this<request_attempts>
+{
+public:
+	request_attempts(network_manager_private *manager, const std::shared_ptr<base_stream> &stream,
+		url_fetcher::request &&request, http_command command, std::string &&body) :
+		m_manager(manager), m_stream(stream), m_request(std::move(request)), m_policy(m_request.retry()),
+		m_command(command), m_body(std::move(body)), m_response(boost::none), m_has_response(false),
+		m_begin(timer_clock::now()), m_started(0), m_retries(0), m_hedged(false), m_retry_pending(false), m_finished(false)
+	{
+	}
+
+	void start()
+	{
+		start_attempt();
+
+		if (m_policy.hedge_delay > 0) {
+			auto self = shared_from_this();
+			m_manager->add_timer(m_policy.hedge_delay, [self] () {
+				self->hedge();
+			});
+		}
+	}
+
+	void on_headers(attempt_stream *attempt, url_fetcher::response &&response)
+	{
+		if (m_finished || attempt->state != attempt_stream::attempt_running)
+			return;
+
+		auto self = shared_from_this();
+		const long code = response.code();
+
+		// Reply is not received, the attempt's result is known only by on_close
+		if (code == 0) {
+			attempt->response = std::move(response);
+			attempt->has_response = true;
+			return;
+		}
 
-				throw;
-			}
+		if ((status_flags(code) & m_policy.retry_on) && m_retries < m_policy.max_retries) {
+			BH_LOG(m_manager->logger, SWARM_LOG_INFO, "attempt of %s failed with status: %ld",
+				m_request.url().to_string().c_str(), code);
+
+			auto holder = take_attempt(attempt);
+			holder->state = attempt_stream::attempt_failed;
+			m_response = std::move(response);
+			m_has_response = true;
+			m_error = boost::system::error_code();
+			// The transfer is still running, so it's stopped out of curl's callback
+			cancel_later(holder);
+			attempt_failed(true);
+			return;
+		}
 
-			curl_multi_remove_handle(multi, easy);
-			infos.erase(info);
-			delete info;
-		} while (easy);
+		auto holder = take_attempt(attempt);
+		network_request_info *record = holder->record;
+		holder->record = NULL;
+		m_finished = true;
 
-		while (!requests.empty() && active_connections < active_connections_limit) {
-			auto request = requests.front();
-			requests.pop();
-			process_info_nocheck(request);
+		m_manager->switch_stream(record, m_stream);
+
+		for (auto it = m_attempts.begin(); it != m_attempts.end(); ++it) {
+			(*it)->state = attempt_stream::attempt_cancelled;
+			cancel_later(*it);
 		}
+		m_attempts.clear();
+
+		m_stream->on_headers(std::move(response));
 	}
 
-	static int open_callback(event_loop *loop, curlsocktype purpose, struct curl_sockaddr *address)
+	void on_close(attempt_stream *attempt, const boost::system::error_code &error)
 	{
-		if (purpose != CURLSOCKTYPE_IPCXN) {
-			return CURL_SOCKET_BAD;
-		}
-		return loop->open_socket(address->family, address->socktype, address->protocol);
+		attempt->record = NULL;
+
+		if (m_finished || attempt->state != attempt_stream::attempt_running)
+			return;
+
+		auto self = shared_from_this();
+		auto holder = take_attempt(attempt);
+		holder->state = attempt_stream::attempt_failed;
+
+		BH_LOG(m_manager->logger, SWARM_LOG_INFO, "attempt of %s failed: %s",
+			m_request.url().to_string().c_str(), error.message().c_str());
+
+		if (holder->has_response)
+			m_response = std::move(holder->response);
+		m_has_response = holder->has_response;
+		m_error = error;
+		attempt_failed(error && (error_flags(error) & m_policy.retry_on));
 	}
 
-	static int close_callback(event_loop *loop, curl_socket_t item)
+private:
+	void start_attempt()
 	{
-		return loop->close_socket(item);
+		// Attempts go to the request's url and to the alternate ones in turn
+		const size_t index = m_started++ % (m_policy.alternate_urls.size() + 1);
+
+		url_fetcher::request request(m_request);
+		if (index > 0)
+			request.set_url(m_policy.alternate_urls[index - 1]);
+		if (m_request.deadline() > 0)
+			request.set_deadline(std::max(1l, deadline_left()));
+
+		auto attempt = std::make_shared<attempt_stream>(shared_from_this());
+		attempt->record = m_manager->enqueue(attempt, std::move(request), m_command, std::string(m_body));
+		m_attempts.push_back(attempt);
 	}
 
-	static int socket_callback(CURL *e, curl_socket_t s, int what, network_manager_private *manager, void *data)
+	void hedge()
 	{
-		(void) e;
-
-		event_loop::poll_option option;
+		if (m_finished || m_hedged || m_attempts.empty())
+			return;
 
-		switch (what) {
-			case CURL_POLL_REMOVE:
-				option = event_loop::poll_remove;
-				break;
-			case CURL_POLL_IN:
-				option = event_loop::poll_in;
-				break;
-			case CURL_POLL_OUT:
-				option = event_loop::poll_out;
-				break;
-			case CURL_POLL_INOUT:
-				option = event_loop::poll_all;
-				break;
-			default:
-				BH_LOG(manager->logger, SWARM_LOG_INFO, "socket_callback, unknown what: %d", what);
-				return 0;
-		}
+		BH_LOG(m_manager->logger, SWARM_LOG_INFO, "hedging request to %s after %ld ms",
+			m_request.url().to_string().c_str(), m_policy.hedge_delay);
 
-		return manager->loop.socket_request(s, option, data);
+		m_hedged = true;
+		start_attempt();
 	}
 
-	static int timer_callback(CURLM *multi, long timeout_ms, network_manager_private *manager)
+	// Result of the request is decided once there are no attempts left
+	void attempt_failed(bool retryable)
 	{
-		(void) multi;
+		if (!m_attempts.empty() || m_retry_pending)
+			return;
 
-		return manager->loop.timer_request(timeout_ms);
-	}
+		if (retryable && m_retries < m_policy.max_retries && (m_request.deadline() <= 0 || deadline_left() > 0)) {
+			schedule_retry();
+			return;
+		}
 
-	static size_t write_callback(char *data, size_t size, size_t nmemb, network_connection_info *info)
-	{
-		info->ensure_headers_sent();
-		BH_LOG(info->logger, SWARM_LOG_DEBUG, "write_callback, size: %llu, nmemb: %llu", size, nmemb);
-		const size_t real_size = size * nmemb;
-		info->stream->on_data(boost::asio::buffer(data, real_size));
-		return real_size;
+		m_finished = true;
+		if (m_has_response)
+			m_stream->on_headers(std::move(m_response));
+		m_stream->on_close(m_error);
 	}
 
-	template <typename Iter>
-	static inline void trim_line(Iter &begin, Iter &end)
+	// Delay is random up to exponentially growing limit, so retries of many requests don't come together
+	void schedule_retry()
 	{
-		while (begin < end && isspace(*begin))
-		    ++begin;
-		while (begin < end && isspace(*(end - 1)))
-		    --end;
+		++m_retries;
+		m_retry_pending = true;
+
+		long limit = std::max(0l, m_policy.backoff);
+		for (long i = 1; i < m_retries && limit < m_policy.max_backoff; ++i)
+			limit *= 2;
+		limit = std::min(limit, std::max(0l, m_policy.max_backoff));
+
+		const long delay = std::uniform_int_distribution<long>(0, limit)(m_manager->random);
+
+		auto self = shared_from_this();
+		m_manager->add_timer(delay, [self] () {
+			self->m_retry_pending = false;
+			if (!self->m_finished)
+				self->start_attempt();
+		});
 	}
 
-	static std::string trimmed(const char *begin, const char *end)
+	// Attempts share the request's deadline, it's counted since the request's submission
+	long deadline_left() const
 	{
-		trim_line(begin, end);
-		return std::string(begin, end);
+		return m_request.deadline()
+			- std::chrono::duration_cast<std::chrono::milliseconds>(timer_clock::now() - m_begin).count();
 	}
 
-	static size_t header_callback(char *data, size_t size, size_t nmemb, network_connection_info *info) {
-		const size_t real_size = size * nmemb;
-
-		// Empty header line, so it's the end
-		long redirect_count;
-		curl_easy_getinfo(info->easy, CURLINFO_REDIRECT_COUNT, &redirect_count);
+	std::shared_ptr<attempt_stream> take_attempt(attempt_stream *attempt)
+	{
+		std::shared_ptr<attempt_stream> result;
 
-		if (redirect_count != info->redirect_count) {
-			info->redirect_count = redirect_count;
-			info->reply.headers().clear();
+		for (auto it = m_attempts.begin(); it != m_attempts.end(); ++it) {
+			if (it->get() == attempt) {
+				result = std::move(*it);
+				m_attempts.erase(it);
+				break;
+			}
 		}
 
-		if (real_size == 2) {
-			long code;
-			curl_easy_getinfo(info->easy, CURLINFO_RESPONSE_CODE, &code);
+		return result;
+	}
 
-			// Check for location header, if it's not redirect - it's surely final request
-			if (code < 300
-				|| code >= 400
-				|| !(info->reply.request().follow_location()
-					&& info->reply.headers().has("Location"))) {
-				info->ensure_headers_sent();
+	// Curl's handles can't be removed from it's callbacks, so running attempts are cancelled by timer
+	void cancel_later(const std::shared_ptr<attempt_stream> &attempt)
+	{
+		network_manager_private *manager = m_manager;
+		manager->add_timer(0, [manager, attempt] () {
+			if (network_request_info *record = attempt->record) {
+				attempt->record = NULL;
+				manager->cancel_request(record);
 			}
+		});
+	}
 
-			return real_size;
-		}
+	static int status_flags(long code)
+	{
+		if (code == 429)
+			return url_fetcher::retry_policy::retry_too_many_requests;
+		if (code >= 500 && code < 600)
+			return url_fetcher::retry_policy::retry_server_errors;
+		return 0;
+	}
 
-		char *lf;
-		char *end = data + real_size;
-		char *colon = std::find(data, end, ':');
+	static int error_flags(const boost::system::error_code &error)
+	{
+		if (error.category() == network_manager_private::easy_category()) {
+			switch (error.value()) {
+			case CURLE_COULDNT_RESOLVE_PROXY:
+			case CURLE_COULDNT_RESOLVE_HOST:
+			case CURLE_COULDNT_CONNECT:
+				return url_fetcher::retry_policy::retry_connect_errors;
+			case CURLE_OPERATION_TIMEDOUT:
+				return url_fetcher::retry_policy::retry_timeouts;
+			case CURLE_PARTIAL_FILE:
+			case CURLE_SEND_ERROR:
+			case CURLE_RECV_ERROR:
+			case CURLE_GOT_NOTHING:
+#if LIBCURL_VERSION_NUM >= MAKE_VERSION(7, 38, 0)
+			case CURLE_HTTP2:
+#endif
+#if LIBCURL_VERSION_NUM >= MAKE_VERSION(7, 49, 0)
+			case CURLE_HTTP2_STREAM:
+#endif
+				return url_fetcher::retry_policy::retry_transfer_errors;
+			default:
+				return 0;
+			}
+		}
 
-		if (colon != end) {
-			std::string field = trimmed(data, colon);
-			std::string value;
-			value.reserve(16);
+		if (error.category() == boost::system::generic_category()) {
+			switch (error.value()) {
+			case ECONNREFUSED:
+			case EHOSTUNREACH:
+			case ENETUNREACH:
+				return url_fetcher::retry_policy::retry_connect_errors;
+			case ETIMEDOUT:
+				return url_fetcher::retry_policy::retry_timeouts;
+			case ECONNRESET:
+			case ECONNABORTED:
+			case EPIPE:
+				return url_fetcher::retry_policy::retry_transfer_errors;
+			default:
+				return 0;
+			}
+		}
 
-			data = colon + 1;
+		return 0;
+	}
 
-			// any number of LWS is allowed after field, rfc 2068
-			do {
-				lf = std::find(data, end, '\n');
+	network_manager_private *m_manager;
+	std::shared_ptr<base_stream> m_stream;
+	url_fetcher::request m_request;
+	url_fetcher::retry_policy m_policy;
+	http_command m_command;
+	std::string m_body;
+	// Attempts which are running or waiting in the queue
+	std::vector<std::shared_ptr<attempt_stream>> m_attempts;
+	// Result of the last failed attempt
+	url_fetcher::response m_response;
+	bool m_has_response;
+	boost::system::error_code m_error;
+	timer_clock::time_point m_begin;
+	size_t m_started;
+	long m_retries;
+	bool m_hedged;
+	bool m_retry_pending;
+	bool m_finished;
+};
 
-				if (!value.empty())
-					value += ' ';
+void attempt_stream::on_headers(url_fetcher::response &&response)
+{
+	owner->on_headers(this, std::move(response));
+}
 
-				auto value_begin = data;
-				auto value_end = lf;
-				trim_line(value_begin, value_end);
-				value.append(value_begin, value_end);
+void attempt_stream::on_data(const boost::asio::const_buffer &buffer)
+{
+	(void) buffer;
+}
 
-				data = lf;
-			} while (data < end && (*(data + 1) == ' ' || *(data + 1) == '\t'));
+void attempt_stream::on_close(const boost::system::error_code &error)
+{
+	owner->on_close(this, error);
+}
 
-			swarm::headers_entry entry = { std::move(field), std::move(value) };
-			info->reply.headers().add(std::move(entry));
-		}
+/*
+ * Requests with retry policy are performed by request_attempts, the rest are passed
+ * to the event loop's thread directly. Body sources can't be replayed, so they are sent once.
+ */
+void network_manager_private::submit(const std::shared_ptr<base_stream> &stream, url_fetcher::request &&request,
+	http_command command, std::string &&body, const std::shared_ptr<body_source> &upload)
+{
+	const url_fetcher::retry_policy &policy = request.retry();
 
-		return size * nmemb;
+	if (upload || (policy.max_retries <= 0 && policy.hedge_delay <= 0)) {
+		enqueue(stream, std::move(request), command, std::move(body), upload);
+		return;
 	}
 
-	event_loop &loop;
-	swarm::logger logger;
-	int still_running;
-	int prev_running;
-	std::atomic_long active_connections;
-	long active_connections_limit;
-	std::queue<request_info::ptr, std::list<request_info::ptr>> requests;
-	std::set<network_connection_info *> infos;
-	CURLM *multi;
-};
+	auto attempts = std::make_shared<request_attempts>(this, stream, std::move(request), command, std::move(body));
+	loop.post([attempts] () {
+		attempts->start();
+	});
+}
 
 url_fetcher::url_fetcher() : p(NULL)
 {
@@ -619,6 +2028,220 @@ url_fetcher &url_fetcher::operator =(url_fetcher &&other)
 void url_fetcher::set_total_limit(long active_connections)
 {
 	p->active_connections_limit = active_connections;
+	// Handles released above the limit are destroyed
+	p->easy_pool_limit = std::max(0l, std::min<long>(active_connections,
+		network_manager_private::default_easy_pool_limit));
+}
+
+void url_fetcher::set_host_limit(long active_connections)
+{
+	p->host_connections_limit = active_connections;
+}
+
+void body_source::resume()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (!m_manager)
+		return;
+
+	network_manager_private *manager = m_manager;
+	network_request_info *request = static_cast<network_request_info *>(m_request);
+	body_source *source = this;
+
+	manager->loop.post([manager, request, source] () {
+		manager->resume_upload(request, source);
+	});
+}
+
+base_stream::base_stream() :
+	m_manager(NULL), m_request(NULL), m_high_water_mark(0), m_buffered(0), m_paused(false), m_over_limit(false)
+{
+}
+
+base_stream::~base_stream()
+{
+}
+
+void base_stream::pause()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_paused = true;
+}
+
+void base_stream::resume()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (!m_paused)
+		return;
+
+	m_paused = false;
+	notify_resume_nolock();
+}
+
+void base_stream::set_high_water_mark(size_t size)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	m_high_water_mark = size;
+	if (m_over_limit && (!size || m_buffered <= size / 2)) {
+		m_over_limit = false;
+		notify_resume_nolock();
+	}
+}
+
+void base_stream::consume(size_t size)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	m_buffered -= std::min(size, m_buffered);
+	if (m_over_limit && m_buffered <= m_high_water_mark / 2) {
+		m_over_limit = false;
+		notify_resume_nolock();
+	}
+}
+
+bool base_stream::is_paused_nolock() const
+{
+	return m_paused || m_over_limit;
+}
+
+// Transfer is continued by the event loop's thread as curl's handles are not thread safe
+void base_stream::notify_resume_nolock()
+{
+	if (!m_manager || is_paused_nolock())
+		return;
+
+	network_manager_private *manager = m_manager;
+	network_request_info *request = static_cast<network_request_info *>(m_request);
+	base_stream *stream = this;
+
+	manager->loop.post([manager, request, stream] () {
+		manager->resume_download(request, stream);
+	});
+}
+
+void url_fetcher::set_share(const std::shared_ptr<url_fetcher_share> &share)
+{
+	p->share = share;
+
+	// Pooled handles are set up without the share
+	for (auto it = p->easy_pool.begin(); it != p->easy_pool.end(); ++it) {
+		curl_easy_cleanup(*it);
+	}
+	p->easy_pool.clear();
+}
+
+void url_fetcher::set_cache(const std::shared_ptr<response_cache> &cache)
+{
+	p->cache = cache;
+}
+
+void url_fetcher::set_http2_mode(http2_mode mode)
+{
+	p->http2 = mode;
+
+#if LIBCURL_VERSION_NUM >= MAKE_VERSION(7, 43, 0)
+	IF_CURL_VERSION(7, 43, 0) {
+		curl_multi_setopt(p->multi, CURLMOPT_PIPELINING, mode == http2_disabled ? long(CURLPIPE_NOTHING) : long(CURLPIPE_MULTIPLEX));
+	}
+#endif
+}
+
+void url_fetcher::set_max_streams(long streams)
+{
+#if LIBCURL_VERSION_NUM >= MAKE_VERSION(7, 67, 0)
+	IF_CURL_VERSION(7, 67, 0) {
+		curl_multi_setopt(p->multi, CURLMOPT_MAX_CONCURRENT_STREAMS, streams);
+	}
+#else
+	(void) streams;
+#endif
+}
+
+void url_fetcher::get_host_statistics(const std::function<void (std::vector<host_statistics> &&)> &handler)
+{
+	p->loop.post(std::bind(&network_manager_private::report_host_statistics, p, handler));
+}
+
+void url_fetcher::get_timing_statistics(const std::function<void (timing_statistics &&)> &handler)
+{
+	p->loop.post(std::bind(&network_manager_private::report_timing_statistics, p, handler));
+}
+
+url_fetcher::timing_histogram::timing_histogram() : buckets(bounds().size() + 1, 0), count(0), sum(0)
+{
+}
+
+const std::vector<int64_t> &url_fetcher::timing_histogram::bounds()
+{
+	static const std::vector<int64_t> result = [] () {
+		std::vector<int64_t> bounds;
+		for (int64_t scale = 100; scale <= 10000000; scale *= 10) {
+			bounds.push_back(scale);
+			bounds.push_back(2 * scale);
+			bounds.push_back(5 * scale);
+		}
+		bounds.push_back(60000000);
+		return bounds;
+	}();
+
+	return result;
+}
+
+void url_fetcher::timing_histogram::add(int64_t duration)
+{
+	const auto &limits = bounds();
+	const size_t index = std::lower_bound(limits.begin(), limits.end(), duration) - limits.begin();
+
+	++buckets[index];
+	++count;
+	sum += duration;
+}
+
+void url_fetcher::timing_histogram::add(const timing_histogram &other)
+{
+	for (size_t i = 0; i < buckets.size(); ++i) {
+		buckets[i] += other.buckets[i];
+	}
+	count += other.count;
+	sum += other.sum;
+}
+
+int64_t url_fetcher::timing_histogram::percentile(double quantile) const
+{
+	const auto &limits = bounds();
+	const uint64_t rank = static_cast<uint64_t>(quantile * count);
+
+	uint64_t seen = 0;
+	for (size_t i = 0; i < limits.size(); ++i) {
+		seen += buckets[i];
+		if (seen > rank)
+			return limits[i];
+	}
+
+	return count ? std::numeric_limits<int64_t>::max() : 0;
+}
+
+url_fetcher::timing_statistics::timing_statistics() : reused_connections(0)
+{
+}
+
+void url_fetcher::timing_statistics::add(const timing_statistics &other)
+{
+	queue.add(other.queue);
+	name_lookup.add(other.name_lookup);
+	connect.add(other.connect);
+	tls.add(other.tls);
+	server.add(other.server);
+	total.add(other.total);
+	reused_connections += other.reused_connections;
+}
+
+long url_fetcher::pending_requests() const
+{
+	return p->pending_requests;
 }
 
 const logger &url_fetcher::logger() const
@@ -628,76 +2251,61 @@ const logger &url_fetcher::logger() const
 
 void url_fetcher::options(const std::shared_ptr<base_stream> &stream, url_fetcher::request &&request)
 {
-	auto info = std::make_shared<network_manager_private::request_info>();
-	info->stream = stream;
-	info->request = std::move(request);
-	info->command = OPTIONS;
-
-	p->loop.post(std::bind(&network_manager_private::process_info, p, info));
+	p->submit(stream, std::move(request), OPTIONS, std::string());
 }
 
 void url_fetcher::head(const std::shared_ptr<base_stream> &stream, url_fetcher::request &&request)
 {
-	auto info = std::make_shared<network_manager_private::request_info>();
-	info->stream = stream;
-	info->request = std::move(request);
-	info->command = HEAD;
-
-	p->loop.post(std::bind(&network_manager_private::process_info, p, info));
+	p->submit(stream, std::move(request), HEAD, std::string());
 }
 
 void url_fetcher::get(const std::shared_ptr<base_stream> &stream, url_fetcher::request &&request)
 {
-	auto info = std::make_shared<network_manager_private::request_info>();
-	info->stream = stream;
-	info->request = std::move(request);
-	info->command = GET;
-
-	p->loop.post(std::bind(&network_manager_private::process_info, p, info));
+	p->submit(stream, std::move(request), GET, std::string());
 }
 
 void url_fetcher::put(const std::shared_ptr<base_stream> &stream, url_fetcher::request &&request, std::string &&body)
 {
-	auto info = std::make_shared<network_manager_private::request_info>();
-	info->stream = stream;
-	info->request = std::move(request);
-	info->command = PUT;
-	info->body = std::move(body);
+	p->submit(stream, std::move(request), PUT, std::move(body));
+}
 
-	p->loop.post(std::bind(&network_manager_private::process_info, p, info));
+void url_fetcher::put(const std::shared_ptr<base_stream> &stream, url_fetcher::request &&request,
+	const std::shared_ptr<body_source> &body)
+{
+	p->submit(stream, std::move(request), PUT, std::string(), body);
 }
 
 void url_fetcher::del(const std::shared_ptr<base_stream> &stream, url_fetcher::request &&request, std::string &&body)
 {
-	auto info = std::make_shared<network_manager_private::request_info>();
-	info->stream = stream;
-	info->request = std::move(request);
-	info->command = DELETE;
-	info->body = std::move(body);
+	p->submit(stream, std::move(request), DELETE, std::move(body));
+}
 
-	p->loop.post(std::bind(&network_manager_private::process_info, p, info));
+void url_fetcher::del(const std::shared_ptr<base_stream> &stream, url_fetcher::request &&request,
+	const std::shared_ptr<body_source> &body)
+{
+	p->submit(stream, std::move(request), DELETE, std::string(), body);
 }
 
 void url_fetcher::patch(const std::shared_ptr<base_stream> &stream, url_fetcher::request &&request, std::string &&body)
 {
-	auto info = std::make_shared<network_manager_private::request_info>();
-	info->stream = stream;
-	info->request = std::move(request);
-	info->command = PATCH;
-	info->body = std::move(body);
+	p->submit(stream, std::move(request), PATCH, std::move(body));
+}
 
-	p->loop.post(std::bind(&network_manager_private::process_info, p, info));
+void url_fetcher::patch(const std::shared_ptr<base_stream> &stream, url_fetcher::request &&request,
+	const std::shared_ptr<body_source> &body)
+{
+	p->submit(stream, std::move(request), PATCH, std::string(), body);
 }
 
 void url_fetcher::post(const std::shared_ptr<base_stream> &stream, url_fetcher::request &&request, std::string &&body)
 {
-	auto info = std::make_shared<network_manager_private::request_info>();
-	info->stream = stream;
-	info->request = std::move(request);
-	info->command = POST;
-	info->body = std::move(body);
+	p->submit(stream, std::move(request), POST, std::move(body));
+}
 
-	p->loop.post(std::bind(&network_manager_private::process_info, p, info));
+void url_fetcher::post(const std::shared_ptr<base_stream> &stream, url_fetcher::request &&request,
+	const std::shared_ptr<body_source> &body)
+{
+	p->submit(stream, std::move(request), POST, std::string(), body);
 }
 
 #define M_DATA() (static_cast<data *>(m_data.get()))
@@ -706,13 +2314,20 @@ class url_fetcher_request_data : public http_request_data
 {
 public:
 	url_fetcher_request_data() : follow_location(false), timeout(30000)
+				   , connect_timeout(0), first_byte_timeout(0), low_speed_limit(0), low_speed_time(0), deadline(0)
 				   , verify_ssl_peers(true)
 	{
 	}
 
 	bool follow_location;
 	long timeout;
+	long connect_timeout;
+	long first_byte_timeout;
+	long low_speed_limit;
+	long low_speed_time;
+	long deadline;
 	bool verify_ssl_peers;
+	url_fetcher::retry_policy retry;
 };
 
 class url_fetcher_response_data : public http_response_data
@@ -724,8 +2339,15 @@ public:
 
 	swarm::url url;
 	url_fetcher::request request;
+	url_fetcher::transfer_timings timings;
 };
 
+url_fetcher::retry_policy::retry_policy() :
+	max_retries(0), retry_on(retry_connect_errors | retry_transfer_errors | retry_server_errors),
+	backoff(50), max_backoff(1000), hedge_delay(0)
+{
+}
+
 url_fetcher::request::request() : http_request(*new url_fetcher_request_data)
 {
 }
@@ -752,8 +2374,7 @@ url_fetcher::request::~request()
 url_fetcher::request &url_fetcher::request::operator =(url_fetcher::request &&other)
 {
 	using std::swap;
-	url_fetcher::request tmp(other);
-	swap(m_data, tmp.m_data);
+	swap(m_data, other.m_data);
 	return *this;
 }
 
@@ -785,6 +2406,52 @@ void url_fetcher::request::set_timeout(long timeout)
 	M_DATA()->timeout = timeout;
 }
 
+long url_fetcher::request::connect_timeout() const
+{
+	return M_DATA()->connect_timeout;
+}
+
+void url_fetcher::request::set_connect_timeout(long timeout)
+{
+	M_DATA()->connect_timeout = timeout;
+}
+
+long url_fetcher::request::first_byte_timeout() const
+{
+	return M_DATA()->first_byte_timeout;
+}
+
+void url_fetcher::request::set_first_byte_timeout(long timeout)
+{
+	M_DATA()->first_byte_timeout = timeout;
+}
+
+long url_fetcher::request::low_speed_limit() const
+{
+	return M_DATA()->low_speed_limit;
+}
+
+long url_fetcher::request::low_speed_time() const
+{
+	return M_DATA()->low_speed_time;
+}
+
+void url_fetcher::request::set_low_speed_limit(long bytes_per_second, long seconds)
+{
+	M_DATA()->low_speed_limit = bytes_per_second;
+	M_DATA()->low_speed_time = seconds;
+}
+
+long url_fetcher::request::deadline() const
+{
+	return M_DATA()->deadline;
+}
+
+void url_fetcher::request::set_deadline(long deadline)
+{
+	M_DATA()->deadline = deadline;
+}
+
 bool url_fetcher::request::verify_ssl_peers() const
 {
 	return M_DATA()->verify_ssl_peers;
@@ -795,6 +2462,22 @@ void url_fetcher::request::set_verify_ssl_peers(bool verify)
 	M_DATA()->verify_ssl_peers = verify;
 }
 
+const url_fetcher::retry_policy &url_fetcher::request::retry() const
+{
+	return M_DATA()->retry;
+}
+
+void url_fetcher::request::set_retry(const retry_policy &retry)
+{
+	M_DATA()->retry = retry;
+}
+
+url_fetcher::transfer_timings::transfer_timings() :
+	queue(0), name_lookup(0), connect(0), app_connect(0), pre_transfer(0), start_transfer(0), total(0),
+	reused_connection(false)
+{
+}
+
 url_fetcher::response::response() : http_response(*new url_fetcher_response_data)
 {
 }
@@ -863,5 +2546,15 @@ void url_fetcher::response::set_request(url_fetcher::request &&request)
 	M_DATA()->request = std::move(request);
 }
 
+const url_fetcher::transfer_timings &url_fetcher::response::timings() const
+{
+	return M_DATA()->timings;
+}
+
+void url_fetcher::response::set_timings(const transfer_timings &timings)
+{
+	M_DATA()->timings = timings;
+}
+
 } // namespace service
 } // namespace cocaine
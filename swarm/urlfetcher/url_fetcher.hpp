@@ -22,9 +22,15 @@
 
 #include "../logger.hpp"
 #include "event_loop.hpp"
+#include "body_source.hpp"
+#include "share.hpp"
+#include "response_cache.hpp"
 #include <memory>
 #include <functional>
 #include <map>
+#include <mutex>
+#include <string>
+#include <vector>
 
 #include <boost/asio.hpp>
 #include <boost/variant.hpp>
@@ -67,6 +73,53 @@ public:
 
 	url_fetcher &operator =(url_fetcher &&other);
 
+	/*!
+	 * \brief The retry_policy struct describes how request is repeated if it fails or is slow.
+	 *
+	 * Request is performed by several attempts, only one of them reaches the stream:
+	 * the first one which receives headers with status not chosen for retry, or the last one.
+	 * Once there is a winner, other attempts are cancelled.
+	 *
+	 * Use it only for idempotent requests, attempts may reach the server more than once.
+	 * Requests with body_source are always sent once.
+	 */
+	struct retry_policy
+	{
+		enum retry_flags {
+			//! Failed resolving or connection, the request was not sent
+			retry_connect_errors = 0x01,
+			//! Attempt's timeout is expired
+			retry_timeouts = 0x02,
+			//! Connection is broken during the transfer
+			retry_transfer_errors = 0x04,
+			//! Server replied by 5xx status
+			retry_server_errors = 0x08,
+			//! Server replied by 429 status
+			retry_too_many_requests = 0x10
+		};
+
+		retry_policy();
+
+		//! Number of attempts after the failed ones, zero by default
+		long max_retries;
+		//! Bitmask of retry_flags, connect errors, transfer errors and 5xx statuses by default
+		int retry_on;
+		/*!
+		 * Delay before the first retry in milliseconds, it's doubled by every next one up to max_backoff.
+		 * Actual delay is random between zero and this value, so retries of many requests are spread in time.
+		 * It's 50 ms by default, max_backoff is 1000 ms.
+		 */
+		long backoff;
+		long max_backoff;
+		/*!
+		 * Delay in milliseconds after which second attempt is sent if there is no reply yet,
+		 * i.e. 95th percentile of response time. Zero disables hedging, which is default.
+		 */
+		long hedge_delay;
+		//! Urls of replicas used by attempts in turn after the request's own one, i.e. by hedged attempt
+		std::vector<swarm::url> alternate_urls;
+	};
+
 	class request : public http_request
 	{
 		typedef url_fetcher_request_data data;
@@ -97,6 +150,44 @@ public:
 		 */
 		void set_timeout(long timeout);
 
+		long connect_timeout() const;
+		/*!
+		 * \brief Sets \a timeout milliseconds as limit of connection's establishment, including resolving and TLS handshake.
+		 *
+		 * Zero means libcurl's default of 300 seconds, which is default.
+		 */
+		void set_connect_timeout(long timeout);
+
+		long first_byte_timeout() const;
+		/*!
+		 * \brief Sets \a timeout milliseconds as limit of time from the transfer's start till the first byte of reply.
+		 *
+		 * Request which gets no reply in time is aborted with error code 110. Zero disables the limit, which is default.
+		 */
+		void set_first_byte_timeout(long timeout);
+
+		long low_speed_limit() const;
+		long low_speed_time() const;
+		/*!
+		 * \brief Aborts the request if it's speed is below \a bytes_per_second for \a seconds.
+		 *
+		 * Zero speed disables the limit, which is default.
+		 */
+		void set_low_speed_limit(long bytes_per_second, long seconds);
+
+		long deadline() const;
+		/*!
+		 * \brief Sets \a deadline milliseconds as limit of request's whole life since it's passed to url fetcher.
+		 *
+		 * Unlike timeout it includes time the request waits for free connection because of
+		 * url_fetcher::set_total_limit and url_fetcher::set_host_limit. Queued request is aborted
+		 * with error code 110 as soon as the deadline passes, running one's timeout is cut to it.
+		 * Retries and hedged attempts of the request share it's deadline.
+		 *
+		 * Zero disables the deadline, which is default.
+		 */
+		void set_deadline(long deadline);
+
 		bool verify_ssl_peers() const;
 		/*!
 		 * \brief Specifies if the client verifies the SSL peers. True by default.
@@ -105,6 +196,42 @@ public:
 		 * then the request fails. A value of false allows for self-signed certificates.
 		 */
 		void set_verify_ssl_peers(bool verify);
+
+		const retry_policy &retry() const;
+		/*!
+		 * \brief Sets policy of retries and hedging of the request to \a retry.
+		 *
+		 * By default request is sent once.
+		 */
+		void set_retry(const retry_policy &retry);
+	};
+
+	/*!
+	 * \brief The transfer_timings struct describes where time of the request was spent.
+	 *
+	 * Times of transfer's phases are in microseconds since the transfer's start, like libcurl reports them,
+	 * so i.e. connect includes name_lookup. Phases the transfer had not reached are zero.
+	 */
+	struct transfer_timings
+	{
+		transfer_timings();
+
+		//! Time the request has waited for free connection in url fetcher's queue before the transfer's start
+		int64_t queue;
+		//! Host's name is resolved
+		int64_t name_lookup;
+		//! TCP connection is established
+		int64_t connect;
+		//! TLS handshake is finished, zero for plain http
+		int64_t app_connect;
+		//! Request is about to be sent
+		int64_t pre_transfer;
+		//! First byte of the reply is received
+		int64_t start_transfer;
+		//! Whole transfer including all redirects
+		int64_t total;
+		//! Request was sent by already opened connection, so there was neither name lookup nor connect
+		bool reused_connection;
 	};
 
 	class response : public http_response
@@ -136,6 +263,15 @@ public:
 		const url_fetcher::request &request() const;
 		void set_request(const url_fetcher::request &request);
 		void set_request(url_fetcher::request &&request);
+
+		/*!
+		 * \brief Returnes timings of the request's transfer.
+		 *
+		 * Response is passed to the stream once headers are received, so total is time till then.
+		 * Replies served by the cache have zero timings.
+		 */
+		const transfer_timings &timings() const;
+		void set_timings(const transfer_timings &timings);
 	};
 
 	/*!
@@ -146,6 +282,168 @@ public:
 	 * By default this property is set to LONG_MAX.
 	 */
 	void set_total_limit(long active_connections);
+	/*!
+	 * \brief Set limit of simultaneously running requests to the same host to \a active_connections.
+	 *
+	 * Hosts are distinguished by host name and explicitly set port. Requests exceeding
+	 * this or total limit are queued per host, once connection slot is free hosts with
+	 * queued requests are served in round-robin order, so single slow host can't occupy all slots.
+	 *
+	 * By default this property is set to LONG_MAX.
+	 */
+	void set_host_limit(long active_connections);
+
+	/*!
+	 * \brief The http2_mode enum describes usage of HTTP/2 by url fetcher.
+	 */
+	enum http2_mode {
+		//! Only HTTP/1.1 is used, each running request has it's own connection
+		http2_disabled,
+		//! HTTP/2 is negotiated by ALPN for https urls, HTTP/1.1 is used for plain http
+		http2_tls,
+		//! HTTP/2 is used without negotiation, it's required for h2c backends
+		http2_prior_knowledge
+	};
+
+	/*!
+	 * \brief Set usage of HTTP/2 to \a mode.
+	 *
+	 * If HTTP/2 is enabled simultaneous requests to the same host are multiplexed
+	 * as streams of single connection, new requests wait for the connection to be established
+	 * instead of opening their own ones. set_host_limit limits number of streams to the host then.
+	 *
+	 * HTTP/2 requires libcurl 7.43 (7.49 for prior knowledge) built with nghttp2,
+	 * otherwise HTTP/1.1 is used.
+	 *
+	 * By default this property is set to http2_disabled.
+	 */
+	void set_http2_mode(http2_mode mode);
+	/*!
+	 * \brief Set maximum number of simultaneous HTTP/2 streams per connection to \a streams.
+	 *
+	 * New connection to the host is opened once all it's connections have this many streams.
+	 * Requires libcurl 7.67, libcurl's default is 100.
+	 */
+	void set_max_streams(long streams);
+	/*!
+	 * \brief Makes url fetcher to use cache of hosts, connections or TLS sessions \a share.
+	 *
+	 * Share may be passed to several url fetchers. It must be set before the first request.
+	 * By default every url fetcher has it's own caches.
+	 *
+	 * \sa url_fetcher_share
+	 */
+	void set_share(const std::shared_ptr<url_fetcher_share> &share);
+	/*!
+	 * \brief Makes url fetcher to store replies to GET requests in \a cache.
+	 *
+	 * Fresh replies are passed to streams from the cache without requests to the server,
+	 * stale ones are revalidated by conditional requests. Not Modified replies are passed
+	 * to streams as cached ones with updated headers, so streams never see 304 status of them.
+	 * Cache may be passed to several url fetchers. It must be set before the first request.
+	 *
+	 * By default there is no cache.
+	 *
+	 * \sa lru_response_cache
+	 */
+	void set_cache(const std::shared_ptr<response_cache> &cache);
+
+	/*!
+	 * \brief The host_statistics struct describes requests to a single host.
+	 */
+	struct host_statistics
+	{
+		//! Host name and port if it's set explicitly
+		std::string host;
+		//! Number of running requests
+		long active;
+		//! Number of requests waiting for connection slot
+		size_t queued;
+		//! Time the oldest queued request is waiting, in microseconds
+		int64_t oldest_wait;
+		//! Number of started requests
+		uint64_t started;
+		//! Total time started requests have spent in queue, in microseconds
+		int64_t total_wait;
+		//! Number of finished requests
+		uint64_t finished;
+		//! Number of connections opened by finished requests, finished / connections is average number of requests per connection
+		uint64_t connections;
+		//! Number of finished requests performed by HTTP/2
+		uint64_t http2_finished;
+	};
+
+	/*!
+	 * \brief Calls \a handler with statistics of all recently used hosts.
+	 *
+	 * Counters are accumulated while host has running or queued requests and
+	 * for some time after it, limited number of idle hosts is remembered.
+	 *
+	 * \a Handler is called from the event loop's thread. This method is thread safe.
+	 */
+	void get_host_statistics(const std::function<void (std::vector<host_statistics> &&)> &handler);
+
+	/*!
+	 * \brief The timing_histogram struct is distribution of durations of one phase of requests.
+	 */
+	struct timing_histogram
+	{
+		timing_histogram();
+
+		//! Upper bounds of buckets in microseconds, from 100 us to 60 s by 1-2-5 steps
+		static const std::vector<int64_t> &bounds();
+
+		//! Number of durations by buckets, the last one is above all bounds
+		std::vector<uint64_t> buckets;
+		uint64_t count;
+		//! Sum of durations in microseconds
+		int64_t sum;
+
+		void add(int64_t duration);
+		void add(const timing_histogram &other);
+		//! Returns upper bound of the bucket which contains \a quantile of durations, i.e. 0.99
+		int64_t percentile(double quantile) const;
+	};
+
+	/*!
+	 * \brief The timing_statistics struct describes durations of phases of finished requests.
+	 *
+	 * Unlike transfer_timings phases are not cumulative, i.e. connect doesn't include name lookup.
+	 * Only transfers which have reached the phase are counted by it's histogram.
+	 */
+	struct timing_statistics
+	{
+		timing_statistics();
+
+		//! Waiting for free connection in url fetcher's queue
+		timing_histogram queue;
+		timing_histogram name_lookup;
+		timing_histogram connect;
+		//! TLS handshake
+		timing_histogram tls;
+		//! From sending the request till the first byte of the reply, i.e. server's time
+		timing_histogram server;
+		//! Whole transfer without the queue
+		timing_histogram total;
+		//! Number of requests sent by already opened connections
+		uint64_t reused_connections;
+
+		void add(const timing_statistics &other);
+	};
+
+	/*!
+	 * \brief Calls \a handler with timing statistics of all requests finished since the url fetcher's creation.
+	 *
+	 * \a Handler is called from the event loop's thread. This method is thread safe.
+	 */
+	void get_timing_statistics(const std::function<void (timing_statistics &&)> &handler);
+
+	/*!
+	 * \brief Returns number of requests submitted but not finished yet, including queued ones.
+	 *
+	 * This method is thread safe.
+	 */
+	long pending_requests() const;
 
 	const swarm::logger &logger() const;
 
@@ -201,6 +499,17 @@ public:
 	 * \sa get
 	 */
 	void post(const std::shared_ptr<base_stream> &stream, url_fetcher::request &&request, std::string &&body);
+	/*!
+	 * \brief Make POST HTTP request to server by \a request with \a body read by parts. Result will be send to \a stream.
+	 *
+	 * Body is read only when connection is ready to send it, so it doesn't have to be in memory entirely.
+	 *
+	 * This method is thread safe.
+	 *
+	 * \sa body_source
+	 */
+	void post(const std::shared_ptr<base_stream> &stream, url_fetcher::request &&request,
+		const std::shared_ptr<body_source> &body);
 	/*!
 	 * \brief Make PUT HTTP request to server by \a request with \a body. Result will be send to \a stream.
 	 *
@@ -214,6 +523,17 @@ public:
 	 * \sa get
 	 */
 	void put(const std::shared_ptr<base_stream> &stream, url_fetcher::request &&request, std::string &&body);
+	/*!
+	 * \brief Make PUT HTTP request to server by \a request with \a body read by parts. Result will be send to \a stream.
+	 *
+	 * Body is read only when connection is ready to send it, so it doesn't have to be in memory entirely.
+	 *
+	 * This method is thread safe.
+	 *
+	 * \sa body_source
+	 */
+	void put(const std::shared_ptr<base_stream> &stream, url_fetcher::request &&request,
+		const std::shared_ptr<body_source> &body);
 	/*!
 	 * \brief Make DELETE HTTP request to server by \a request with \a body. Result will be send to \a stream.
 	 *
@@ -227,6 +547,17 @@ public:
 	 * \sa get
 	 */
 	void del(const std::shared_ptr<base_stream> &stream, url_fetcher::request &&request, std::string &&body);
+	/*!
+	 * \brief Make DELETE HTTP request to server by \a request with \a body read by parts. Result will be send to \a stream.
+	 *
+	 * Body is read only when connection is ready to send it, so it doesn't have to be in memory entirely.
+	 *
+	 * This method is thread safe.
+	 *
+	 * \sa body_source
+	 */
+	void del(const std::shared_ptr<base_stream> &stream, url_fetcher::request &&request,
+		const std::shared_ptr<body_source> &body);
 	/*!
 	 * \brief Make PATCH HTTP request to server by \a request with \a body. Result will be send to \a stream.
 	 *
@@ -240,6 +571,17 @@ public:
 	 * \sa get
 	 */
 	void patch(const std::shared_ptr<base_stream> &stream, url_fetcher::request &&request, std::string &&body);
+	/*!
+	 * \brief Make PATCH HTTP request to server by \a request with \a body read by parts. Result will be send to \a stream.
+	 *
+	 * Body is read only when connection is ready to send it, so it doesn't have to be in memory entirely.
+	 *
+	 * This method is thread safe.
+	 *
+	 * \sa body_source
+	 */
+	void patch(const std::shared_ptr<base_stream> &stream, url_fetcher::request &&request,
+		const std::shared_ptr<body_source> &body);
 
 private:
 	url_fetcher(const url_fetcher &other) = delete;
@@ -252,14 +594,23 @@ private:
 
 /*!
  * \brief The base_stream class is an interface for handling request-specific events.
+ *
+ * Stream may slow down the server if it can't dispose the data as fast as it comes,
+ * i.e. if it's proxied to a slow client. Delivery of data by on_data is stopped
+ * either explicitly by pause or once more than high water mark bytes are delivered
+ * but not reported by consume yet. Meanwhile the data is left in the socket, so
+ * memory usage doesn't depend on the size of the reply.
+ *
+ * Stream may be used by single request at a time.
  */
 class base_stream
 {
 public:
+	base_stream();
 	/*!
 	 * \brief Destroyes the base_stream.
 	 */
-	virtual ~base_stream() {}
+	virtual ~base_stream();
 
 	/*!
 	 * \brief This method is called once final headers are received.
@@ -286,6 +637,50 @@ public:
 	 * So i.e. timeout is notified by "curl_easy_code" error category and CURLE_OPERATION_TIMEDOUT error.
 	 */
 	virtual void on_close(const boost::system::error_code &error) = 0;
+
+	/*!
+	 * \brief Stops delivery of data until resume is called.
+	 *
+	 * Chunk passed to on_data at the moment is considered as delivered anyway.
+	 * It's safe to call it from any thread.
+	 */
+	void pause();
+	/*!
+	 * \brief Continues delivery of data stopped by pause.
+	 *
+	 * It's safe to call it from any thread and at any moment.
+	 */
+	void resume();
+	/*!
+	 * \brief Limits amount of data delivered to on_data but not consumed yet by \a size bytes.
+	 *
+	 * Once the limit is exceeded delivery is stopped until amount of not consumed data
+	 * is halved. Zero disables the limit, which is default.
+	 */
+	void set_high_water_mark(size_t size);
+	/*!
+	 * \brief Reports that \a size bytes passed to on_data are disposed.
+	 *
+	 * It's needed only if high water mark is set. It's safe to call it from any thread.
+	 */
+	void consume(size_t size);
+
+private:
+	base_stream(const base_stream &other) = delete;
+	base_stream &operator =(const base_stream &other) = delete;
+
+	friend class network_manager_private;
+
+	bool is_paused_nolock() const;
+	void notify_resume_nolock();
+
+	std::mutex m_mutex;
+	network_manager_private *m_manager;
+	void *m_request;
+	size_t m_high_water_mark;
+	size_t m_buffered;
+	bool m_paused;
+	bool m_over_limit;
 };
 
 } // namespace service
@@ -31,6 +31,9 @@ class Server(object):
                 regex_match: regex to match URL.
                 methods: list of supported methods.
                 headers: dict of necessary headers and their values.
+        access_log:
+            Asynchronous access log configuration (e.g., format, path, sample_rate).
+            Disabled by default.
     '''
 
     CONFIG_TEMPLATE = '''\
@@ -60,6 +63,9 @@ class Server(object):
     },
     "monitor-port": {{ monitor_port }},
     "log_request_headers": {{ log_request_headers | tojson | safe }},
+{% if access_log %}
+    "access_log": {{ access_log | tojson | safe }},
+{% endif %}
     "application": {
         "handlers": {{ handlers | tojson | safe }}
     }
@@ -75,6 +81,7 @@ class Server(object):
         self.opts['monitor_port'] = kwargs.get('monitor_port', 0)
         self.opts['log_request_headers'] = kwargs.get('log_request_headers', [])
         self.opts['handlers'] = kwargs.get('handlers', [])
+        self.opts['access_log'] = kwargs.get('access_log')
         self.config_file = None
 
     def configure(self):
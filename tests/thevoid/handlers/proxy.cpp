@@ -0,0 +1,167 @@
+/*
+ * Copyright 2015+ Ruslan Nigmatullin <euroelessar@yandex.ru>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "thevoid/stream.hpp"
+#include "swarm/urlfetcher/url_fetcher.hpp"
+#include "swarm/urlfetcher/boost_event_loop.hpp"
+#include "swarm/urlfetcher/stream.hpp"
+
+#include "handlers_factory.hpp"
+
+
+namespace handlers {
+
+/*
+ * Url fetcher with it's own event loop's thread shared by all proxy handlers,
+ * so reply to the client is sent from the thread different from the connection's one.
+ * Cacheable replies are kept in memory.
+ */
+class upstream_fetcher
+{
+public:
+	upstream_fetcher(const ioremap::swarm::logger &logger) :
+		m_work(m_service),
+		m_loop(m_service, logger),
+		m_fetcher(m_loop, logger),
+		m_thread([this] () { m_service.run(); })
+	{
+		m_fetcher.set_cache(std::make_shared<ioremap::swarm::lru_response_cache>(16 * 1024 * 1024));
+	}
+
+	~upstream_fetcher()
+	{
+		m_service.stop();
+		m_thread.join();
+	}
+
+	// Fetcher is created by the first request, so it logs with that request's logger
+	static ioremap::swarm::url_fetcher &instance(const ioremap::swarm::logger &logger)
+	{
+		static upstream_fetcher fetcher(logger);
+		return fetcher.m_fetcher;
+	}
+
+private:
+	boost::asio::io_service m_service;
+	boost::asio::io_service::work m_work;
+	ioremap::swarm::boost_event_loop m_loop;
+	ioremap::swarm::url_fetcher m_fetcher;
+	std::thread m_thread;
+};
+
+/*
+ * Passes upstream's reply to the client. Every chunk is consumed once it's written to the socket,
+ * so no more than high water mark bytes are kept in memory if the client is slow.
+ */
+class proxy_stream
+	: public ioremap::swarm::base_stream
+	, public std::enable_shared_from_this<proxy_stream>
+{
+public:
+	proxy_stream(const std::shared_ptr<ioremap::thevoid::reply_stream> &reply) : m_reply(reply)
+	{
+	}
+
+	virtual void on_headers(ioremap::swarm::url_fetcher::response &&response)
+	{
+		ioremap::thevoid::http_response reply;
+		reply.set_code(response.code());
+		if (auto content_length = response.headers().content_length())
+			reply.headers().set_content_length(*content_length);
+
+		m_reply->send_headers(std::move(reply), boost::asio::const_buffer(),
+			ioremap::thevoid::reply_stream::result_function());
+	}
+
+	virtual void on_data(const boost::asio::const_buffer &buffer)
+	{
+		auto begin = boost::asio::buffer_cast<const char *>(buffer);
+		auto chunk = std::make_shared<std::string>(begin, begin + boost::asio::buffer_size(buffer));
+		auto stream = shared_from_this();
+
+		m_reply->send_data(boost::asio::buffer(*chunk), [stream, chunk] (const boost::system::error_code &) {
+			stream->consume(chunk->size());
+		});
+	}
+
+	virtual void on_close(const boost::system::error_code &error)
+	{
+		m_reply->close(error);
+	}
+
+private:
+	std::shared_ptr<ioremap::thevoid::reply_stream> m_reply;
+};
+
+/*
+ * Fetches url passed by "url" query's item. Flow control is disabled if "high_water_mark" is zero.
+ * Failed request is repeated "max_retries" times, slow one is hedged after "hedge_delay" milliseconds.
+ * "first_byte_timeout" and "deadline" limit the request's time in milliseconds.
+ * Reply is collected by simple_stream and sent at once if "simple" is set.
+ */
+class proxy
+	: public ioremap::thevoid::simple_request_stream<server>
+	, public std::enable_shared_from_this<proxy>
+{
+	virtual void on_request(const ioremap::thevoid::http_request& req,
+			const boost::asio::const_buffer& /* buffer */)
+	{
+		const auto &query = req.url().query();
+
+		ioremap::swarm::url_fetcher::request request;
+		request.set_url(query.item_value<std::string>("url", ""));
+		request.set_timeout(60000);
+		request.set_first_byte_timeout(query.item_value<long>("first_byte_timeout", 0));
+		request.set_deadline(query.item_value<long>("deadline", 0));
+
+		ioremap::swarm::url_fetcher::retry_policy retry;
+		retry.max_retries = query.item_value<long>("max_retries", 0);
+		retry.hedge_delay = query.item_value<long>("hedge_delay", 0);
+		request.set_retry(retry);
+
+		if (query.item_value<int>("simple", 0)) {
+			auto self = shared_from_this();
+			auto stream = ioremap::swarm::simple_stream::create([self] (const ioremap::swarm::url_fetcher::response &response,
+					const std::string &data, const boost::system::error_code &error) {
+				if (error) {
+					self->send_reply(ioremap::thevoid::http_response::HTTP_502_BAD_GATEWAY);
+					return;
+				}
+
+				ioremap::thevoid::http_response reply;
+				reply.set_code(response.code());
+				reply.headers().set_content_length(data.size());
+				self->send_reply(std::move(reply), std::string(data));
+			});
+
+			upstream_fetcher::instance(this->logger()).get(stream, std::move(request));
+			return;
+		}
+
+		auto stream = std::make_shared<proxy_stream>(this->reply());
+		stream->set_high_water_mark(query.item_value<size_t>("high_water_mark", 1024 * 1024));
+
+		upstream_fetcher::instance(this->logger()).get(stream, std::move(request));
+	}
+};
+
+} // namespace handlers
+
+REGISTER_HANDLER(proxy)
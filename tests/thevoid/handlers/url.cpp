@@ -0,0 +1,87 @@
+/*
+ * Copyright 2015+ Danil Osherov <shindo@yandex-team.ru>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <memory>
+#include <sstream>
+
+#include "thevoid/stream.hpp"
+
+#include "handlers_factory.hpp"
+
+
+namespace handlers {
+
+/*!
+ * Compares request's url, which is parsed as request target, with the same url
+ * parsed by uriparser. Responds 200 if they are equal and 500 with the difference otherwise.
+ */
+class url
+	: public ioremap::thevoid::simple_request_stream<server>
+	, public std::enable_shared_from_this<url>
+{
+	virtual void on_request(const ioremap::thevoid::http_request& req,
+			const boost::asio::const_buffer& /* buffer */)
+	{
+		const ioremap::swarm::url& actual = req.url();
+		const ioremap::swarm::url expected(actual.original());
+
+		std::ostringstream difference;
+		compare(difference, "is_valid", actual.is_valid(), expected.is_valid());
+		compare(difference, "scheme", actual.scheme(), expected.scheme());
+		compare(difference, "host", actual.host(), expected.host());
+		compare(difference, "port", actual.port() ? *actual.port() : 0, expected.port() ? *expected.port() : 0);
+		compare(difference, "path", actual.path(), expected.path());
+		compare(difference, "path_components", join(actual.path_components()), join(expected.path_components()));
+		compare(difference, "raw_query", actual.raw_query(), expected.raw_query());
+		compare(difference, "query", actual.query().to_string(), expected.query().to_string());
+		compare(difference, "fragment", actual.fragment(), expected.fragment());
+		compare(difference, "to_string", actual.to_string(), expected.to_string());
+		compare(difference, "to_canonical", actual.to_canonical(), expected.to_canonical());
+		compare(difference, "fingerprint", actual.fingerprint(), expected.fingerprint());
+
+		std::string data = difference.str();
+
+		ioremap::thevoid::http_response response;
+		response.set_code(data.empty()
+				? ioremap::thevoid::http_response::HTTP_200_OK
+				: ioremap::thevoid::http_response::HTTP_500_INTERNAL_SERVER_ERROR);
+		response.headers().set_content_length(data.size());
+
+		this->send_reply(std::move(response), std::move(data));
+	}
+
+private:
+	template <typename T>
+	static void compare(std::ostream& out, const char* name, const T& actual, const T& expected) {
+		if (!(actual == expected)) {
+			out << name << ": '" << actual << "' != '" << expected << "'\n";
+		}
+	}
+
+	static std::string join(const std::vector<std::string>& components) {
+		std::string result;
+		for (const auto& component: components) {
+			result += '[';
+			result += component;
+			result += ']';
+		}
+		return result;
+	}
+};
+
+} // namespace handlers
+
+REGISTER_HANDLER(url)
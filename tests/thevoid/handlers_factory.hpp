@@ -43,6 +43,10 @@ void init_handlers_##handler_name() { \
 		handlers::factory_t::mapped_type( \
 			new ioremap::thevoid::stream_factory<server, handlers::handler_name>(server_ptr.get()) \
 		); \
+	handlers::factory["pooled_" #handler_name] = \
+		handlers::factory_t::mapped_type( \
+			new ioremap::thevoid::pooled_stream_factory<server, handlers::handler_name>(server_ptr.get()) \
+		); \
 }
 
 #endif // IOREMAP_THEVOID_TESTS_HANDLERS_FACTORY_HPP
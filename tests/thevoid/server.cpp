@@ -50,6 +50,16 @@ public:
 			opts.set_methods(v);
 		}
 
+		const auto& host_exact = config["host_exact"];
+		if (!host_exact.IsNull()) {
+			opts.set_host_exact(host_exact.GetString());
+		}
+
+		const auto& host_suffix = config["host_suffix"];
+		if (!host_suffix.IsNull()) {
+			opts.set_host_suffix(host_suffix.GetString());
+		}
+
 		const auto& headers = config["headers"];
 		if (!headers.IsNull()) {
 			for (auto iter = headers.MemberBegin(), end = headers.MemberEnd();
@@ -0,0 +1,139 @@
+import json
+import os
+import tempfile
+import time
+
+import pytest
+import requests
+
+
+ACCESS_LOG_PATH = os.path.join(tempfile.gettempdir(), 'thevoid_test_access_log.json')
+
+
+@pytest.fixture
+def access_log_path(request):
+    '''Returns path of the access log file and removes it after the test.
+    '''
+    def remove():
+        if os.path.exists(ACCESS_LOG_PATH):
+            os.remove(ACCESS_LOG_PATH)
+
+    remove()
+    request.addfinalizer(remove)
+    return ACCESS_LOG_PATH
+
+
+def read_access_log(path, count, timeout=2):
+    '''Waits until access log contains at least `count` records and returns them.
+    '''
+    deadline = time.time() + timeout
+    records = []
+    while time.time() < deadline:
+        if os.path.exists(path):
+            with open(path) as f:
+                records = [json.loads(line) for line in f if line.strip()]
+            if len(records) >= count:
+                break
+        time.sleep(0.05)
+    return records
+
+
+@pytest.mark.server_options(
+    handlers=[
+        {
+            'handler': 'echo',
+            'exact_match': '/echo',
+        },
+    ],
+    access_log={
+        'format': 'json',
+        'path': ACCESS_LOG_PATH,
+        'flush_interval': 10,
+    },
+)
+def test_access_log_json(server, access_log_path):
+    '''Sends several requests and validates records of asynchronous json access log.
+
+    Args:
+        server: an instance of `Server`.
+        access_log_path: path of the access log file.
+    '''
+    for code in (200, 404, 503):
+        requests.post(url=server.request_url('/echo'), params={'code': code}, data='x' * 10)
+
+    records = read_access_log(access_log_path, 3)
+
+    # Records are collected by every worker thread separately, so their order is not preserved
+    assert sorted(record['status'] for record in records) == [200, 404, 503]
+    for record in records:
+        assert record['method'] == 'POST'
+        assert record['url'].startswith('/echo?code=')
+        assert record['received'] > 0
+        assert record['sent'] > 0
+        assert len(record['request_id']) == 16
+
+
+@pytest.mark.server_options(
+    handlers=[
+        {
+            'handler': 'echo',
+            'exact_match': '/echo',
+        },
+    ],
+    access_log={
+        'format': 'json',
+        'path': ACCESS_LOG_PATH,
+        'sample_rate': 0,
+        'flush_interval': 10,
+    },
+)
+def test_access_log_sampling(server, access_log_path):
+    '''Validates that requests which are not sampled are not logged but are accounted.
+
+    Args:
+        server: an instance of `Server`.
+        access_log_path: path of the access log file.
+    '''
+    for _ in range(5):
+        requests.post(url=server.request_url('/echo'))
+
+    response = requests.get('http://localhost:{port}/stats'.format(port=server.opts['monitor_port']))
+    access_log = response.json()['access_log']
+
+    assert access_log['sampled_out'] == 5
+    assert access_log['written'] == 0
+    assert read_access_log(access_log_path, 1, timeout=0.2) == []
+
+
+@pytest.mark.server_options(
+    handlers=[
+        {
+            'handler': 'echo',
+            'exact_match': '/echo',
+        },
+    ],
+    access_log={
+        'format': 'json',
+        'path': os.path.join(tempfile.gettempdir(), 'thevoid_test_missing_dir', 'access_log.json'),
+        'flush_interval': 10,
+    },
+)
+def test_access_log_failed_to_open(server):
+    '''Validates that records are accounted as dropped if the access log file can't be opened.
+
+    Args:
+        server: an instance of `Server`.
+    '''
+    for _ in range(3):
+        requests.post(url=server.request_url('/echo'))
+
+    deadline = time.time() + 2
+    while True:
+        response = requests.get('http://localhost:{port}/stats'.format(port=server.opts['monitor_port']))
+        access_log = response.json()['access_log']
+        if access_log['dropped'] >= 3 or time.time() > deadline:
+            break
+        time.sleep(0.05)
+
+    assert access_log['dropped'] == 3
+    assert access_log['written'] == 0
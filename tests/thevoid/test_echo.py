@@ -72,6 +72,40 @@ def test_echo_response_status_code(server, status_code):
     assert response.status_code == status_code
 
 
+@pytest.mark.server_options(
+    handlers=[
+        {
+            'handler': 'echo',
+            'exact_match': '/echo',
+        }
+    ]
+)
+@pytest.mark.parametrize(
+    'query,status_code',
+    [
+        ('code=404&code=200', 404),
+        ('codex=500&code=202', 202),
+        ('c=500&code=203', 203),
+        ('&'.join('key{0}={0}'.format(i) for i in range(20)) + '&code=204&code=500', 204),
+        ('code=%32%30%35', 205),
+    ],
+    ids=['repeated', 'longer key', 'shorter key', 'many items', 'encoded value'],
+)
+def test_echo_query_lookup(server, query, status_code):
+    '''Sends empty POST request to the echo handler with 'code' among other query parameters.
+
+    The first item with exactly matching key must be used.
+
+    Args:
+        server: an instance of `Server`.
+        query: raw request's query.
+        status_code: expected response's status code.
+    '''
+    response = requests.post(url=server.request_url('/echo') + '?' + query)
+
+    assert response.status_code == status_code
+
+
 @pytest.mark.server_options(
     handlers=[
         {'handler': 'echo',
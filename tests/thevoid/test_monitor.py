@@ -0,0 +1,171 @@
+import pytest
+import requests
+
+
+def monitor_url(server, path):
+    '''Returns full URL of the server's monitor port.
+
+    Args:
+        server: an instance of `Server`.
+        path: relative request's url.
+    '''
+    return 'http://localhost:{port}{path}'.format(
+        port=server.opts['monitor_port'],
+        path=path,
+    )
+
+
+def monitor_information(server):
+    '''Requests statistics information in JSON from the server's monitor port.
+
+    Args:
+        server: an instance of `Server`.
+
+    Returns:
+        Parsed JSON document.
+    '''
+    response = requests.get(monitor_url(server, '/stats'))
+    assert response.status_code == 200
+    assert response.headers['content-type'] == 'application/json'
+
+    return response.json()
+
+
+@pytest.mark.server_options(
+    handlers=[
+        {
+            'handler': 'echo',
+            'exact_match': '/echo',
+        },
+        {
+            'handler': 'ok',
+            'exact_match': '/ping',
+        },
+    ]
+)
+def test_monitor_handlers_statistics(server):
+    '''Sends several requests and validates per-handler counters reported by monitor.
+
+    Args:
+        server: an instance of `Server`.
+    '''
+    for code in (200, 200, 404, 503):
+        requests.post(url=server.request_url('/echo'), params={'code': code}, data='x' * 10)
+
+    information = monitor_information(server)
+    handlers = information['handlers']
+
+    assert [handler['name'] for handler in handlers] == ['/echo', '/ping']
+
+    echo, ping = handlers
+
+    assert echo['requests'] == 4
+    assert echo['status']['2xx'] == 2
+    assert echo['status']['4xx'] == 1
+    assert echo['status']['5xx'] == 1
+    assert echo['received'] > 0
+    assert echo['sent'] > 0
+
+    for name in ('total_time', 'first_byte_time', 'handler_time'):
+        latency = echo[name]
+        assert latency['count'] == 4
+        assert latency['p50'] <= latency['p99'] <= latency['max']
+
+    assert ping['requests'] == 0
+    assert ping['total_time']['count'] == 0
+
+
+@pytest.mark.server_options(
+    handlers=[
+        {
+            'handler': 'echo',
+            'exact_match': '/echo',
+        },
+    ]
+)
+def test_monitor_server_statistics(server):
+    '''Validates server and workers counters reported by monitor.
+
+    Args:
+        server: an instance of `Server`.
+    '''
+    requests.post(url=server.request_url('/echo'))
+
+    information = monitor_information(server)
+
+    assert 'connections' in information
+    assert 'active-connections' in information
+    assert information['application'] == {}
+
+    workers = information['workers']
+    assert len(workers) > 0
+    assert sum(worker['connections'] for worker in workers) >= 1
+    for worker in workers:
+        assert worker['loop_lag'] >= 0
+
+
+@pytest.mark.server_options(
+    handlers=[
+        {
+            'handler': 'echo',
+            'exact_match': '/echo',
+        },
+    ]
+)
+def test_monitor_prometheus_metrics(server):
+    '''Validates Prometheus text format reported by monitor.
+
+    Args:
+        server: an instance of `Server`.
+    '''
+    for code in (200, 500):
+        requests.post(url=server.request_url('/echo'), params={'code': code})
+
+    response = requests.get(monitor_url(server, '/metrics'))
+    assert response.status_code == 200
+    assert response.headers['content-type'].startswith('text/plain')
+
+    samples = {}
+    for line in response.text.splitlines():
+        if not line or line.startswith('#'):
+            continue
+        name, value = line.rsplit(' ', 1)
+        samples[name] = float(value)
+
+    assert samples['thevoid_handler_requests_total{handler="/echo"}'] == 2
+    assert samples['thevoid_handler_responses_total{handler="/echo",status="2xx"}'] == 1
+    assert samples['thevoid_handler_responses_total{handler="/echo",status="5xx"}'] == 1
+    assert samples['thevoid_handler_time_seconds_count{handler="/echo",phase="total"}'] == 2
+    assert samples['thevoid_handler_time_seconds_bucket{handler="/echo",phase="total",le="+Inf"}'] == 2
+
+    # Buckets are cumulative, their bounds are edges of the server's histogram buckets
+    prefix = 'thevoid_handler_time_seconds_bucket{handler="/echo",phase="total",le="'
+    buckets = sorted((float(name[len(prefix):-2]), value)
+                     for name, value in samples.items()
+                     if name.startswith(prefix) and not name.endswith('"+Inf"}'))
+    assert len(buckets) == 16
+    assert buckets[0][0] == 0.000103
+    assert all(first[1] <= second[1] for first, second in zip(buckets, buckets[1:]))
+    assert buckets[-1][1] <= 2
+
+
+@pytest.mark.parametrize(
+    'method,path,status_code',
+    [
+        ('GET', '/', 404),
+        ('GET', '/unknown', 404),
+        ('POST', '/stats', 405),
+        ('GET', '/stop', 405),
+    ],
+)
+def test_monitor_invalid_requests(server, method, path, status_code):
+    '''Validates monitor replies to unsupported requests.
+
+    Args:
+        server: an instance of `Server`.
+        method: request's method.
+        path: request's path.
+        status_code: expected response's status code.
+    '''
+    response = requests.request(method, monitor_url(server, path))
+    assert response.status_code == status_code
@@ -0,0 +1,48 @@
+import pytest
+import requests
+
+
+@pytest.mark.server_options(
+    threads=1,
+    handlers=[
+        {'handler': 'pooled_echo',
+         'exact_match': '/echo'}
+    ])
+def test_pooled_echo_keep_alive(server):
+    '''Sends several requests over single connection to the pooled echo handler.
+
+    Handler objects are reused between requests, so every response must contain
+    only data of it's own request.
+
+    Args:
+        server: an instance of `Server`.
+    '''
+    session = requests.Session()
+
+    for i, code in enumerate((200, 404, 200, 503)):
+        data = str(i).encode() * (i * 1024 + 1)
+        response = session.post(server.request_url('/echo'), params={'code': code}, data=data)
+
+        assert response.status_code == code
+        assert response.content == data
+
+
+@pytest.mark.server_options(
+    handlers=[
+        {'handler': 'pooled_simple_echo',
+         'exact_match': '/echo'}
+    ])
+def test_pooled_simple_request_stream(server):
+    '''Sends several requests to the pooled simple_request_stream based handler.
+
+    Request's body accumulated by the previous request must be cleared by reset().
+
+    Args:
+        server: an instance of `Server`.
+    '''
+    for size in (1024, 10, 0, 100):
+        data = b'x' * size
+        response = requests.post(server.request_url('/echo'), data=data)
+
+        assert response.status_code == requests.codes.ok
+        assert response.content == data
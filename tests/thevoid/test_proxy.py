@@ -0,0 +1,306 @@
+import pytest
+import requests
+import socket
+import threading
+import time
+
+from urllib import quote
+
+
+BODY_SIZE = 64 * 1024 * 1024
+CHUNK_SIZE = 1024 * 1024
+HIGH_WATER_MARK = 1024 * 1024
+
+
+@pytest.yield_fixture
+def upstream():
+    '''Starts HTTP server which sends BODY_SIZE bytes as fast as possible to the first client.
+
+    Yields:
+        upstream's url.
+    '''
+    listener = socket.socket(socket.AF_INET, socket.SOCK_STREAM, 0)
+    listener.bind(('localhost', 0))
+    listener.listen(1)
+
+    def serve():
+        connection, _ = listener.accept()
+        try:
+            request = b''
+            while b'\r\n\r\n' not in request:
+                request += connection.recv(4096)
+
+            connection.sendall(
+                b'HTTP/1.1 200 OK\r\n'
+                b'Content-Length: %d\r\n'
+                b'Connection: close\r\n\r\n' % BODY_SIZE)
+
+            chunk = b'x' * CHUNK_SIZE
+            for _ in range(BODY_SIZE // CHUNK_SIZE):
+                connection.sendall(chunk)
+        except socket.error:
+            pass
+        finally:
+            connection.close()
+
+    thread = threading.Thread(target=serve)
+    thread.daemon = True
+    thread.start()
+
+    yield 'http://localhost:{0}/'.format(listener.getsockname()[1])
+
+    listener.close()
+
+
+@pytest.yield_fixture
+def scripted_upstream():
+    '''Starts HTTP server which answers n-th connection by n-th of given replies.
+
+    Every connection is served by it's own thread and is closed after the reply.
+
+    Yields:
+        function which accepts list of (delay in seconds, status, extra headers) tuples,
+        headers may be omitted, and returns upstream's url and list of (status, request)
+        pairs sent so far.
+    '''
+    listener = socket.socket(socket.AF_INET, socket.SOCK_STREAM, 0)
+    listener.bind(('localhost', 0))
+    listener.listen(16)
+    sent = []
+
+    def respond(connection, delay, status, headers=b''):
+        try:
+            request = b''
+            while b'\r\n\r\n' not in request:
+                request += connection.recv(4096)
+
+            time.sleep(delay)
+            sent.append((status, request))
+            body = b'' if status == 304 else b'OK'
+            connection.sendall(
+                b'HTTP/1.1 %d Status\r\n'
+                b'%s'
+                b'Content-Length: %d\r\n'
+                b'Connection: close\r\n\r\n'
+                b'%s' % (status, headers, len(body), body))
+        except socket.error:
+            pass
+        finally:
+            connection.close()
+
+    def serve(replies):
+        for reply in replies:
+            try:
+                connection, _ = listener.accept()
+            except socket.error:
+                return
+            thread = threading.Thread(target=respond, args=(connection,) + reply)
+            thread.daemon = True
+            thread.start()
+
+    def start(replies):
+        thread = threading.Thread(target=serve, args=(replies,))
+        thread.daemon = True
+        thread.start()
+        return 'http://localhost:{0}/'.format(listener.getsockname()[1]), sent
+
+    yield start
+
+    listener.close()
+
+
+def proxy_url(server, upstream, **options):
+    options['url'] = quote(upstream, safe='')
+    query = '&'.join('{0}={1}'.format(key, value) for key, value in sorted(options.items()))
+    return 'http://localhost:{0}/proxy?{1}'.format(server.opts['port'], query)
+
+
+def resident_size(pid):
+    '''Returns resident set size of the process in bytes.
+    '''
+    with open('/proc/{0}/status'.format(pid)) as status:
+        for line in status:
+            if line.startswith('VmRSS:'):
+                return int(line.split()[1]) * 1024
+    return 0
+
+
+@pytest.mark.server_options(
+    handlers=[{'handler': 'proxy', 'exact_match': '/proxy'}]
+)
+@pytest.mark.parametrize('high_water_mark', [HIGH_WATER_MARK, 0])
+def test_proxy_to_throttled_reader(server, upstream, high_water_mark):
+    '''Proxies large upstream's reply to the client which reads it slowly.
+
+    With high water mark the url fetcher stops reading from upstream while the client
+    doesn't keep up, so server's memory doesn't depend on reply's size. Without it
+    the whole reply is accumulated by the server.
+
+    Args:
+        server: an instance of `Server`.
+        upstream: upstream's url.
+        high_water_mark: proxy stream's limit of not sent data, zero disables it.
+    '''
+    pid = server.process.proc.pid
+
+    client = socket.socket(socket.AF_INET, socket.SOCK_STREAM, 0)
+    client.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 64 * 1024)
+    client.connect(('localhost', server.opts['port']))
+    client.sendall(
+        b'GET /proxy?url={0}&high_water_mark={1} HTTP/1.1\r\n'
+        b'Host: localhost\r\n\r\n'.format(quote(upstream, safe=''), high_water_mark))
+
+    initial_size = resident_size(pid)
+    peak_size = initial_size
+
+    response = b''
+    while b'\r\n\r\n' not in response:
+        response += client.recv(4096)
+    headers, received = response.split(b'\r\n\r\n', 1)
+    received = len(received)
+
+    assert headers.startswith(b'HTTP/1.1 200')
+
+    while received < BODY_SIZE:
+        data = client.recv(CHUNK_SIZE)
+        if not data:
+            break
+        received += len(data)
+        peak_size = max(peak_size, resident_size(pid))
+        time.sleep(0.005)
+
+    client.close()
+
+    assert received == BODY_SIZE
+
+    growth = peak_size - initial_size
+    if high_water_mark:
+        assert growth < BODY_SIZE // 4, growth
+    else:
+        assert growth > BODY_SIZE // 2, growth
+
+
+@pytest.mark.server_options(
+    handlers=[{'handler': 'proxy', 'exact_match': '/proxy'}]
+)
+@pytest.mark.parametrize('max_retries, code', [(0, 503), (1, 503), (2, 200)])
+def test_retry_server_errors(server, scripted_upstream, max_retries, code):
+    '''Upstream fails twice by 503, so the request succeeds only if it's retried twice.
+
+    Args:
+        server: an instance of `Server`.
+        scripted_upstream: upstream's factory.
+        max_retries: number of the proxy request's retries.
+        code: expected status of the reply.
+    '''
+    upstream, sent = scripted_upstream([(0, 503), (0, 503), (0, 200)])
+
+    response = requests.get(proxy_url(server, upstream, max_retries=max_retries), timeout=10)
+
+    assert response.status_code == code
+    assert len(sent) == min(max_retries + 1, 3)
+
+
+@pytest.mark.server_options(
+    handlers=[{'handler': 'proxy', 'exact_match': '/proxy'}]
+)
+def test_hedged_request(server, scripted_upstream):
+    '''The first attempt is answered in 3 seconds, the hedged one is answered at once.
+
+    Args:
+        server: an instance of `Server`.
+        scripted_upstream: upstream's factory.
+    '''
+    upstream, sent = scripted_upstream([(3, 500), (0, 200)])
+
+    start = time.time()
+    response = requests.get(proxy_url(server, upstream, hedge_delay=100), timeout=10)
+
+    assert response.status_code == 200
+    assert time.time() - start < 2
+
+
+@pytest.mark.server_options(
+    handlers=[{'handler': 'proxy', 'exact_match': '/proxy'}]
+)
+def test_cache_fresh_reply(server, scripted_upstream):
+    '''Fresh reply is served from url fetcher's cache without request to upstream.
+
+    Args:
+        server: an instance of `Server`.
+        scripted_upstream: upstream's factory.
+    '''
+    upstream, sent = scripted_upstream([(0, 200, b'Cache-Control: max-age=60\r\n'), (0, 500)])
+
+    for _ in range(2):
+        response = requests.get(proxy_url(server, upstream), timeout=10)
+        assert response.status_code == 200
+        assert response.content == b'OK'
+
+    assert len(sent) == 1
+
+
+@pytest.mark.server_options(
+    handlers=[{'handler': 'proxy', 'exact_match': '/proxy'}]
+)
+def test_cache_simple_stream(server, scripted_upstream):
+    '''Cacheable reply is stored after simple_stream has taken the response by on_headers.
+
+    Args:
+        server: an instance of `Server`.
+        scripted_upstream: upstream's factory.
+    '''
+    upstream, sent = scripted_upstream([(0, 200, b'Cache-Control: max-age=60\r\n'), (0, 500)])
+
+    for _ in range(2):
+        response = requests.get(proxy_url(server, upstream, simple=1), timeout=10)
+        assert response.status_code == 200
+        assert response.content == b'OK'
+
+    assert len(sent) == 1
+
+
+@pytest.mark.server_options(
+    handlers=[{'handler': 'proxy', 'exact_match': '/proxy'}]
+)
+def test_cache_revalidation(server, scripted_upstream):
+    '''Stale reply is revalidated by ETag, Not Modified reply is passed as the cached one.
+
+    Args:
+        server: an instance of `Server`.
+        scripted_upstream: upstream's factory.
+    '''
+    headers = b'Cache-Control: no-cache\r\nETag: "v1"\r\n'
+    upstream, sent = scripted_upstream([(0, 200, headers), (0, 304, headers)])
+
+    for _ in range(2):
+        response = requests.get(proxy_url(server, upstream), timeout=10)
+        assert response.status_code == 200
+        assert response.content == b'OK'
+
+    assert len(sent) == 2
+    assert b'If-None-Match: "v1"' in sent[1][1]
+
+
+@pytest.mark.server_options(
+    handlers=[{'handler': 'proxy', 'exact_match': '/proxy'}]
+)
+@pytest.mark.parametrize('option', ['first_byte_timeout', 'deadline'])
+def test_slow_upstream_timeout(server, scripted_upstream, option):
+    '''Upstream replies in 3 seconds, so the request is aborted by 200 ms limit.
+
+    Args:
+        server: an instance of `Server`.
+        scripted_upstream: upstream's factory.
+        option: name of the limit.
+    '''
+    upstream, sent = scripted_upstream([(3, 200)])
+
+    start = time.time()
+    try:
+        response = requests.get(proxy_url(server, upstream, **{option: 200}), timeout=10)
+        assert response.status_code != 200
+    except requests.exceptions.ConnectionError:
+        pass
+
+    assert time.time() - start < 2
@@ -0,0 +1,119 @@
+import pytest
+import requests
+
+
+# Handlers are told apart by their replies to POST with body 'x' and query 'code=201':
+# echo replies with the code and the body, simple_echo with 200 and the body,
+# ok with 200 and empty body.
+ECHO = (201, b'x')
+SIMPLE_ECHO = (200, b'x')
+OK = (200, b'')
+
+
+@pytest.mark.server_options(
+    handlers=[
+        {
+            'handler': 'echo',
+            'regex_match': '/items/[0-9]+',
+            'methods': ['PUT'],
+        },
+        {
+            'handler': 'simple_echo',
+            'regex_match': '/items/.*',
+            'host_exact': 'api.example.com',
+        },
+        {
+            'handler': 'ok',
+            'regex_match': '/items/.*',
+        },
+        {
+            'handler': 'simple_echo',
+            'regex_match': '/(items|other)/[a-z]+',
+            'methods': ['DELETE'],
+        },
+    ]
+)
+@pytest.mark.parametrize(
+    'method, path, host, expected',
+    [
+        # The first matching registration wins over later ones matching too
+        ('PUT', '/items/1', None, ECHO),
+        # Method condition of the first one fails, host condition of the second one passes
+        ('POST', '/items/1', 'api.example.com', SIMPLE_ECHO),
+        ('POST', '/items/1', 'api.example.com:8080', SIMPLE_ECHO),
+        # Both method and host conditions fail, the third one matches everything
+        ('POST', '/items/1', None, OK),
+        ('POST', '/items/1', 'www.example.com', OK),
+        # Regex of the first one doesn't match despite matching method
+        ('PUT', '/items/abc', None, OK),
+        ('PUT', '/items/abc', 'api.example.com', SIMPLE_ECHO),
+        # Regex must match the whole path
+        ('PUT', '/items/1/2', None, OK),
+        ('DELETE', '/other/abc', None, SIMPLE_ECHO),
+        ('POST', '/other/abc', None, None),
+        ('POST', '/missing', None, None),
+    ]
+)
+def test_regex_handlers_order(server, method, path, host, expected):
+    '''Sends requests matched by several regex handlers and validates which one replies.
+
+    Handler registered first among ones whose regex and other conditions match the request
+    must process it, handlers rejected by method or host fall through to the next ones.
+
+    Args:
+        server: an instance of `Server`.
+        method: method of the request.
+        path: path of the request.
+        host: Host header of the request or None for the server's address.
+        expected: code and body of the expected handler or None if none matches.
+    '''
+    headers = {'Host': host} if host else {}
+    response = requests.request(method, server.request_url(path), params={'code': 201},
+                                data='x', headers=headers)
+
+    if expected is None:
+        assert response.status_code == requests.codes.not_found
+    else:
+        assert (response.status_code, response.content) == expected
+
+
+@pytest.mark.server_options(
+    handlers=[
+        {
+            'handler': 'ok',
+            'regex_match': '/other/([a-z]+)',
+        },
+        {
+            'handler': 'echo',
+            'regex_match': '/cond/(x)?(?(1)y|z)',
+        },
+    ]
+)
+@pytest.mark.parametrize(
+    'path, expected',
+    [
+        ('/other/abc', OK),
+        # Condition refers to the handler's own group, not to the one of the combined regex
+        ('/cond/xy', ECHO),
+        ('/cond/z', ECHO),
+        ('/cond/xz', None),
+        ('/cond/y', None),
+    ]
+)
+def test_regex_handler_with_conditional_group(server, path, expected):
+    '''Sends requests to a regex handler whose pattern has a conditional group.
+
+    Such pattern can't be a part of the combined regex, as it's groups are renumbered there,
+    so it must be checked separately and still match the same paths.
+
+    Args:
+        server: an instance of `Server`.
+        path: path of the request.
+        expected: code and body of the expected handler or None if none matches.
+    '''
+    response = requests.post(server.request_url(path), params={'code': 201}, data='x')
+
+    if expected is None:
+        assert response.status_code == requests.codes.not_found
+    else:
+        assert (response.status_code, response.content) == expected
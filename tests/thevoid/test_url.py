@@ -0,0 +1,85 @@
+import pytest
+import requests
+
+from tornado.httputil import (
+    HTTPHeaders,
+    RequestStartLine,
+    HTTPMessageDelegate
+)
+from tornado.http1connection import HTTP1Connection
+
+
+class ResponseHandler(HTTPMessageDelegate):
+    '''Collects response's start line and body.
+    '''
+    def __init__(self):
+        super(ResponseHandler, self).__init__()
+
+        self.start_line = None
+        self.body = b''
+
+    def headers_received(self, start_line, headers):
+        self.start_line = start_line
+
+    def data_received(self, chunk):
+        self.body += chunk
+
+
+@pytest.mark.server_options(
+    handlers=[{'handler': 'url', 'prefix_match': '/'}]
+)
+@pytest.mark.parametrize(
+    'target',
+    [
+        '/',
+        '/a',
+        '/a/',
+        '/a//b',
+        '/a/b?x=1&y=2',
+        '/?',
+        '/a?',
+        '/a?x=/y?z',
+        '/a%20b',
+        '/a%2Fb',
+        '/a%2fb',
+        '/%41%42',
+        '/%7e/',
+        '/a/./b',
+        '/a/../b',
+        '/a/b/..',
+        '/a?b=%2a',
+        '/a?b=%2A&c=%41',
+        '/a:b@c;d=e,f',
+        "/!$&'()*+",
+        '/a#fragment',
+        '/a?b#fragment',
+        '/~user/index.html?q=a+b',
+        '/%00x',
+        '/a%0D%0Ab',
+        '/%D0%BF%D1%83%D1%82%D1%8C?%D0%BA=%D0%B7',
+    ],
+)
+@pytest.mark.async_test
+def test_request_target_parsing(server, io_stream, target):
+    '''Validates that request target parsed by the fast path is equal to one parsed by uriparser.
+
+    The url handler compares request's url with the same url parsed by uriparser and
+    responds with 500 and the difference if they are not equal.
+
+    Args:
+        server: an instance of `Server`.
+        io_stream: an instance of `tornado.iostream.IOStream`.
+        target: request's target.
+    '''
+    yield io_stream.connect(('localhost', server.opts['port']))
+
+    connection = HTTP1Connection(io_stream, is_client=True)
+    start_line = RequestStartLine(method='GET', path=target, version='HTTP/1.1')
+    yield connection.write_headers(start_line, HTTPHeaders())
+    connection.finish()
+
+    response = ResponseHandler()
+    yield connection.read_response(response)
+
+    # invalid urls are rejected by the server itself
+    assert response.start_line.code in (requests.codes.ok, requests.codes.bad_request), response.body
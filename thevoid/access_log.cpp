@@ -0,0 +1,499 @@
+/*
+ * Copyright 2015+ Ruslan Nigmatullin <euroelessar@yandex.ru>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "access_log_p.hpp"
+#include "statistics_p.hpp"
+
+#include "rapidjson/writer.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+
+#ifdef __linux__
+# include <sys/prctl.h>
+#endif
+
+namespace ioremap {
+namespace thevoid {
+
+static const char access_log_magic[8] = { 'T', 'V', 'A', 'C', 'L', 'O', 'G', '\0' };
+
+bool access_log_record::set_string(char *field, size_t size, const std::string &value)
+{
+	const size_t length = std::min(size - 1, value.size());
+	memcpy(field, value.c_str(), length);
+	memset(field + length, 0, size - length);
+	return length == value.size();
+}
+
+access_log_file_header access_log_file_header::create()
+{
+	access_log_file_header header;
+	memcpy(header.magic, access_log_magic, sizeof(header.magic));
+	header.version = current_version;
+	header.record_size = sizeof(access_log_record);
+	return header;
+}
+
+bool access_log_file_header::is_valid() const
+{
+	return memcmp(magic, access_log_magic, sizeof(magic)) == 0
+		&& version == current_version
+		&& record_size == sizeof(access_log_record);
+}
+
+static void format_timestamp(uint64_t timestamp, std::string &output)
+{
+	const time_t seconds = timestamp / 1000000;
+	struct tm time;
+	localtime_r(&seconds, &time);
+
+	char buffer[64];
+	size_t size = strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", &time);
+	size += snprintf(buffer + size, sizeof(buffer) - size, ".%06llu",
+		static_cast<unsigned long long>(timestamp % 1000000));
+	output.append(buffer, size);
+}
+
+static const char *string_or_dash(const char *value)
+{
+	return *value ? value : "-";
+}
+
+void format_access_log_text(const access_log_record &record, std::string &output)
+{
+	format_timestamp(record.timestamp, output);
+
+	char buffer[1024];
+	const int size = snprintf(buffer, sizeof(buffer),
+		" access_log_entry: request_id: %016llx, method: %s, url: %s%s, local: %s, remote: %s, status: %d, "
+		"received: %llu, sent: %llu, time: %llu us, "
+		"receive_time: %llu us, send_time: %llu us, starttransfer_time: %llu us\n",
+		static_cast<unsigned long long>(record.request_id),
+		string_or_dash(record.method),
+		string_or_dash(record.url),
+		(record.flags & access_log_record::url_truncated) ? "..." : "",
+		record.local,
+		record.remote,
+		record.status,
+		static_cast<unsigned long long>(record.received),
+		static_cast<unsigned long long>(record.sent),
+		static_cast<unsigned long long>(record.total_time),
+		static_cast<unsigned long long>(record.receive_time),
+		static_cast<unsigned long long>(record.send_time),
+		static_cast<unsigned long long>(record.starttransfer_time));
+
+	output.append(buffer, std::min<size_t>(std::max(size, 0), sizeof(buffer) - 1));
+}
+
+struct access_log_output
+{
+	typedef char Ch;
+
+	void Put(char ch)
+	{
+		data->push_back(ch);
+	}
+
+	std::string *data;
+};
+
+void format_access_log_json(const access_log_record &record, std::string &output)
+{
+	char request_id[17];
+	snprintf(request_id, sizeof(request_id), "%016llx", static_cast<unsigned long long>(record.request_id));
+
+	access_log_output stream = { &output };
+	rapidjson::Writer<access_log_output> writer(stream);
+
+	writer.StartObject();
+	writer.String("timestamp");
+	writer.Uint64(record.timestamp);
+	writer.String("request_id");
+	writer.String(request_id);
+	writer.String("method");
+	writer.String(record.method);
+	writer.String("url");
+	writer.String(record.url);
+	writer.String("url_truncated");
+	writer.Bool(record.flags & access_log_record::url_truncated);
+	writer.String("trace_bit");
+	writer.Bool(record.flags & access_log_record::trace_bit);
+	writer.String("local");
+	writer.String(record.local);
+	writer.String("remote");
+	writer.String(record.remote);
+	writer.String("status");
+	writer.Int(record.status);
+	writer.String("received");
+	writer.Uint64(record.received);
+	writer.String("sent");
+	writer.Uint64(record.sent);
+	writer.String("time");
+	writer.Uint64(record.total_time);
+	writer.String("receive_time");
+	writer.Uint64(record.receive_time);
+	writer.String("send_time");
+	writer.Uint64(record.send_time);
+	writer.String("starttransfer_time");
+	writer.Uint64(record.starttransfer_time);
+	writer.EndObject();
+
+	output.push_back('\n');
+}
+
+static size_t round_up_to_power_of_two(size_t value)
+{
+	size_t result = 1;
+	while (result < value)
+		result <<= 1;
+	return result;
+}
+
+access_log_ring::access_log_ring(size_t capacity) :
+	m_records(round_up_to_power_of_two(std::max<size_t>(capacity, 2))),
+	m_mask(m_records.size() - 1),
+	m_tail(0),
+	m_head(0),
+	m_dropped(0)
+{
+}
+
+bool access_log_ring::push(const access_log_record &record)
+{
+	const size_t tail = m_tail.load(std::memory_order_relaxed);
+	const size_t head = m_head.load(std::memory_order_acquire);
+
+	if (tail - head > m_mask) {
+		m_dropped.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	m_records[tail & m_mask] = record;
+	m_tail.store(tail + 1, std::memory_order_release);
+	return true;
+}
+
+bool access_log_ring::pop(access_log_record &record)
+{
+	const size_t head = m_head.load(std::memory_order_relaxed);
+	const size_t tail = m_tail.load(std::memory_order_acquire);
+
+	if (head == tail)
+		return false;
+
+	record = m_records[head & m_mask];
+	m_head.store(head + 1, std::memory_order_release);
+	return true;
+}
+
+uint64_t access_log_ring::dropped() const
+{
+	return m_dropped.load(std::memory_order_relaxed);
+}
+
+async_access_log::async_access_log(const swarm::logger &logger) :
+	m_logger(logger, blackhole::log::attributes_t()),
+	m_enabled(false),
+	m_format(format_text),
+	m_sample_threshold(uint64_t(1) << 32),
+	m_flush_interval(100),
+	m_file(NULL),
+	m_written(0),
+	m_dropped(0),
+	m_sampled_out(0),
+	m_reported_dropped(0),
+	m_reopen(false),
+	m_need_stop(false)
+{
+}
+
+async_access_log::~async_access_log()
+{
+	stop();
+}
+
+bool async_access_log::configure(const rapidjson::Value &config, size_t workers_count, std::string &error)
+{
+	if (!config.IsObject()) {
+		error = "\"access_log\" field is not an object";
+		return false;
+	}
+
+	if (config.HasMember("format")) {
+		const std::string format = config["format"].GetString();
+		if (format == "text") {
+			m_format = format_text;
+		} else if (format == "json") {
+			m_format = format_json;
+		} else if (format == "binary") {
+			m_format = format_binary;
+		} else {
+			error = "\"access_log.format\" must be one of: text, json, binary";
+			return false;
+		}
+	}
+
+	if (config.HasMember("path")) {
+		m_path = config["path"].GetString();
+	}
+
+	if (m_format == format_binary && m_path.empty()) {
+		error = "\"access_log.path\" is required for binary format";
+		return false;
+	}
+
+	if (config.HasMember("sample_rate")) {
+		const double rate = config["sample_rate"].GetDouble();
+		if (rate < 0 || rate > 1) {
+			error = "\"access_log.sample_rate\" must be in [0, 1] range";
+			return false;
+		}
+		m_sample_threshold = static_cast<uint64_t>(rate * (uint64_t(1) << 32));
+	}
+
+	size_t buffer_size = 4096;
+	if (config.HasMember("buffer_size")) {
+		buffer_size = config["buffer_size"].GetUint();
+	}
+
+	if (config.HasMember("flush_interval")) {
+		m_flush_interval = std::chrono::milliseconds(config["flush_interval"].GetUint());
+	}
+
+	// The first ring is shared by all non-worker threads
+	m_rings.clear();
+	for (size_t i = 0; i < workers_count + 1; ++i) {
+		m_rings.emplace_back(new access_log_ring(buffer_size));
+	}
+
+	m_enabled = true;
+	return true;
+}
+
+bool async_access_log::enabled() const
+{
+	return m_enabled;
+}
+
+bool async_access_log::sampled(uint64_t request_id)
+{
+	// Request ids are either random or are provided by the client, so they
+	// are mixed to get uniform distribution for any source
+	const uint64_t hash = (request_id * 0x9E3779B97F4A7C15ull) >> 32;
+
+	if (hash < m_sample_threshold)
+		return true;
+
+	m_sampled_out.fetch_add(1, std::memory_order_relaxed);
+	return false;
+}
+
+void async_access_log::push(const access_log_record &record)
+{
+	const size_t shard = route_statistics::thread_shard();
+
+	if (shard == 0 || shard >= m_rings.size()) {
+		std::lock_guard<std::mutex> lock(m_foreign_mutex);
+		m_rings[0]->push(record);
+	} else {
+		m_rings[shard]->push(record);
+	}
+}
+
+void async_access_log::start()
+{
+	if (!m_enabled || m_thread)
+		return;
+
+	open_file();
+
+	m_need_stop = false;
+	m_thread.reset(new boost::thread(std::bind(&async_access_log::run, this)));
+}
+
+void async_access_log::stop()
+{
+	if (!m_thread)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_need_stop = true;
+	}
+	m_condition.notify_all();
+
+	m_thread->join();
+	m_thread.reset();
+
+	close_file();
+}
+
+void async_access_log::reopen()
+{
+	m_reopen = true;
+}
+
+uint64_t async_access_log::written() const
+{
+	return m_written.load(std::memory_order_relaxed);
+}
+
+uint64_t async_access_log::dropped() const
+{
+	uint64_t result = m_dropped.load(std::memory_order_relaxed);
+	for (auto it = m_rings.begin(); it != m_rings.end(); ++it)
+		result += (*it)->dropped();
+	return result;
+}
+
+uint64_t async_access_log::sampled_out() const
+{
+	return m_sampled_out.load(std::memory_order_relaxed);
+}
+
+void async_access_log::run()
+{
+#ifdef __linux__
+	prctl(PR_SET_NAME, "void_access_log");
+#endif
+
+	std::string output;
+	bool need_stop = false;
+
+	while (!need_stop) {
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_condition.wait_for(lock, m_flush_interval, [this] { return m_need_stop; });
+			need_stop = m_need_stop;
+		}
+
+		if (m_reopen.exchange(false)) {
+			close_file();
+			open_file();
+		}
+
+		// Records are formatted in batches, so the file is written by large chunks
+		while (drain(output) > 0) {
+			flush(output);
+		}
+		flush(output);
+
+		const uint64_t dropped = this->dropped();
+		if (dropped != m_reported_dropped) {
+			BH_LOG(m_logger, SWARM_LOG_WARNING, "access log: %llu records were dropped, %llu in total",
+				static_cast<unsigned long long>(dropped - m_reported_dropped),
+				static_cast<unsigned long long>(dropped));
+			m_reported_dropped = dropped;
+		}
+	}
+}
+
+bool async_access_log::open_file()
+{
+	if (m_path.empty())
+		return true;
+
+	m_file = fopen(m_path.c_str(), "ab");
+	if (!m_file) {
+		BH_LOG(m_logger, SWARM_LOG_ERROR, "failed to open access log \"%s\": %s",
+			m_path.c_str(), strerror(errno));
+		return false;
+	}
+
+	if (m_format == format_binary && ftell(m_file) == 0) {
+		const access_log_file_header header = access_log_file_header::create();
+		fwrite(&header, sizeof(header), 1, m_file);
+	}
+
+	return true;
+}
+
+void async_access_log::close_file()
+{
+	if (m_file) {
+		fclose(m_file);
+		m_file = NULL;
+	}
+}
+
+size_t async_access_log::drain(std::string &output)
+{
+	enum {
+		batch_size = 256
+	};
+
+	access_log_record record;
+	size_t count = 0;
+
+	// File failed to open, records are taken out of the rings and accounted as dropped
+	if (!m_path.empty() && !m_file) {
+		for (auto it = m_rings.begin(); it != m_rings.end(); ++it) {
+			for (size_t i = 0; i < batch_size && (*it)->pop(record); ++i, ++count) {
+			}
+		}
+
+		m_dropped.fetch_add(count, std::memory_order_relaxed);
+		return count;
+	}
+
+	for (auto it = m_rings.begin(); it != m_rings.end(); ++it) {
+		for (size_t i = 0; i < batch_size && (*it)->pop(record); ++i, ++count) {
+			switch (m_format) {
+			case format_text:
+				format_access_log_text(record, output);
+				break;
+			case format_json:
+				format_access_log_json(record, output);
+				break;
+			case format_binary:
+				output.append(reinterpret_cast<const char *>(&record), sizeof(record));
+				break;
+			}
+		}
+	}
+
+	m_written.fetch_add(count, std::memory_order_relaxed);
+	return count;
+}
+
+void async_access_log::flush(std::string &output)
+{
+	if (output.empty())
+		return;
+
+	if (m_file) {
+		fwrite(output.data(), 1, output.size(), m_file);
+		fflush(m_file);
+	} else if (m_path.empty()) {
+		// Lines are logged one by one without trailing new line
+		size_t begin = 0;
+		while (begin < output.size()) {
+			size_t end = output.find('\n', begin);
+			if (end == std::string::npos)
+				end = output.size();
+
+			BH_LOG(m_logger, SWARM_LOG_INFO, "%s", output.substr(begin, end - begin).c_str());
+			begin = end + 1;
+		}
+	}
+
+	output.clear();
+}
+
+} } // namespace ioremap::thevoid
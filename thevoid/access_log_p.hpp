@@ -0,0 +1,238 @@
+/*
+ * Copyright 2015+ Ruslan Nigmatullin <euroelessar@yandex.ru>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef IOREMAP_THEVOID_ACCESS_LOG_P_HPP
+#define IOREMAP_THEVOID_ACCESS_LOG_P_HPP
+
+#include <swarm/logger.hpp>
+#include <blackhole/utils/atomic.hpp>
+
+#include <boost/thread.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "rapidjson/document.h"
+
+namespace ioremap {
+namespace thevoid {
+
+/*!
+ * \internal
+ *
+ * \brief The access_log_record struct is a fixed-size binary access log entry.
+ *
+ * Strings are truncated to the size of their fields and are always zero-terminated.
+ * The same layout is used as on-disk format of the binary access log.
+ */
+struct access_log_record
+{
+	enum {
+		method_size = 16,
+		url_size = 256,
+		endpoint_size = 64
+	};
+
+	enum flags_type : uint32_t {
+		//! Url is longer than url_size - 1 and was truncated
+		url_truncated = 0x01,
+		trace_bit = 0x02
+	};
+
+	//! Wall clock time of the request's start in microseconds since Epoch
+	uint64_t timestamp;
+	uint64_t request_id;
+	uint64_t received;
+	uint64_t sent;
+	//! All times are in microseconds
+	uint64_t total_time;
+	uint64_t receive_time;
+	uint64_t send_time;
+	uint64_t starttransfer_time;
+	int32_t status;
+	uint32_t flags;
+	char method[method_size];
+	char url[url_size];
+	char local[endpoint_size];
+	char remote[endpoint_size];
+
+	/*!
+	 * \brief Copies \a value to \a field of \a size bytes, returns false if it was truncated.
+	 */
+	static bool set_string(char *field, size_t size, const std::string &value);
+};
+
+/*!
+ * \internal
+ *
+ * \brief The access_log_file_header struct is written at the start of binary access log.
+ */
+struct access_log_file_header
+{
+	enum {
+		current_version = 1
+	};
+
+	char magic[8];
+	uint32_t version;
+	uint32_t record_size;
+
+	static access_log_file_header create();
+	bool is_valid() const;
+};
+
+/*!
+ * \internal
+ *
+ * \brief Appends human-readable line of \a record to \a output.
+ */
+void format_access_log_text(const access_log_record &record, std::string &output);
+
+/*!
+ * \internal
+ *
+ * \brief Appends single-line JSON representation of \a record to \a output.
+ */
+void format_access_log_json(const access_log_record &record, std::string &output);
+
+/*!
+ * \internal
+ *
+ * \brief The access_log_ring class is a bounded single-producer single-consumer queue.
+ *
+ * If the queue is full new records are dropped and accounted, producer is never blocked.
+ */
+class access_log_ring
+{
+public:
+	explicit access_log_ring(size_t capacity);
+
+	bool push(const access_log_record &record);
+	bool pop(access_log_record &record);
+
+	uint64_t dropped() const;
+
+private:
+	std::vector<access_log_record> m_records;
+	size_t m_mask;
+	// Producer and consumer positions are kept on different cache lines
+	std::atomic<size_t> m_tail;
+	char m_tail_padding[64 - sizeof(std::atomic<size_t>)];
+	std::atomic<size_t> m_head;
+	char m_head_padding[64 - sizeof(std::atomic<size_t>)];
+	std::atomic<uint64_t> m_dropped;
+};
+
+/*!
+ * \internal
+ *
+ * \brief The async_access_log class writes access log from the background thread.
+ *
+ * Every worker thread pushes records into it's own ring, records from all other threads
+ * are pushed to the shared one under the mutex. Background thread drains all rings,
+ * formats records and writes them either to the file or, for text and json formats
+ * without file, to the server's logger.
+ *
+ * Configuration:
+ * \code{.json}
+ * "access_log": {
+ *     "format": "text",        // text, json or binary
+ *     "path": "/var/log/access.log",
+ *     "sample_rate": 1.0,      // part of requests to log, decision is made by request id
+ *     "buffer_size": 4096,     // number of records in the ring of every worker
+ *     "flush_interval": 100    // milliseconds
+ * }
+ * \endcode
+ */
+class async_access_log
+{
+public:
+	enum format_type {
+		format_text,
+		format_json,
+		format_binary
+	};
+
+	async_access_log(const swarm::logger &logger);
+	~async_access_log();
+
+	/*!
+	 * \brief Reads configuration, returns false and sets \a error if it's invalid.
+	 */
+	bool configure(const rapidjson::Value &config, size_t workers_count, std::string &error);
+
+	bool enabled() const;
+
+	/*!
+	 * \brief Returns true if request with \a request_id must be logged.
+	 */
+	bool sampled(uint64_t request_id);
+
+	/*!
+	 * \brief Enqueues \a record, it's safe to call it from any thread.
+	 */
+	void push(const access_log_record &record);
+
+	void start();
+	void stop();
+	/*!
+	 * \brief Asks background thread to reopen the file, i.e. after log rotation.
+	 */
+	void reopen();
+
+	uint64_t written() const;
+	uint64_t dropped() const;
+	uint64_t sampled_out() const;
+
+private:
+	void run();
+	bool open_file();
+	void close_file();
+	size_t drain(std::string &output);
+	void flush(std::string &output);
+
+	swarm::logger m_logger;
+	bool m_enabled;
+	format_type m_format;
+	std::string m_path;
+	uint64_t m_sample_threshold;
+	std::chrono::milliseconds m_flush_interval;
+
+	std::vector<std::unique_ptr<access_log_ring>> m_rings;
+	std::mutex m_foreign_mutex;
+
+	FILE *m_file;
+	std::atomic<uint64_t> m_written;
+	// Records drained while the file is not open
+	std::atomic<uint64_t> m_dropped;
+	std::atomic<uint64_t> m_sampled_out;
+	uint64_t m_reported_dropped;
+
+	std::atomic_bool m_reopen;
+	bool m_need_stop;
+	std::mutex m_mutex;
+	std::condition_variable m_condition;
+	std::unique_ptr<boost::thread> m_thread;
+};
+
+} } // namespace ioremap::thevoid
+
+#endif // IOREMAP_THEVOID_ACCESS_LOG_P_HPP
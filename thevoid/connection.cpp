@@ -19,6 +19,7 @@
 #include <boost/bind.hpp>
 #include <iostream>
 #include <algorithm>
+#include <strings.h>
 
 #include "server_p.hpp"
 #include "stream_p.hpp"
@@ -81,6 +82,35 @@ struct timespec gettime_now() {
 	return now;
 }
 
+/*
+ * Generates request ids by xorshift64* generator.
+ *
+ * State is per thread, so there is no contention between workers unlike std::rand.
+ * It's seeded on the first call by current time and the address of thread's state.
+ */
+uint64_t generate_request_id() {
+	static __thread uint64_t state = 0;
+
+	if (__builtin_expect(state == 0, false)) {
+		struct timeval now;
+		gettimeofday(&now, NULL);
+
+		// splitmix64 finalizer spreads the seed's entropy over all bits
+		uint64_t seed = (uint64_t(now.tv_sec) * USECS_IN_SEC + now.tv_usec) ^ reinterpret_cast<uintptr_t>(&state);
+		seed = (seed ^ (seed >> 30)) * 0xbf58476d1ce4e5b9ull;
+		seed = (seed ^ (seed >> 27)) * 0x94d049bb133111ebull;
+		seed ^= seed >> 31;
+
+		state = seed ? seed : 0x9e3779b97f4a7c15ull;
+	}
+
+	state ^= state >> 12;
+	state ^= state << 25;
+	state ^= state >> 27;
+
+	return state * 0x2545f4914f6cdd1dull;
+}
+
 } // unnamed namespace
 
 
@@ -133,7 +163,21 @@ OutputIterator escape(
 	return output;
 }
 
-std::string headers_to_string(
+// Returns value of the first header named \a name without copying it
+const std::string* find_header(const ioremap::swarm::http_headers& headers, const std::string& name)
+{
+	for (const auto& entry: headers.all()) {
+		if (entry.first.size() == name.size() && strncasecmp(entry.first.c_str(), name.c_str(), name.size()) == 0) {
+			return &entry.second;
+		}
+	}
+
+	return NULL;
+}
+
+// Replaces content of \a headers_string and returns it, so it's memory is reused between requests
+const std::string& headers_to_string(
+		std::string& headers_string,
 		const ioremap::swarm::http_headers& headers,
 		const std::vector<std::string>& log_headers,
 		int quote = '"'
@@ -141,15 +185,15 @@ std::string headers_to_string(
 {
 	typedef std::back_insert_iterator<std::string> output_type;
 
-	std::string headers_string;
+	headers_string.clear();
 	output_type output(headers_string);
 
 	output++ = '{';
 
 	bool first_header = true;
 	for (const auto& log_header: log_headers) {
-		if (headers.has(log_header)) {
-			std::string header_value = *headers.get(log_header);
+		if (const std::string* header_value_ptr = find_header(headers, log_header)) {
+			const std::string& header_value = *header_value_ptr;
 
 			if (!first_header) {
 				output++ = ','; output++ = ' ';
@@ -178,7 +222,7 @@ namespace ioremap {
 namespace thevoid {
 
 #define CONNECTION_LOG(log_level, ...) \
-	BH_LOG(m_logger, (log_level), __VA_ARGS__)
+	BH_LOG(logger_for(log_level), (log_level), __VA_ARGS__)
 
 #define CONNECTION_DEBUG(...) \
 	CONNECTION_LOG(SWARM_LOG_DEBUG, __VA_ARGS__)
@@ -243,11 +287,13 @@ connection<T>::connection(base_server *server, boost::asio::io_service &service,
 	m_server(server),
 	m_base_logger(m_server->logger(), make_attributes(this)),
 	m_logger(m_base_logger, blackhole::log::attributes_t()),
+	m_logger_outdated(false),
 	m_socket(service),
 	m_buffer(buffer_size),
 	m_content_length(0),
 	m_access_log_printed(false),
 	m_close_invoked(false),
+	m_handler_index(server_data::no_handler),
 	m_state(read_headers | waiting_for_first_data),
 	m_sending(false),
 	m_keep_alive(false),
@@ -258,13 +304,18 @@ connection<T>::connection(base_server *server, boost::asio::io_service &service,
 	m_pause_receive(false),
 	m_receive_time{0, 0},
 	m_send_time{0, 0},
-	m_starttransfer_time{0, 0}
+	m_starttransfer_time{0, 0},
+	m_request_start{0, 0},
+	m_first_byte_time{0, 0},
+	m_handler_time{0, 0}
 {
 	m_unprocessed_begin = m_buffer.data();
 	m_unprocessed_end = m_buffer.data();
 	m_access_start.tv_sec = 0;
 	m_access_start.tv_usec = 0;
 	m_access_status = 0;
+	m_access_request_id = 0;
+	m_access_trace_bit = false;
 	m_access_received = 0;
 	m_access_sent = 0;
 	m_request_processing_was_finished = false;
@@ -330,6 +381,8 @@ void connection<T>::send_headers(http_response &&rep,
 	std::function<void (const boost::system::error_code &err)> &&handler)
 {
 	m_access_status = rep.code();
+	if (m_first_byte_time.tv_sec == 0 && m_first_byte_time.tv_nsec == 0)
+		m_first_byte_time = gettime_now() - m_request_start;
 
 	if (!m_keep_alive) {
 		// if connection cannot be reused, send "Connection: Close"
@@ -395,13 +448,27 @@ void connection<T>::initialize(base_request_stream_data *data)
 template <typename T>
 swarm::logger connection<T>::create_logger()
 {
-	return swarm::logger(m_logger, blackhole::log::attributes_t());
+	return swarm::logger(m_base_logger, m_attributes);
+}
+
+template <typename T>
+swarm::logger &connection<T>::logger_for(swarm::log_level level)
+{
+	// Request's attributes are bound to the logger only if the record is going to be written
+	if (m_logger_outdated && (level >= m_server->m_data->base_logger.verbosity() || m_access_trace_bit)) {
+		m_logger = swarm::logger(m_base_logger, m_attributes);
+		m_logger_outdated = false;
+	}
+
+	return m_logger;
 }
 
 template <typename T>
 void connection<T>::close(const boost::system::error_code &err)
 {
 	m_close_invoked = true;
+	if (m_handler_time.tv_sec == 0 && m_handler_time.tv_nsec == 0)
+		m_handler_time = gettime_now() - m_request_start;
 
 	CONNECTION_DEBUG("handler asks for closing connection")
 		("error", err.message())
@@ -703,6 +770,8 @@ void connection<T>::process_next()
 	m_access_start.tv_sec = 0;
 	m_access_start.tv_usec = 0;
 	m_access_status = 0;
+	m_access_request_id = 0;
+	m_access_trace_bit = false;
 	m_access_received = 0;
 	m_access_sent = 0;
 	m_request_processing_was_finished = false;
@@ -719,10 +788,15 @@ void connection<T>::process_next()
 	m_receive_time = {0, 0};
 	m_send_time = {0, 0};
 	m_starttransfer_time = {0, 0};
+	m_request_start = {0, 0};
+	m_first_byte_time = {0, 0};
+	m_handler_time = {0, 0};
+	m_handler_index = server_data::no_handler;
 
 	m_attributes.clear();
-	m_logger = swarm::logger(m_base_logger, m_attributes);
-	m_request = http_request();
+	m_logger_outdated = true;
+	// Handler returns it's previous request by on_headers, it's memory is reused for the next one
+	m_request.clear();
 
 	CONNECTION_INFO("process next request")
 		("size", m_unprocessed_end - m_unprocessed_begin)
@@ -752,19 +826,60 @@ void connection<T>::print_access_log()
 
 	unsigned long long delta = 1000000ull * (end.tv_sec - m_access_start.tv_sec) + end.tv_usec - m_access_start.tv_usec;
 
-	CONNECTION_LOG(SWARM_LOG_INFO, "access_log_entry: method: %s, url: %s, local: %s, remote: %s, status: %d, received: %llu, sent: %llu, time: %llu us, "
-			"receive_time: %ld us, send_time: %ld us, starttransfer_time: %ld us",
-		m_access_method.empty() ? "-" : m_access_method.c_str(),
-		m_access_url.empty() ? "-" : m_access_url.c_str(),
-		m_access_local.c_str(),
-		m_access_remote.c_str(),
-		m_access_status,
-		m_access_received,
-		m_access_sent,
-		delta,
-		timespec_to_usec(m_receive_time),
-		timespec_to_usec(m_send_time),
-		timespec_to_usec(m_starttransfer_time));
+	auto &access_log = m_server->m_data->access_log;
+	if (access_log.enabled()) {
+		if (access_log.sampled(m_access_request_id)) {
+			access_log_record record;
+			record.timestamp = 1000000ull * m_access_start.tv_sec + m_access_start.tv_usec;
+			record.request_id = m_access_request_id;
+			record.received = m_access_received;
+			record.sent = m_access_sent;
+			record.total_time = delta;
+			record.receive_time = timespec_to_usec(m_receive_time);
+			record.send_time = timespec_to_usec(m_send_time);
+			record.starttransfer_time = timespec_to_usec(m_starttransfer_time);
+			record.status = m_access_status;
+			record.flags = m_access_trace_bit ? uint32_t(access_log_record::trace_bit) : 0;
+			access_log_record::set_string(record.method, sizeof(record.method), m_access_method);
+			if (!access_log_record::set_string(record.url, sizeof(record.url), m_access_url))
+				record.flags |= access_log_record::url_truncated;
+			access_log_record::set_string(record.local, sizeof(record.local), m_access_local);
+			access_log_record::set_string(record.remote, sizeof(record.remote), m_access_remote);
+
+			access_log.push(record);
+		}
+	} else {
+		CONNECTION_LOG(SWARM_LOG_INFO, "access_log_entry: method: %s, url: %s, local: %s, remote: %s, status: %d, received: %llu, sent: %llu, time: %llu us, "
+				"receive_time: %ld us, send_time: %ld us, starttransfer_time: %ld us",
+			m_access_method.empty() ? "-" : m_access_method.c_str(),
+			m_access_url.empty() ? "-" : m_access_url.c_str(),
+			m_access_local.c_str(),
+			m_access_remote.c_str(),
+			m_access_status,
+			m_access_received,
+			m_access_sent,
+			delta,
+			timespec_to_usec(m_receive_time),
+			timespec_to_usec(m_send_time),
+			timespec_to_usec(m_starttransfer_time));
+	}
+
+	if (m_handler_index != server_data::no_handler) {
+		const struct timespec total_time = gettime_now() - m_request_start;
+
+		route_statistics::record info;
+		info.status = m_access_status;
+		info.received = m_access_received;
+		info.sent = m_access_sent;
+		info.total_time = timespec_to_usec(total_time);
+		// Replies which were interrupted before handler's reaction are accounted by total time
+		info.first_byte_time = timespec_to_usec(m_first_byte_time.tv_sec || m_first_byte_time.tv_nsec
+			? m_first_byte_time : total_time);
+		info.handler_time = timespec_to_usec(m_handler_time.tv_sec || m_handler_time.tv_nsec
+			? m_handler_time : total_time);
+
+		m_server->m_data->handlers_statistics[m_handler_index]->add(info);
+	}
 }
 
 template <typename T>
@@ -1100,6 +1215,7 @@ void connection<T>::process_headers()
 	if (m_state & waiting_for_first_data) {
 		m_state &= ~waiting_for_first_data;
 		gettimeofday(&m_access_start, NULL);
+		m_request_start = gettime_now();
 	}
 
 	boost::tribool result;
@@ -1127,10 +1243,11 @@ void connection<T>::process_headers()
 		int request_header_err = 0;
 
 		if (!request_header.empty()) {
-			if (auto request_ptr = m_request.headers().get(request_header)) {
-				std::string tmp = request_ptr->substr(0, 16);
+			if (const std::string* request_ptr = find_header(m_request.headers(), request_header)) {
+				char tmp[17];
+				tmp[request_ptr->copy(tmp, 16)] = '\0';
 				errno = 0;
-				request_id = strtoull(tmp.c_str(), NULL, 16);
+				request_id = strtoull(tmp, NULL, 16);
 				request_header_err = -errno;
 				if (request_header_err != 0) {
 					request_id = 0;
@@ -1141,15 +1258,12 @@ void connection<T>::process_headers()
 		}
 
 		if (failed_to_parse_request_id) {
-			unsigned char *buffer = reinterpret_cast<unsigned char *>(&request_id);
-			for (size_t i = 0; i < sizeof(request_id) / sizeof(unsigned char); ++i) {
-				buffer[i] = std::rand();
-			}
+			request_id = generate_request_id();
 		}
 
 		const std::string &trace_header = m_server->m_data->trace_header;
 		if (!trace_header.empty()) {
-			if (auto trace_bit_ptr = m_request.headers().get(trace_header)) {
+			if (const std::string* trace_bit_ptr = find_header(m_request.headers(), trace_header)) {
 				try {
 					trace_bit = boost::lexical_cast<uint32_t>(*trace_bit_ptr) > 0;
 				} catch (std::exception &exc) {
@@ -1162,13 +1276,14 @@ void connection<T>::process_headers()
 			}
 		}
 
-		m_attributes = blackhole::log::attributes_t({
-			swarm::keyword::request_id() = request_id,
-			blackhole::keyword::tracebit() = trace_bit
-		});
-		m_logger = swarm::logger(m_base_logger, m_attributes);
+		// Attributes are cleared by process_next, inserting them keeps the map's buckets
+		m_attributes.insert(swarm::keyword::request_id() = request_id);
+		m_attributes.insert(blackhole::keyword::tracebit() = trace_bit);
+		m_access_request_id = request_id;
+		m_access_trace_bit = trace_bit;
+		m_logger_outdated = true;
 
-		blackhole::scoped_attributes_t logger_guard(m_logger, blackhole::log::attributes_t(m_attributes));
+		detail::scoped_attributes_ref logger_guard(m_base_logger, m_attributes);
 
 		if (request_header_err != 0) {
 			auto request_ptr = m_request.headers().get(request_header);
@@ -1199,10 +1314,10 @@ void connection<T>::process_headers()
 				m_access_url.empty() ? "-" : m_access_url,
 				m_access_local,
 				m_access_remote,
-				headers_to_string(m_request.headers(), m_server->m_data->log_request_headers)
+				headers_to_string(m_headers_string, m_request.headers(), m_server->m_data->log_request_headers)
 			);
 
-			auto factory = m_server->factory(m_request);
+			m_handler_index = m_server->m_data->find_handler(m_request);
 
 			if (auto length = m_request.headers().content_length())
 				m_content_length = *length;
@@ -1215,9 +1330,9 @@ void connection<T>::process_headers()
 				m_chunk_state = read_headers | waiting_for_first_data;
 			}
 
-			if (factory) {
+			if (m_handler_index != server_data::no_handler) {
 				++m_server->m_data->active_connections_counter;
-				m_handler = factory->create();
+				m_handler = m_server->m_data->handlers[m_handler_index].second->create();
 				m_handler->initialize(std::static_pointer_cast<reply_stream>(this->shared_from_this()));
 				SAFE_CALL(m_handler->on_headers(std::move(m_request)), "connection::process_headers -> on_headers", SAFE_SEND_ERROR);
 			} else {
@@ -114,6 +114,8 @@ public:
 	void send_error(http_response::status_type type);
 	virtual void initialize(base_request_stream_data *data);
 	virtual swarm::logger create_logger();
+	//! Returns logger for record of \a level, binds request's attributes only if it passes the filter
+	swarm::logger &logger_for(swarm::log_level level);
 	virtual void close(const boost::system::error_code &err) /*override*/;
 	virtual void virtual_hook(reply_stream_hook id, void *data);
 
@@ -177,7 +179,9 @@ private:
 	base_server *m_server;
 	blackhole::log::attributes_t m_attributes;
 	swarm::logger m_base_logger;
+	//! Logger with request's attributes, it's rebuilt lazily by logger_for
 	swarm::logger m_logger;
+	bool m_logger_outdated;
 
 	//! Socket for the connection.
 	socket_type m_socket;
@@ -199,7 +203,11 @@ private:
 	timeval m_access_start;
 	std::string m_access_method;
 	std::string m_access_url;
+	//! Request's headers written to the log
+	std::string m_headers_string;
 	int m_access_status;
+	uint64_t m_access_request_id;
+	bool m_access_trace_bit;
 	unsigned long long m_access_received;
 	unsigned long long m_access_sent;
 	bool m_request_processing_was_finished;
@@ -214,6 +222,8 @@ private:
 	std::atomic_bool m_close_invoked;
 	//! This object represents the server logic
 	std::shared_ptr<base_request_stream> m_handler;
+	//! Index of the handler in server's list, it's used to account route statistics
+	size_t m_handler_index;
 
 	//! Request parsing state
 	uint32_t m_state;
@@ -249,6 +259,17 @@ private:
 	//! Time from the start until the first chunk of data is received.
 	//! This value is presented within access_log_entry as 'starttransfer_time'.
 	struct timespec m_starttransfer_time;
+
+	//! Monotonic time when request headers started to be processed.
+	struct timespec m_request_start;
+
+	//! Time from the request start until the handler sent headers.
+	//! This value is accounted in route statistics as 'first_byte_time'.
+	struct timespec m_first_byte_time;
+
+	//! Time from the request start until the handler asked to close the reply.
+	//! This value is accounted in route statistics as 'handler_time'.
+	struct timespec m_handler_time;
 };
 
 typedef connection<boost::asio::ip::tcp::socket> tcp_connection;
@@ -50,8 +50,7 @@ http_request::~http_request()
 http_request &http_request::operator =(http_request &&other)
 {
 	using std::swap;
-	http_request tmp(other);
-	swap(m_data, tmp.m_data);
+	swap(m_data, other.m_data);
 	return *this;
 }
 
@@ -63,6 +62,25 @@ http_request &http_request::operator =(const http_request &other)
 	return *this;
 }
 
+void http_request::clear()
+{
+	if (!m_data) {
+		m_data.reset(new http_request_data);
+		return;
+	}
+
+	http_request_data *data = M_DATA();
+	data->url = swarm::url();
+	data->headers.clear();
+	data->method.clear();
+	data->major_version = 1;
+	data->minor_version = 1;
+	data->request_id = 0;
+	data->trace_bit = false;
+	data->remote_endpoint.clear();
+	data->local_endpoint.clear();
+}
+
 uint64_t http_request::request_id() const
 {
 	return M_DATA()->request_id;
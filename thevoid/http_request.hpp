@@ -18,6 +18,9 @@ public:
 	http_request &operator =(http_request &&other);
 	http_request &operator =(const http_request &other);
 
+	// Resets the request to the default one keeping memory of headers and strings
+	void clear();
+
 	uint64_t request_id() const;
 	void set_request_id(uint64_t request_id);
 
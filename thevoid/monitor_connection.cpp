@@ -17,7 +17,6 @@
 #include "monitor_connection_p.hpp"
 #include "server_p.hpp"
 
-#include "rapidjson/stringbuffer.h"
 #include "rapidjson/prettywriter.h"
 
 #include <boost/bind.hpp>
@@ -25,8 +24,503 @@
 namespace ioremap {
 namespace thevoid {
 
+enum {
+	//! Report is sent to the socket as soon as this amount of data is generated
+	report_chunk_size = 64 * 1024,
+	//! Maximal size of request headers
+	max_request_size = 16 * 1024
+};
+
+/*!
+ * \internal
+ *
+ * \brief The monitor_report class generates statistics report part by part.
+ *
+ * Snapshot of all counters is taken at construction, so the whole report is consistent
+ * even if it's sent to the client in several chunks.
+ */
+class monitor_report
+{
+public:
+	monitor_report(base_server *server, server_data &data, std::string &output) :
+		m_data(data), m_output(output), m_step(0), m_now(worker_statistics::now()),
+		m_application(server->get_statistics())
+	{
+		m_handlers.reserve(m_data.handlers_statistics.size());
+		for (auto it = m_data.handlers_statistics.begin(); it != m_data.handlers_statistics.end(); ++it) {
+			m_handlers.emplace_back((*it)->get_snapshot());
+		}
+	}
+
+	virtual ~monitor_report()
+	{
+	}
+
+	/*!
+	 * \brief Appends next part of the report to the output.
+	 *
+	 * Returns false if there is nothing to append anymore.
+	 */
+	virtual bool generate_next() = 0;
+
+protected:
+	server_data &m_data;
+	std::string &m_output;
+	size_t m_step;
+	uint64_t m_now;
+	std::vector<route_statistics::snapshot> m_handlers;
+	std::map<std::string, std::string> m_application;
+};
+
+/*!
+ * \internal
+ *
+ * \brief The string_output class is rapidjson's output stream which writes to the std::string.
+ */
+struct string_output
+{
+	typedef char Ch;
+
+	explicit string_output(std::string *data) : data(data)
+	{
+	}
+
+	void Put(char ch)
+	{
+		data->push_back(ch);
+	}
+
+	std::string *data;
+};
+
+class json_report : public monitor_report
+{
+public:
+	json_report(base_server *server, server_data &data, std::string &output) :
+		monitor_report(server, data, output), m_stream(&output), m_writer(m_stream)
+	{
+	}
+
+	bool generate_next()
+	{
+		const size_t step = m_step++;
+
+		if (step == 0) {
+			generate_server();
+		} else if (step <= m_handlers.size()) {
+			generate_handler(step - 1);
+		} else if (step == m_handlers.size() + 1) {
+			generate_application();
+		} else {
+			return false;
+		}
+
+		return true;
+	}
+
+private:
+	void generate_server()
+	{
+		m_writer.StartObject();
+
+		m_writer.String("connections");
+		m_writer.Int(m_data.connections_counter);
+		m_writer.String("active-connections");
+		m_writer.Int(m_data.active_connections_counter);
+
+		m_writer.String("workers");
+		m_writer.StartArray();
+		for (size_t i = 0; i < m_data.workers_statistics.size(); ++i) {
+			const worker_statistics &worker = *m_data.workers_statistics[i];
+
+			m_writer.StartObject();
+			m_writer.String("index");
+			m_writer.Uint64(i);
+			m_writer.String("connections");
+			m_writer.Uint64(worker.connections.load(std::memory_order_relaxed));
+			m_writer.String("loop_lag");
+			m_writer.Uint64(worker.current_loop_lag(m_now));
+			m_writer.EndObject();
+		}
+		m_writer.EndArray();
+
+		if (m_data.access_log.enabled()) {
+			m_writer.String("access_log");
+			m_writer.StartObject();
+			m_writer.String("written");
+			m_writer.Uint64(m_data.access_log.written());
+			m_writer.String("dropped");
+			m_writer.Uint64(m_data.access_log.dropped());
+			m_writer.String("sampled_out");
+			m_writer.Uint64(m_data.access_log.sampled_out());
+			m_writer.EndObject();
+		}
+
+		m_writer.String("handlers");
+		m_writer.StartArray();
+	}
+
+	void generate_handler(size_t index)
+	{
+		const auto &name = m_data.handlers_statistics[index]->name();
+		const auto &snapshot = m_handlers[index];
+
+		m_writer.StartObject();
+
+		m_writer.String("name");
+		m_writer.String(name.c_str(), name.size());
+		m_writer.String("requests");
+		m_writer.Uint64(snapshot.requests);
+
+		m_writer.String("status");
+		m_writer.StartObject();
+		for (size_t i = 0; i < route_statistics::status_class_count; ++i) {
+			m_writer.String(route_statistics::status_class_name(i));
+			m_writer.Uint64(snapshot.statuses[i]);
+		}
+		m_writer.EndObject();
+
+		m_writer.String("received");
+		m_writer.Uint64(snapshot.received);
+		m_writer.String("sent");
+		m_writer.Uint64(snapshot.sent);
+
+		// All times are in microseconds
+		generate_latency("total_time", snapshot.total_time);
+		generate_latency("first_byte_time", snapshot.first_byte_time);
+		generate_latency("handler_time", snapshot.handler_time);
+
+		m_writer.EndObject();
+	}
+
+	void generate_latency(const char *name, const latency_snapshot &latency)
+	{
+		m_writer.String(name);
+		m_writer.StartObject();
+
+		m_writer.String("count");
+		m_writer.Uint64(latency.count());
+		m_writer.String("mean");
+		m_writer.Double(latency.mean());
+		m_writer.String("max");
+		m_writer.Uint64(latency.max());
+		m_writer.String("p50");
+		m_writer.Uint64(latency.quantile(0.5));
+		m_writer.String("p90");
+		m_writer.Uint64(latency.quantile(0.9));
+		m_writer.String("p95");
+		m_writer.Uint64(latency.quantile(0.95));
+		m_writer.String("p99");
+		m_writer.Uint64(latency.quantile(0.99));
+		m_writer.String("p999");
+		m_writer.Uint64(latency.quantile(0.999));
+
+		m_writer.EndObject();
+	}
+
+	void generate_application()
+	{
+		m_writer.EndArray();
+
+		m_writer.String("application");
+		m_writer.StartObject();
+		for (auto it = m_application.begin(); it != m_application.end(); ++it) {
+			m_writer.String(it->first.c_str(), it->first.size());
+			m_writer.String(it->second.c_str(), it->second.size());
+		}
+		m_writer.EndObject();
+
+		m_writer.EndObject();
+		m_output.push_back('\n');
+	}
+
+	string_output m_stream;
+	rapidjson::PrettyWriter<string_output> m_writer;
+};
+
+class metrics_report : public monitor_report
+{
+public:
+	enum handler_family {
+		family_requests,
+		family_responses,
+		family_received,
+		family_sent,
+		family_time,
+		family_count
+	};
+
+	metrics_report(base_server *server, server_data &data, std::string &output) :
+		monitor_report(server, data, output)
+	{
+	}
+
+	bool generate_next()
+	{
+		const size_t step = m_step++;
+		const size_t handler_steps = family_count * m_handlers.size();
+
+		if (step == 0) {
+			generate_server();
+		} else if (step <= handler_steps) {
+			// All samples of the same metric must be grouped together
+			const size_t family = (step - 1) / m_handlers.size();
+			const size_t index = (step - 1) % m_handlers.size();
+			generate_handler(static_cast<handler_family>(family), index);
+		} else if (step == handler_steps + 1) {
+			generate_application();
+		} else {
+			return false;
+		}
+
+		return true;
+	}
+
+private:
+	void append(const char *data)
+	{
+		m_output.append(data);
+	}
+
+	void append(uint64_t value)
+	{
+		char buffer[32];
+		const int size = snprintf(buffer, sizeof(buffer), "%llu", static_cast<unsigned long long>(value));
+		m_output.append(buffer, size);
+	}
+
+	void append_seconds(uint64_t microseconds)
+	{
+		char buffer[32];
+		const int size = snprintf(buffer, sizeof(buffer), "%llu.%06llu",
+			static_cast<unsigned long long>(microseconds / 1000000),
+			static_cast<unsigned long long>(microseconds % 1000000));
+		m_output.append(buffer, size);
+	}
+
+	void append_label(const std::string &value)
+	{
+		m_output.push_back('"');
+		for (auto it = value.begin(); it != value.end(); ++it) {
+			switch (*it) {
+			case '\\':
+				m_output.append("\\\\");
+				break;
+			case '"':
+				m_output.append("\\\"");
+				break;
+			case '\n':
+				m_output.append("\\n");
+				break;
+			default:
+				m_output.push_back(*it);
+				break;
+			}
+		}
+		m_output.push_back('"');
+	}
+
+	void append_header(const char *name, const char *type, const char *help)
+	{
+		append("# HELP ");
+		append(name);
+		append(" ");
+		append(help);
+		append("\n# TYPE ");
+		append(name);
+		append(" ");
+		append(type);
+		append("\n");
+	}
+
+	void generate_server()
+	{
+		append_header("thevoid_connections", "gauge", "Number of opened client connections.");
+		append("thevoid_connections ");
+		append(uint64_t(std::max(0, int(m_data.connections_counter))));
+		append("\n");
+
+		append_header("thevoid_active_connections", "gauge", "Number of connections with request being processed.");
+		append("thevoid_active_connections ");
+		append(uint64_t(std::max(0, int(m_data.active_connections_counter))));
+		append("\n");
+
+		if (m_data.access_log.enabled()) {
+			append_header("thevoid_access_log_records_total", "counter", "Number of access log records per outcome.");
+			append("thevoid_access_log_records_total{result=\"written\"} ");
+			append(m_data.access_log.written());
+			append("\nthevoid_access_log_records_total{result=\"dropped\"} ");
+			append(m_data.access_log.dropped());
+			append("\nthevoid_access_log_records_total{result=\"sampled_out\"} ");
+			append(m_data.access_log.sampled_out());
+			append("\n");
+		}
+
+		if (m_data.workers_statistics.empty())
+			return;
+
+		append_header("thevoid_worker_connections_total", "counter", "Number of connections assigned to the worker.");
+		for (size_t i = 0; i < m_data.workers_statistics.size(); ++i) {
+			append("thevoid_worker_connections_total{worker=\"");
+			append(uint64_t(i));
+			append("\"} ");
+			append(m_data.workers_statistics[i]->connections.load(std::memory_order_relaxed));
+			append("\n");
+		}
+
+		append_header("thevoid_worker_loop_lag_seconds", "gauge", "Time the last probe spent in the worker's event loop queue.");
+		for (size_t i = 0; i < m_data.workers_statistics.size(); ++i) {
+			append("thevoid_worker_loop_lag_seconds{worker=\"");
+			append(uint64_t(i));
+			append("\"} ");
+			append_seconds(m_data.workers_statistics[i]->current_loop_lag(m_now));
+			append("\n");
+		}
+	}
+
+	void generate_handler(handler_family family, size_t index)
+	{
+		const bool first = (index == 0);
+		const auto &name = m_data.handlers_statistics[index]->name();
+		const auto &snapshot = m_handlers[index];
+
+		switch (family) {
+		case family_requests:
+			if (first)
+				append_header("thevoid_handler_requests_total", "counter", "Number of requests processed by the handler.");
+			append("thevoid_handler_requests_total{handler=");
+			append_label(name);
+			append("} ");
+			append(snapshot.requests);
+			append("\n");
+			break;
+		case family_responses:
+			if (first)
+				append_header("thevoid_handler_responses_total", "counter", "Number of replies sent by the handler per status class.");
+			for (size_t i = 0; i < route_statistics::status_class_count; ++i) {
+				append("thevoid_handler_responses_total{handler=");
+				append_label(name);
+				append(",status=\"");
+				append(route_statistics::status_class_name(i));
+				append("\"} ");
+				append(snapshot.statuses[i]);
+				append("\n");
+			}
+			break;
+		case family_received:
+			if (first)
+				append_header("thevoid_handler_received_bytes_total", "counter", "Number of bytes received by the handler.");
+			append("thevoid_handler_received_bytes_total{handler=");
+			append_label(name);
+			append("} ");
+			append(snapshot.received);
+			append("\n");
+			break;
+		case family_sent:
+			if (first)
+				append_header("thevoid_handler_sent_bytes_total", "counter", "Number of bytes sent by the handler.");
+			append("thevoid_handler_sent_bytes_total{handler=");
+			append_label(name);
+			append("} ");
+			append(snapshot.sent);
+			append("\n");
+			break;
+		case family_time:
+			if (first)
+				append_header("thevoid_handler_time_seconds", "histogram", "Request processing time per phase.");
+			generate_histogram(name, "total", snapshot.total_time);
+			generate_histogram(name, "first_byte", snapshot.first_byte_time);
+			generate_histogram(name, "handler", snapshot.handler_time);
+			break;
+		default:
+			break;
+		}
+	}
+
+	void generate_histogram(const std::string &name, const char *phase, const latency_snapshot &latency)
+	{
+		// Bucket bounds in microseconds
+		static const uint64_t bounds[] = {
+			100, 250, 500,
+			1000, 2500, 5000,
+			10000, 25000, 50000,
+			100000, 250000, 500000,
+			1000000, 2500000, 5000000,
+			10000000
+		};
+
+		/*
+		 * Edges of latency histogram's buckets are not round numbers, so every bound is replaced
+		 * by the last value of histogram's bucket containing it. Values are integer microseconds,
+		 * so the count of values not greater than the last one is exact.
+		 */
+		for (size_t i = 0; i < sizeof(bounds) / sizeof(bounds[0]); ++i) {
+			const size_t index = latency_histogram::bucket_index(bounds[i]);
+			const uint64_t last = latency_histogram::bucket_lower_bound(index + 1) - 1;
+
+			append_histogram_prefix("_bucket", name, phase);
+			append(",le=\"");
+			append_seconds(last);
+			append("\"} ");
+			append(latency.count_below(last));
+			append("\n");
+		}
+
+		append_histogram_prefix("_bucket", name, phase);
+		append(",le=\"+Inf\"} ");
+		append(latency.count());
+		append("\n");
+
+		append_histogram_prefix("_sum", name, phase);
+		append("} ");
+		append_seconds(latency.sum());
+		append("\n");
+
+		append_histogram_prefix("_count", name, phase);
+		append("} ");
+		append(latency.count());
+		append("\n");
+	}
+
+	void append_histogram_prefix(const char *suffix, const std::string &name, const char *phase)
+	{
+		append("thevoid_handler_time_seconds");
+		append(suffix);
+		append("{handler=");
+		append_label(name);
+		append(",phase=\"");
+		append(phase);
+		append("\"");
+	}
+
+	void generate_application()
+	{
+		bool first = true;
+
+		for (auto it = m_application.begin(); it != m_application.end(); ++it) {
+			// Prometheus accepts only numeric samples
+			const char *begin = it->second.c_str();
+			char *end = NULL;
+			strtod(begin, &end);
+			if (it->second.empty() || end != begin + it->second.size())
+				continue;
+
+			if (first) {
+				append_header("thevoid_application", "untyped", "Application statistics reported by get_statistics().");
+				first = false;
+			}
+
+			append("thevoid_application{key=");
+			append_label(it->first);
+			append("} ");
+			m_output.append(it->second);
+			append("\n");
+		}
+	}
+};
+
 monitor_connection::monitor_connection(base_server *server, boost::asio::io_service &io_service, size_t buffer_size)
-	: m_server(server), m_socket(io_service)
+	: m_server(server), m_socket(io_service), m_request_size(0)
 {
 	(void) buffer_size;
 }
@@ -51,73 +545,123 @@ void monitor_connection::start(const std::string &local_endpoint)
 	async_read();
 }
 
-std::string monitor_connection::get_information()
+void monitor_connection::async_read()
 {
-	auto server_statistics = m_server->get_statistics();
+	m_socket.async_read_some(boost::asio::buffer(m_buffer),
+				 std::bind(&monitor_connection::handle_read, shared_from_this(),
+					   std::placeholders::_1,
+					   std::placeholders::_2));
+}
 
-	rapidjson::MemoryPoolAllocator<> allocator;
-	rapidjson::Value information;
-	information.SetObject();
+void monitor_connection::handle_read(const boost::system::error_code &err, std::size_t bytes_transferred)
+{
+	if (err || bytes_transferred < 1) {
+		close();
+		return;
+	}
 
-	information.AddMember("connections", int(m_server->m_data->connections_counter), allocator);
-	information.AddMember("active-connections", int(m_server->m_data->active_connections_counter), allocator);
+	m_request_size += bytes_transferred;
 
-	rapidjson::Value application;
-	application.SetObject();
+	boost::tribool result;
+	const char *end = NULL;
+	boost::tie(result, end) = m_request_parser.parse(m_request, m_buffer.data(), m_buffer.data() + bytes_transferred);
 
-	for (auto it = server_statistics.begin(); it != server_statistics.end(); ++it) {
-		application.AddMember(it->first.c_str(), it->second.c_str(), allocator);
+	if (result) {
+		process_request();
+	} else if (!result) {
+		send_reply(http_response::bad_request, "Failed to parse request\n");
+	} else if (m_request_size > max_request_size) {
+		send_reply(http_response::bad_request, "Request is too large\n");
+	} else {
+		async_read();
 	}
+}
+
+void monitor_connection::process_request()
+{
+	const std::string &method = m_request.method();
+	const std::string &path = m_request.url().path();
 
-	information.AddMember("application", application, allocator);
+	if (path == "/stats" || path == "/metrics") {
+		if (method != "GET" && method != "HEAD") {
+			send_reply(http_response::method_not_allowed, "Only GET is allowed\n");
+			return;
+		}
 
-	rapidjson::StringBuffer buffer;
-	rapidjson::PrettyWriter<rapidjson::StringBuffer> writer(buffer);
+		m_server->m_data->probe_workers();
 
-	information.Accept(writer);
-	buffer.Put('\n');
+		if (path == "/stats") {
+			append_headers(http_response::ok, "application/json");
+			m_report.reset(new json_report(m_server, *m_server->m_data, m_storage));
+		} else {
+			append_headers(http_response::ok, "text/plain; version=0.0.4");
+			m_report.reset(new metrics_report(m_server, *m_server->m_data, m_storage));
+		}
 
-	return std::string(buffer.GetString(), buffer.Size());
+		if (method == "HEAD")
+			m_report.reset();
+
+		send_report();
+	} else if (path == "/stop") {
+		if (method != "POST") {
+			send_reply(http_response::method_not_allowed, "Only POST is allowed\n");
+			return;
+		}
+
+		append_headers(http_response::ok, "text/plain");
+		m_storage += "Stopping...\n";
+		boost::asio::async_write(m_socket, boost::asio::buffer(m_storage),
+			std::bind(&monitor_connection::handle_stop_write, shared_from_this(),
+				std::placeholders::_1, std::placeholders::_2));
+	} else {
+		send_reply(http_response::not_found,
+			"GET /stats - statistics information in JSON\n"
+			"GET /metrics - statistics information in Prometheus text format\n"
+			"POST /stop - stop server\n");
+	}
 }
 
-void monitor_connection::async_read()
+void monitor_connection::append_headers(int code, const char *content_type)
 {
-	m_socket.async_read_some(boost::asio::buffer(m_buffer),
-				 std::bind(&monitor_connection::handle_read, shared_from_this(),
-					   std::placeholders::_1,
-					   std::placeholders::_2));
+	http_response reply;
+	reply.set_code(code);
+	reply.headers().set_content_type(content_type);
+	// Report's size is unknown before it's generated, so it's finished by closing the connection
+	reply.headers().set_keep_alive(false);
+
+	const auto buffers = reply.to_buffers();
+	for (auto it = buffers.begin(); it != buffers.end(); ++it) {
+		m_storage.append(boost::asio::buffer_cast<const char *>(*it), boost::asio::buffer_size(*it));
+	}
 }
 
-void monitor_connection::handle_read(const boost::system::error_code &err, std::size_t bytes_transferred)
+void monitor_connection::send_reply(int code, const std::string &content)
 {
-	if (err || bytes_transferred < 1) {
+	append_headers(code, "text/plain");
+	m_storage += content;
+	async_write();
+}
+
+void monitor_connection::send_report()
+{
+	while (m_report && m_storage.size() < report_chunk_size) {
+		if (!m_report->generate_next())
+			m_report.reset();
+	}
+
+	if (m_storage.empty()) {
 		close();
 		return;
 	}
 
-	switch (m_buffer[0]) {
-		case 'i': case 'I':
-			async_write(get_information());
-			break;
-		case 's': case 'S': {
-			const char *result = "Stopping...\n";
-			boost::asio::async_write(m_socket, boost::asio::buffer(result, strlen(result)),
-				std::bind(&monitor_connection::handle_stop_write, shared_from_this(),
-					std::placeholders::_1, std::placeholders::_2));
-			break;
-		}
-		default:
-		case 'h': case 'H':
-			async_write("i - statistics information\n"
-				    "s - stop server\n"
-				    "h - this help message\n");
-			break;
-	}
+	boost::asio::async_write(m_socket, boost::asio::buffer(m_storage),
+				 std::bind(&monitor_connection::handle_report_write, shared_from_this(),
+					   std::placeholders::_1,
+					   std::placeholders::_2));
 }
 
-void monitor_connection::async_write(const std::string &data)
+void monitor_connection::async_write()
 {
-	m_storage = data;
 	boost::asio::async_write(m_socket, boost::asio::buffer(m_storage),
 				 std::bind(&monitor_connection::handle_write, shared_from_this(),
 					   std::placeholders::_1,
@@ -129,6 +673,19 @@ void monitor_connection::handle_write(const boost::system::error_code &, size_t)
 	close();
 }
 
+void monitor_connection::handle_report_write(const boost::system::error_code &err, size_t)
+{
+	m_storage.clear();
+
+	if (err) {
+		m_report.reset();
+		close();
+		return;
+	}
+
+	send_report();
+}
+
 void monitor_connection::handle_stop_write(const boost::system::error_code &, size_t)
 {
 	close();
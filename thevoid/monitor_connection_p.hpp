@@ -20,10 +20,27 @@
 #include <boost/asio.hpp>
 #include <boost/array.hpp>
 #include "server.hpp"
+#include "request_parser_p.hpp"
 
 namespace ioremap {
 namespace thevoid {
 
+class monitor_report;
+
+/*!
+ * \internal
+ *
+ * \brief The monitor_connection class serves HTTP requests to the monitor port.
+ *
+ * Supported requests are:
+ * \li GET /stats - JSON document with server, workers, handlers and application statistics.
+ * \li GET /metrics - the same statistics in Prometheus text exposition format.
+ * \li POST /stop - stops the server.
+ *
+ * Report is generated part by part directly into the outgoing buffer, every part is sent
+ * to the socket as soon as buffer is big enough, so the monitor thread is never blocked
+ * by the large report.
+ */
 class monitor_connection : public std::enable_shared_from_this<monitor_connection>
 {
 public:
@@ -39,11 +56,15 @@ public:
 	void start(const std::string &local_endpoint);
 
 protected:
-	std::string get_information();
 	void async_read();
 	void handle_read(const boost::system::error_code &err, std::size_t bytes_transferred);
-	void async_write(const std::string &data);
+	void process_request();
+	void append_headers(int code, const char *content_type);
+	void send_reply(int code, const std::string &content);
+	void send_report();
+	void async_write();
 	void handle_write(const boost::system::error_code &err, size_t);
+	void handle_report_write(const boost::system::error_code &err, size_t);
 	void handle_stop_write(const boost::system::error_code &err, size_t);
 	void close();
 
@@ -51,8 +72,12 @@ private:
 	base_server *m_server;
 	socket_type m_socket;
 	endpoint_type m_endpoint;
-	boost::array<char, 64> m_buffer;
+	boost::array<char, 1024> m_buffer;
+	request_parser m_request_parser;
+	http_request m_request;
+	size_t m_request_size;
 	std::string m_storage;
+	std::unique_ptr<monitor_report> m_report;
 };
 
 } // namespace thevoid
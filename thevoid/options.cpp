@@ -49,6 +49,7 @@ public:
 
 	uint64_t flags;
 	std::string match_string;
+	std::string match_regex_string;
 	boost::regex match_regex;
 	std::vector<std::string> methods;
 	std::vector<swarm::headers_entry> headers;
@@ -160,6 +161,7 @@ void base_server::options::set_regex_match(const std::string &str)
 	}
 	m_data->flags |= server_options_private::check_regexp_match | server_options_private::check_string_match;
 	m_data->match_regex.assign(str);
+	m_data->match_regex_string = str;
 }
 
 void base_server::options::set_methods(const std::vector<std::string> &methods)
@@ -232,6 +234,57 @@ void base_server::options::set_host_suffix(const std::string &host)
 }
 
 bool base_server::options::check(const http_request &request) const
+{
+	return check_impl(request, NULL);
+}
+
+bool base_server::options::check(const http_request &request, bool regex_matched) const
+{
+	return check_impl(request, &regex_matched);
+}
+
+const std::string &base_server::options::regex_pattern() const
+{
+	return m_data->match_regex_string;
+}
+
+std::string base_server::options::description() const
+{
+	std::string result;
+
+	if (m_data->flags & server_options_private::check_methods) {
+		for (auto it = m_data->methods.begin(); it != m_data->methods.end(); ++it) {
+			if (it != m_data->methods.begin())
+				result += ',';
+			result += *it;
+		}
+		result += ' ';
+	}
+
+	if (m_data->flags & server_options_private::check_exact_match) {
+		result += m_data->match_string;
+	} else if (m_data->flags & server_options_private::check_prefix_match) {
+		result += m_data->match_string;
+		result += '*';
+	} else if (m_data->flags & server_options_private::check_regexp_match) {
+		result += '~';
+		result += m_data->match_regex_string;
+	} else {
+		result += '*';
+	}
+
+	if (m_data->flags & server_options_private::check_host_exact) {
+		result += " host=";
+		result += m_data->host_string;
+	} else if (m_data->flags & server_options_private::check_host_suffix) {
+		result += " host=*";
+		result += m_data->host_string;
+	}
+
+	return result;
+}
+
+bool base_server::options::check_impl(const http_request &request, const bool *regex_matched) const
 {
 	if (m_data->flags & server_options_private::check_methods) {
 		const auto &methods = m_data->methods;
@@ -272,7 +325,11 @@ bool base_server::options::check(const http_request &request) const
 				return false;
 			}
 		} else if (m_data->flags & server_options_private::check_regexp_match) {
-			if (!boost::regex_match(request.url().path(), m_data->match_regex)) {
+			if (regex_matched) {
+				if (!*regex_matched) {
+					return false;
+				}
+			} else if (!boost::regex_match(request.url().path(), m_data->match_regex)) {
 				return false;
 			}
 		}
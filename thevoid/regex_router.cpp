@@ -0,0 +1,107 @@
+/*
+ * Copyright 2015+ Ruslan Nigmatullin <euroelessar@yandex.ru>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "regex_router_p.hpp"
+
+namespace ioremap {
+namespace thevoid {
+
+regex_router::regex_router() : m_mark_count(0)
+{
+}
+
+void regex_router::add(size_t index, const std::string &pattern)
+{
+	if (has_back_references(pattern)) {
+		return;
+	}
+
+	std::string combined = m_pattern;
+	if (!combined.empty())
+		combined += '|';
+	combined += '(';
+	combined += pattern;
+	combined += ')';
+
+	boost::regex single;
+	boost::regex result;
+
+	try {
+		single.assign(pattern);
+		result.assign(combined);
+	} catch (std::exception &) {
+		// Such pattern can not be combined with previous ones (i.e. because of named
+		// sub-expressions with the same name), so it will be checked separately
+		return;
+	}
+
+	route info = { index, m_mark_count + 1 };
+	m_routes.push_back(info);
+	if (m_combined.size() <= index)
+		m_combined.resize(index + 1, false);
+	m_combined[index] = true;
+	m_mark_count += single.mark_count() + 1;
+	m_pattern.swap(combined);
+	m_regex.swap(result);
+}
+
+bool regex_router::contains(size_t index) const
+{
+	return index < m_combined.size() && m_combined[index];
+}
+
+size_t regex_router::find_first(const std::string &path) const
+{
+	if (m_routes.empty())
+		return npos;
+
+	boost::smatch match;
+	if (!boost::regex_match(path, match, m_regex))
+		return npos;
+
+	for (auto it = m_routes.begin(); it != m_routes.end(); ++it) {
+		if (match[it->mark].matched)
+			return it->index;
+	}
+
+	return npos;
+}
+
+bool regex_router::has_back_references(const std::string &pattern)
+{
+	for (size_t i = 0; i + 1 < pattern.size(); ++i) {
+		const char ch = pattern[i];
+		const char next = pattern[i + 1];
+
+		if (ch == '\\') {
+			// \1-\9, \g{1}, \g-1, \k<name>
+			if ((next >= '1' && next <= '9') || next == 'g' || next == 'k')
+				return true;
+			++i;
+		} else if (ch == '(' && next == '?' && i + 2 < pattern.size()) {
+			// (?1), (?-1), (?+1), (?R), (?&name), (?P=name), (?P>name), (?(1)...), (?(<name>)...)
+			const char kind = pattern[i + 2];
+			if ((kind >= '0' && kind <= '9') || kind == '-' || kind == '+'
+				|| kind == 'R' || kind == '&' || kind == 'P' || kind == '(') {
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+} } // namespace ioremap::thevoid
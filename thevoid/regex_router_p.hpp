@@ -0,0 +1,87 @@
+/*
+ * Copyright 2015+ Ruslan Nigmatullin <euroelessar@yandex.ru>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef IOREMAP_THEVOID_REGEX_ROUTER_P_HPP
+#define IOREMAP_THEVOID_REGEX_ROUTER_P_HPP
+
+#include <boost/regex.hpp>
+
+#include <string>
+#include <vector>
+
+namespace ioremap {
+namespace thevoid {
+
+/*!
+ * \internal
+ *
+ * \brief The regex_router class matches path against all regex routes at once.
+ *
+ * Every pattern registered by add() is wrapped into it's own marked sub-expression
+ * and all of them are joined into the single alternation. Alternatives are tried
+ * in order of registration, so the first marked sub-expression which took part
+ * in the full match is the route with the lowest index.
+ *
+ * Patterns with back references can not be renumbered safely, so they are not
+ * combined and must be checked by the route itself.
+ */
+class regex_router
+{
+public:
+	enum : size_t {
+		npos = size_t(-1)
+	};
+
+	regex_router();
+
+	/*!
+	 * \brief Adds \a pattern of the route at \a index.
+	 *
+	 * Routes must be added in ascending order of their indexes.
+	 */
+	void add(size_t index, const std::string &pattern);
+
+	/*!
+	 * \brief Returns true if route at \a index is the part of combined expression.
+	 */
+	bool contains(size_t index) const;
+
+	/*!
+	 * \brief Returns index of the first route which pattern matches the whole \a path.
+	 *
+	 * If there is no such route npos is returned.
+	 */
+	size_t find_first(const std::string &path) const;
+
+private:
+	struct route
+	{
+		size_t index;
+		size_t mark;
+	};
+
+	static bool has_back_references(const std::string &pattern);
+
+	std::vector<route> m_routes;
+	std::vector<bool> m_combined;
+	std::string m_pattern;
+	size_t m_mark_count;
+	boost::regex m_regex;
+};
+
+} } // namespace ioremap::thevoid
+
+#endif // IOREMAP_THEVOID_REGEX_ROUTER_P_HPP
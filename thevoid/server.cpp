@@ -68,7 +68,8 @@ server_data::server_data(base_server *server) :
 	monitor_acceptors(new acceptors_list<monitor_connection>(*this)),
 	daemonize(false),
 	safe_mode(false),
-	options_parsed(false)
+	options_parsed(false),
+	access_log(logger)
 {
 	swarm::utils::logger::init_attributes(base_logger);
 }
@@ -89,14 +90,79 @@ void server_data::handle_stop()
 
 void server_data::handle_reload()
 {
+	access_log.reopen();
 }
 
 boost::asio::io_service &server_data::get_worker_service()
 {
 	const uint id = (threads_round_robin++ % threads_count);
+	workers_statistics[id]->connections.fetch_add(1, std::memory_order_relaxed);
 	return *worker_io_services[id];
 }
 
+struct worker_probe
+{
+	worker_statistics *statistics;
+
+	void operator() () const
+	{
+		const uint64_t start = statistics->probe_start.load(std::memory_order_relaxed);
+		statistics->loop_lag.store(worker_statistics::now() - start, std::memory_order_relaxed);
+		statistics->probe_start.store(0, std::memory_order_relaxed);
+	}
+};
+
+void server_data::probe_workers()
+{
+	for (size_t i = 0; i < workers_statistics.size(); ++i) {
+		worker_statistics &statistics = *workers_statistics[i];
+
+		uint64_t expected = 0;
+		if (!statistics.probe_start.compare_exchange_strong(expected, worker_statistics::now()))
+			continue;
+
+		worker_probe probe = { &statistics };
+		worker_io_services[i]->post(probe);
+	}
+}
+
+size_t server_data::find_handler(const http_request &request) const
+{
+	// Combined regex is evaluated only once we reach the first regex handler,
+	// all regex handlers before the first matched one are known to fail.
+	bool regex_evaluated = false;
+	size_t regex_index = regex_router::npos;
+
+	for (size_t i = 0; i < handlers.size(); ++i) {
+		const auto &options = handlers[i].first;
+		bool matched;
+
+		if (!handlers_regex.contains(i)) {
+			matched = options.check(request);
+		} else {
+			if (!regex_evaluated) {
+				regex_index = handlers_regex.find_first(request.url().path());
+				regex_evaluated = true;
+			}
+
+			if (regex_index == regex_router::npos || i < regex_index) {
+				continue;
+			} else if (i == regex_index) {
+				matched = options.check(request, true);
+			} else {
+				// The first regex handler didn't satisfy other conditions
+				matched = options.check(request);
+			}
+		}
+
+		if (matched) {
+			return i;
+		}
+	}
+
+	return no_handler;
+}
+
 pid_file::pid_file(const std::string &path) : m_path(path), m_file(NULL)
 {
 }
@@ -268,6 +334,13 @@ bool base_server::initialize_logger(const rapidjson::Value &config)
 
 void base_server::on(base_server::options &&opts, const std::shared_ptr<base_stream_factory> &factory)
 {
+	const std::string &pattern = opts.regex_pattern();
+	if (!pattern.empty()) {
+		m_data->handlers_regex.add(m_data->handlers.size(), pattern);
+	}
+
+	// Every worker thread has it's own shard, all other threads share the first one
+	m_data->handlers_statistics.emplace_back(new route_statistics(opts.description(), m_data->threads_count + 1));
 	m_data->handlers.emplace_back(std::move(opts), factory);
 }
 
@@ -357,12 +430,14 @@ struct io_service_runner
 {
 	boost::asio::io_service *service;
 	const char *name;
+	size_t statistics_shard;
 
 	void operator() () const
 	{
 #ifdef __linux__
 		prctl(PR_SET_NAME, name);
 #endif
+		route_statistics::set_thread_shard(statistics_shard);
 		service->run();
 	}
 };
@@ -492,9 +567,18 @@ int base_server::parse_arguments(int argc, char **argv)
 
 	for (size_t i = 0; i < m_data->threads_count; ++i) {
 		m_data->worker_io_services.emplace_back(new boost::asio::io_service(1));
+		m_data->workers_statistics.emplace_back(new worker_statistics);
 		m_data->worker_works.emplace_back(new boost::asio::io_service::work(*m_data->worker_io_services[i]));
 	}
 
+	if (config.HasMember("access_log")) {
+		std::string error;
+		if (!m_data->access_log.configure(config["access_log"], m_data->threads_count, error)) {
+			BH_LOG(logger(), SWARM_LOG_ERROR, "%s", error.c_str());
+			return -8;
+		}
+	}
+
 	try {
 		for (auto it = endpoints.Begin(); it != endpoints.End(); ++it) {
 			listen(it->GetString());
@@ -565,15 +649,19 @@ int base_server::run()
 	m_data->worker_works.emplace_back(new boost::asio::io_service::work(*m_data->monitor_io_service));
 	m_data->worker_works.emplace_back(new boost::asio::io_service::work(*m_data->io_service));
 
+	m_data->access_log.start();
+
 	std::vector<std::unique_ptr<boost::thread> > threads;
 	io_service_runner runner;
 	runner.name = "void_worker";
 
 	for (size_t i = 0; i < m_data->threads_count; ++i) {
 		runner.service = m_data->worker_io_services[i].get();
+		runner.statistics_shard = i + 1;
 		m_data->worker_threads.emplace_back(new boost::thread(runner));
 	}
 
+	runner.statistics_shard = 0;
 	runner.name = "void_monitor";
 	runner.service = m_data->monitor_io_service.get();
 	threads.emplace_back(new boost::thread(runner));
@@ -592,6 +680,7 @@ int base_server::run()
 	m_data->tcp_acceptors.reset();
 	m_data->monitor_acceptors.reset();
 	m_data->pid.reset();
+	m_data->access_log.stop();
 
 	return 0;
 }
@@ -608,11 +697,9 @@ void base_server::reload()
 
 std::shared_ptr<base_stream_factory> base_server::factory(const http_request &request)
 {
-	for (auto it = m_data->handlers.begin(); it != m_data->handlers.end(); ++it) {
-		if (it->first.check(request)) {
-			return it->second;
-		}
-	}
+	const size_t index = m_data->find_handler(request);
+	if (index != server_data::no_handler)
+		return m_data->handlers[index].second;
 
 	return std::shared_ptr<base_stream_factory>();
 }
@@ -306,6 +306,27 @@ protected:
 		 * \brief Returns true if request satisfies all conditions.
 		 */
 		bool check(const http_request &request) const;
+		/*!
+		 * \internal
+		 * \brief Returns true if request satisfies all conditions.
+		 *
+		 * Regular expression is not evaluated, \a regex_matched is used as it's result instead.
+		 */
+		bool check(const http_request &request, bool regex_matched) const;
+
+		/*!
+		 * \internal
+		 * \brief Returns regular expression set by set_regex_match or empty string.
+		 */
+		const std::string &regex_pattern() const;
+
+		/*!
+		 * \internal
+		 * \brief Returns human-readable description of the route, i.e. "GET /ping".
+		 *
+		 * It's used as route's name in monitoring statistics.
+		 */
+		std::string description() const;
 
 		/*!
 		 * \brief Swaps this options with \a other.
@@ -313,6 +334,8 @@ protected:
 		void swap(options &other);
 
 	private:
+		bool check_impl(const http_request &request, const bool *regex_matched) const;
+
 		std::unique_ptr<server_options_private> m_data;
 	};
 
@@ -387,6 +410,22 @@ protected:
 		base_server::on(std::move(opts), std::make_shared<stream_factory<Server, T>>(static_cast<Server *>(this)));
 	}
 
+	/*!
+	 * \brief Add new handler of type \a T with options \a args, handlers are reused between requests.
+	 *
+	 * It's the same as on() except that finished handlers are not destroyed but reset
+	 * by base_request_stream::reset() and reused for next requests.
+	 *
+	 * \sa pooled_stream_factory
+	 */
+	template <typename T, typename... Options>
+	void on_pooled(Options &&...args)
+	{
+		options opts;
+		options_pass(apply_option(opts, args)...);
+		base_server::on(std::move(opts), std::make_shared<pooled_stream_factory<Server, T>>(static_cast<Server *>(this)));
+	}
+
 private:
 	/*!
 	 * \internal
@@ -18,9 +18,12 @@
 #define IOREMAP_THEVOID_SERVER_P_HPP
 
 #include "server.hpp"
+#include "access_log_p.hpp"
 #include "acceptorlist_p.hpp"
 #include "connection_p.hpp"
 #include "monitor_connection_p.hpp"
+#include "regex_router_p.hpp"
+#include "statistics_p.hpp"
 
 #include <mutex>
 #include <set>
@@ -61,6 +64,22 @@ public:
 
 	boost::asio::io_service &get_worker_service();
 
+	enum : size_t {
+		no_handler = size_t(-1)
+	};
+
+	/*!
+	 * \brief Returns index of the first handler which accepts \a request or no_handler.
+	 */
+	size_t find_handler(const http_request &request) const;
+
+	/*!
+	 * \brief Posts probe to every worker's event loop to measure it's lag.
+	 *
+	 * The probe isn't posted if previous one is still pending.
+	 */
+	void probe_workers();
+
 	//! Logger instance
 	swarm::logger_base base_logger;
 	swarm::logger logger;
@@ -77,6 +96,8 @@ public:
 	std::vector<std::unique_ptr<boost::asio::io_service>> worker_io_services;
 	std::vector<std::unique_ptr<boost::asio::io_service::work>> worker_works;
 	std::vector<std::unique_ptr<boost::thread>> worker_threads;
+	//! Counters of workers' event loops, indexes are the same as in worker_io_services
+	std::vector<std::unique_ptr<worker_statistics>> workers_statistics;
 	//! Size of workers thread pool
 	std::atomic_uint threads_round_robin;
 	unsigned int threads_count;
@@ -88,6 +109,10 @@ public:
 	std::unique_ptr<acceptors_list<monitor_connection>> monitor_acceptors;
 	//! User handlers for urls
 	std::vector<std::pair<base_server::options, factory_ptr>> handlers;
+	//! All regex handlers combined into the single expression
+	regex_router handlers_regex;
+	//! Per-handler counters and latency histograms, indexes are the same as in handlers
+	std::vector<std::unique_ptr<route_statistics>> handlers_statistics;
 	//! User id change to during deamonization
 	boost::optional<uid_t> user_id;
 	bool daemonize;
@@ -103,6 +128,9 @@ public:
 
 	//! Request headers to log
 	std::vector<std::string> log_request_headers;
+
+	//! Access log written from the background thread, it's disabled by default
+	async_access_log access_log;
 };
 
 }}
@@ -0,0 +1,267 @@
+/*
+ * Copyright 2015+ Ruslan Nigmatullin <euroelessar@yandex.ru>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "statistics_p.hpp"
+
+#include <algorithm>
+
+#include <time.h>
+
+namespace ioremap {
+namespace thevoid {
+
+static __thread size_t current_thread_shard = 0;
+
+latency_histogram::latency_histogram() : m_count(0), m_sum(0), m_max(0)
+{
+	for (size_t i = 0; i < bucket_count; ++i)
+		m_buckets[i] = 0;
+}
+
+void latency_histogram::add(uint64_t value)
+{
+	m_buckets[bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+	m_count.fetch_add(1, std::memory_order_relaxed);
+	m_sum.fetch_add(value, std::memory_order_relaxed);
+
+	uint64_t max = m_max.load(std::memory_order_relaxed);
+	while (max < value && !m_max.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+	}
+}
+
+size_t latency_histogram::bucket_index(uint64_t value)
+{
+	if (value < sub_bucket_count)
+		return value;
+
+	const size_t msb = 63 - __builtin_clzll(value);
+	if (msb >= max_value_bits)
+		return bucket_count - 1;
+
+	const size_t shift = msb - sub_bucket_bits;
+	const size_t minor = (value >> shift) - sub_bucket_count;
+
+	return (shift + 1) * sub_bucket_count + minor;
+}
+
+uint64_t latency_histogram::bucket_lower_bound(size_t index)
+{
+	if (index < sub_bucket_count)
+		return index;
+
+	const size_t shift = index / sub_bucket_count - 1;
+	const size_t minor = index % sub_bucket_count;
+
+	return uint64_t(sub_bucket_count + minor) << shift;
+}
+
+latency_snapshot::latency_snapshot() :
+	m_buckets(latency_histogram::bucket_count, 0), m_count(0), m_sum(0), m_max(0)
+{
+}
+
+void latency_snapshot::merge(const latency_histogram &histogram)
+{
+	for (size_t i = 0; i < m_buckets.size(); ++i)
+		m_buckets[i] += histogram.m_buckets[i].load(std::memory_order_relaxed);
+
+	m_count += histogram.m_count.load(std::memory_order_relaxed);
+	m_sum += histogram.m_sum.load(std::memory_order_relaxed);
+	m_max = std::max(m_max, histogram.m_max.load(std::memory_order_relaxed));
+}
+
+uint64_t latency_snapshot::count() const
+{
+	return m_count;
+}
+
+uint64_t latency_snapshot::sum() const
+{
+	return m_sum;
+}
+
+uint64_t latency_snapshot::max() const
+{
+	return m_max;
+}
+
+double latency_snapshot::mean() const
+{
+	return m_count ? double(m_sum) / m_count : 0;
+}
+
+uint64_t latency_snapshot::quantile(double quantile) const
+{
+	uint64_t total = 0;
+	for (auto it = m_buckets.begin(); it != m_buckets.end(); ++it)
+		total += *it;
+
+	if (total == 0)
+		return 0;
+
+	const uint64_t rank = std::max<uint64_t>(1, uint64_t(quantile * total + 0.5));
+	uint64_t seen = 0;
+
+	for (size_t i = 0; i < m_buckets.size(); ++i) {
+		seen += m_buckets[i];
+		if (seen >= rank) {
+			// Report the upper bound of the bucket, but never more than the real maximum
+			const uint64_t upper = i + 1 < m_buckets.size()
+				? latency_histogram::bucket_lower_bound(i + 1) - 1
+				: m_max;
+			return std::min(upper, m_max);
+		}
+	}
+
+	return m_max;
+}
+
+uint64_t latency_snapshot::count_below(uint64_t value) const
+{
+	const size_t last = latency_histogram::bucket_index(value);
+	uint64_t result = 0;
+
+	for (size_t i = 0; i <= last; ++i)
+		result += m_buckets[i];
+
+	return result;
+}
+
+struct route_statistics::shard
+{
+	shard() : requests(0), received(0), sent(0)
+	{
+		for (size_t i = 0; i < status_class_count; ++i)
+			statuses[i] = 0;
+	}
+
+	std::atomic<uint64_t> requests;
+	std::atomic<uint64_t> statuses[status_class_count];
+	std::atomic<uint64_t> received;
+	std::atomic<uint64_t> sent;
+	latency_histogram total_time;
+	latency_histogram first_byte_time;
+	latency_histogram handler_time;
+};
+
+route_statistics::snapshot::snapshot() : requests(0), received(0), sent(0)
+{
+	std::fill(statuses, statuses + status_class_count, 0);
+}
+
+route_statistics::route_statistics(const std::string &name, size_t shards_count) : m_name(name)
+{
+	m_shards.resize(std::max<size_t>(1, shards_count));
+	for (auto it = m_shards.begin(); it != m_shards.end(); ++it)
+		it->reset(new shard);
+}
+
+route_statistics::~route_statistics()
+{
+}
+
+const std::string &route_statistics::name() const
+{
+	return m_name;
+}
+
+void route_statistics::add(const record &info)
+{
+	shard &data = *m_shards[current_thread_shard % m_shards.size()];
+
+	size_t status = info.status / 100;
+	if (status >= status_class_count)
+		status = status_other;
+
+	data.requests.fetch_add(1, std::memory_order_relaxed);
+	data.statuses[status].fetch_add(1, std::memory_order_relaxed);
+	data.received.fetch_add(info.received, std::memory_order_relaxed);
+	data.sent.fetch_add(info.sent, std::memory_order_relaxed);
+	data.total_time.add(info.total_time);
+	data.first_byte_time.add(info.first_byte_time);
+	data.handler_time.add(info.handler_time);
+}
+
+route_statistics::snapshot route_statistics::get_snapshot() const
+{
+	snapshot result;
+
+	for (auto it = m_shards.begin(); it != m_shards.end(); ++it) {
+		const shard &data = **it;
+
+		result.requests += data.requests.load(std::memory_order_relaxed);
+		for (size_t i = 0; i < status_class_count; ++i)
+			result.statuses[i] += data.statuses[i].load(std::memory_order_relaxed);
+		result.received += data.received.load(std::memory_order_relaxed);
+		result.sent += data.sent.load(std::memory_order_relaxed);
+		result.total_time.merge(data.total_time);
+		result.first_byte_time.merge(data.first_byte_time);
+		result.handler_time.merge(data.handler_time);
+	}
+
+	return result;
+}
+
+const char *route_statistics::status_class_name(size_t status)
+{
+	switch (status) {
+	case status_1xx:
+		return "1xx";
+	case status_2xx:
+		return "2xx";
+	case status_3xx:
+		return "3xx";
+	case status_4xx:
+		return "4xx";
+	case status_5xx:
+		return "5xx";
+	default:
+		return "other";
+	}
+}
+
+void route_statistics::set_thread_shard(size_t shard)
+{
+	current_thread_shard = shard;
+}
+
+size_t route_statistics::thread_shard()
+{
+	return current_thread_shard;
+}
+
+worker_statistics::worker_statistics() : connections(0), probe_start(0), loop_lag(0)
+{
+}
+
+uint64_t worker_statistics::current_loop_lag(uint64_t now) const
+{
+	const uint64_t start = probe_start.load(std::memory_order_relaxed);
+	if (start != 0 && now > start)
+		return std::max<uint64_t>(now - start, loop_lag.load(std::memory_order_relaxed));
+
+	return loop_lag.load(std::memory_order_relaxed);
+}
+
+uint64_t worker_statistics::now()
+{
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+
+	return uint64_t(time.tv_sec) * 1000000 + time.tv_nsec / 1000;
+}
+
+} } // namespace ioremap::thevoid
@@ -0,0 +1,208 @@
+/*
+ * Copyright 2015+ Ruslan Nigmatullin <euroelessar@yandex.ru>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef IOREMAP_THEVOID_STATISTICS_P_HPP
+#define IOREMAP_THEVOID_STATISTICS_P_HPP
+
+#include <blackhole/utils/atomic.hpp>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ioremap {
+namespace thevoid {
+
+/*!
+ * \internal
+ *
+ * \brief The latency_histogram class is a log-linear histogram of microsecond values.
+ *
+ * Values less than 16 have their own buckets, every next power of two is split
+ * into 16 equal buckets, so relative error of any quantile is less than 1/16.
+ * Values above ~9.5 hours are accounted in the last bucket.
+ *
+ * Counters are updated by relaxed atomic operations, so histogram may be safely
+ * read while it's being updated.
+ */
+class latency_histogram
+{
+public:
+	enum : size_t {
+		sub_bucket_bits = 4,
+		sub_bucket_count = 1 << sub_bucket_bits,
+		max_value_bits = 35,
+		bucket_count = (max_value_bits - sub_bucket_bits + 1) * sub_bucket_count
+	};
+
+	latency_histogram();
+
+	void add(uint64_t value);
+
+	static size_t bucket_index(uint64_t value);
+	static uint64_t bucket_lower_bound(size_t index);
+
+private:
+	friend class latency_snapshot;
+
+	std::atomic<uint64_t> m_buckets[bucket_count];
+	std::atomic<uint64_t> m_count;
+	std::atomic<uint64_t> m_sum;
+	std::atomic<uint64_t> m_max;
+};
+
+/*!
+ * \internal
+ *
+ * \brief The latency_snapshot class is a merged non-atomic copy of several histograms.
+ */
+class latency_snapshot
+{
+public:
+	latency_snapshot();
+
+	void merge(const latency_histogram &histogram);
+
+	uint64_t count() const;
+	uint64_t sum() const;
+	uint64_t max() const;
+	double mean() const;
+	/*!
+	 * \brief Returns value at \a quantile (0..1), it's accurate within the bucket's width.
+	 */
+	uint64_t quantile(double quantile) const;
+
+	/*!
+	 * \brief Returns number of values in buckets up to the one containing \a value.
+	 *
+	 * It's exact only for the last value of the bucket, otherwise greater values
+	 * of the same bucket are counted too.
+	 */
+	uint64_t count_below(uint64_t value) const;
+
+private:
+	std::vector<uint64_t> m_buckets;
+	uint64_t m_count;
+	uint64_t m_sum;
+	uint64_t m_max;
+};
+
+/*!
+ * \internal
+ *
+ * \brief The route_statistics class contains counters of the single handler.
+ *
+ * Counters are split into several shards, every worker thread updates only
+ * it's own one, so there is no contention on hot path.
+ * All shards are merged on demand by snapshot().
+ */
+class route_statistics
+{
+public:
+	enum status_class {
+		status_other,
+		status_1xx,
+		status_2xx,
+		status_3xx,
+		status_4xx,
+		status_5xx,
+		status_class_count
+	};
+
+	struct record
+	{
+		int status;
+		uint64_t received;
+		uint64_t sent;
+		//! All times are in microseconds
+		uint64_t total_time;
+		uint64_t first_byte_time;
+		uint64_t handler_time;
+	};
+
+	struct snapshot
+	{
+		snapshot();
+
+		uint64_t requests;
+		uint64_t statuses[status_class_count];
+		uint64_t received;
+		uint64_t sent;
+		latency_snapshot total_time;
+		latency_snapshot first_byte_time;
+		latency_snapshot handler_time;
+	};
+
+	route_statistics(const std::string &name, size_t shards_count);
+	~route_statistics();
+
+	const std::string &name() const;
+
+	void add(const record &info);
+	snapshot get_snapshot() const;
+
+	static const char *status_class_name(size_t status);
+
+	/*!
+	 * \brief Sets index of shard used by current thread.
+	 *
+	 * Server sets it for every worker thread, all other threads use the shard 0.
+	 */
+	static void set_thread_shard(size_t shard);
+	/*!
+	 * \brief Returns index of shard used by current thread, it's worker's index plus one.
+	 */
+	static size_t thread_shard();
+
+private:
+	struct shard;
+
+	std::string m_name;
+	std::vector<std::unique_ptr<shard>> m_shards;
+};
+
+/*!
+ * \internal
+ *
+ * \brief The worker_statistics struct contains counters of the single worker's event loop.
+ */
+struct worker_statistics
+{
+	worker_statistics();
+
+	//! Number of connections ever assigned to the worker
+	std::atomic<uint64_t> connections;
+	//! Monotonic time in microseconds when the probe was posted, zero if there is no pending probe
+	std::atomic<uint64_t> probe_start;
+	//! Time in microseconds which the last probe spent in the worker's queue
+	std::atomic<uint64_t> loop_lag;
+
+	/*!
+	 * \brief Returns current event loop lag in microseconds.
+	 *
+	 * If the probe is still pending it's age is returned, so stuck loop is visible immediately.
+	 */
+	uint64_t current_loop_lag(uint64_t now) const;
+
+	/*!
+	 * \brief Returns monotonic time in microseconds.
+	 */
+	static uint64_t now();
+};
+
+} } // namespace ioremap::thevoid
+
+#endif // IOREMAP_THEVOID_STATISTICS_P_HPP
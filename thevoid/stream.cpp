@@ -49,13 +49,27 @@ base_request_stream::~base_request_stream()
 {
 }
 
+void base_request_stream::reset()
+{
+}
+
 void base_request_stream::initialize(const std::shared_ptr<reply_stream> &reply)
 {
 	m_reply = reply;
-	m_logger.reset(new swarm::logger(reply->create_logger()));
+	if (m_logger)
+		*m_logger = reply->create_logger();
+	else
+		m_logger.reset(new swarm::logger(reply->create_logger()));
 	m_data->logger_attributes = reply->get_logger_attributes();
 }
 
+void base_request_stream::recycle()
+{
+	m_reply.reset();
+	m_data->logger_attributes = NULL;
+	reset();
+}
+
 void base_request_stream::virtual_hook(base_request_stream::request_stream_hook id, void *data)
 {
 	(void) id;
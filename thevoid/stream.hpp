@@ -30,6 +30,46 @@ namespace ioremap {
 namespace thevoid {
 
 namespace detail {
+/*!
+ * \internal
+ *
+ * \brief The scoped_attributes_ref class pushes attributes to the thread's scope by reference.
+ *
+ * Unlike blackhole::scoped_attributes_t it doesn't copy \a attributes, so they must outlive the guard.
+ * Attributes are copied only to be merged with the parent scope if there is one.
+ */
+class scoped_attributes_ref : public blackhole::scoped_attributes_concept_t
+{
+public:
+	scoped_attributes_ref(swarm::logger &logger, const blackhole::log::attributes_t &attributes) :
+		blackhole::scoped_attributes_concept_t(logger), m_attributes(attributes)
+	{
+	}
+
+	virtual const blackhole::log::attributes_t &attributes() const
+	{
+		if (__builtin_expect(!has_parent(), true))
+			return m_attributes;
+
+		// Referenced attributes may change while the guard is alive, so they are merged every time
+		const blackhole::log::attributes_t &parent_attributes = parent().attributes();
+		m_merged = m_attributes;
+		m_merged.insert(parent_attributes.begin(), parent_attributes.end());
+
+		return m_merged;
+	}
+
+private:
+	const blackhole::log::attributes_t &m_attributes;
+	mutable blackhole::log::attributes_t m_merged;
+};
+
+/*!
+ * \internal
+ *
+ * Pushes referenced attributes to the scope for the call, used by connection for it's own
+ * completion handlers. They are called by connection's thread, which is the only one changing them.
+ */
 template <typename Method>
 struct attributes_bind_handler
 {
@@ -40,7 +80,7 @@ struct attributes_bind_handler
 	template <typename... Args>
 	void operator() (Args &&...args)
 	{
-		blackhole::scoped_attributes_t logger_guard(*logger, blackhole::log::attributes_t(*attributes));
+		scoped_attributes_ref logger_guard(*logger, *attributes);
 		method(std::forward<Args>(args)...);
 	}
 };
@@ -55,6 +95,38 @@ attributes_bind_handler<typename std::remove_reference<Method>::type> attributes
 		std::forward<Method>(method)
 	};
 }
+
+/*!
+ * \internal
+ *
+ * Owns copies of logger and attributes taken when the handler is created, so it may be called
+ * later and by any thread, while connection changes it's attributes for the next request.
+ */
+template <typename Method>
+struct attributes_copy_handler
+{
+	swarm::logger logger;
+	blackhole::log::attributes_t attributes;
+	Method method;
+
+	template <typename... Args>
+	void operator() (Args &&...args)
+	{
+		scoped_attributes_ref logger_guard(logger, attributes);
+		method(std::forward<Args>(args)...);
+	}
+};
+
+template <typename Method>
+attributes_copy_handler<typename std::remove_reference<Method>::type> attributes_copy_bind(
+	const swarm::logger &logger, const blackhole::log::attributes_t &attributes, Method &&method)
+{
+	return {
+		logger,
+		attributes,
+		std::forward<Method>(method)
+	};
+}
 }
 
 /*!
@@ -253,10 +325,28 @@ public:
 	 */
 	virtual void on_close(const boost::system::error_code &err) = 0;
 
+	/*!
+	 * \brief Restores initial state of the stream so it may be reused for the next request.
+	 *
+	 * It's called only for streams registered by server::on_pooled as soon as the last
+	 * reference to the stream is released. Reimplement it if your stream has own state,
+	 * allocated memory may be kept (i.e. by clear() of vectors and strings).
+	 * Implementation must call the base class's one.
+	 *
+	 * \sa pooled_stream_factory
+	 */
+	virtual void reset();
+
 	/*!
 	 * \internal
 	 */
 	void initialize(const std::shared_ptr<reply_stream> &reply);
+	/*!
+	 * \internal
+	 *
+	 * Releases the reply stream and calls reset(), logger is kept to be rebound by initialize().
+	 */
+	void recycle();
 
 	/*!
 	 * \brief Returns the logger.
@@ -271,10 +361,15 @@ public:
 
 	virtual void virtual_hook(request_stream_hook id, void *data);
 
+	/*!
+	 * \brief Returns \a handler which is called with request's logger attributes in the scope.
+	 *
+	 * Logger and attributes are copied by this call, so the handler may be called by any thread.
+	 */
 	template <typename Method>
-	detail::attributes_bind_handler<typename std::remove_reference<Method>::type> wrap(Method handler)
+	detail::attributes_copy_handler<typename std::remove_reference<Method>::type> wrap(Method handler)
 	{
-		return detail::attributes_bind(*m_logger, *logger_attributes(), std::move(handler));
+		return detail::attributes_copy_bind(*m_logger, *logger_attributes(), std::move(handler));
 	}
 
 protected:
@@ -498,6 +593,16 @@ public:
 	 */
 	virtual void on_request(const http_request &req, const boost::asio::const_buffer &buffer) = 0;
 
+	/*!
+	 * \brief Clears the request and it's data keeping the allocated memory.
+	 */
+	virtual void reset()
+	{
+		request_stream<Server>::reset();
+		m_request.clear();
+		m_data.clear();
+	}
+
 protected:
 	/*!
 	 * \brief Returns const reference to ioremap::http_request associated initiated this handler.
@@ -514,7 +619,7 @@ private:
 	void on_headers(http_request &&req)
 	{
 		m_request = std::move(req);
-		if (auto tmp = req.headers().content_length())
+		if (auto tmp = m_request.headers().content_length())
 			m_data.reserve(*tmp);
 	}
 
@@ -599,6 +704,21 @@ public:
 	 */
 	virtual void on_error(const boost::system::error_code &err) = 0;
 
+	/*!
+	 * \brief Restores default chunk size and clears the request and the chunk keeping it's memory.
+	 */
+	virtual void reset()
+	{
+		request_stream<Server>::reset();
+		m_request.clear();
+		m_data.clear();
+		m_chunk_size = 10 * 1024;
+		m_real_chunk_size = 0;
+		m_client_asked_chunk = false;
+		m_first_chunk = true;
+		m_last_chunk = false;
+	}
+
 protected:
 	/*!
 	 * \brief Returns the request initiated this handler.
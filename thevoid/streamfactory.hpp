@@ -19,6 +19,10 @@
 
 #include "stream.hpp"
 
+#include <boost/thread/tss.hpp>
+
+#include <vector>
+
 namespace ioremap {
 namespace thevoid {
 
@@ -52,6 +56,118 @@ private:
 	Server *m_server;
 };
 
+/*!
+ * \brief The pooled_stream_factory class recycles streams instead of creating new one for every request.
+ *
+ * As soon as the last reference to the stream is released it's reset by base_request_stream::reset()
+ * and is put to the free list of the thread which released it. Next request processed by the same
+ * worker thread reuses it, so memory allocated by the stream for the previous request is reused too.
+ * Request of simple and buffered streams is swapped with the connection's one by on_headers, so the
+ * connection parses the next request into the cleared request object and it's headers vector.
+ * Strings of headers are allocated again.
+ *
+ * At most \a pool_size streams are kept by every thread. Streams are kept only by threads which create
+ * them, so ones released by other threads, e.g. by url_fetcher's callbacks, are destroyed instead of
+ * piling up in free lists which are never used.
+ *
+ * \sa server::on_pooled
+ */
+template <typename Server, typename T>
+class pooled_stream_factory : public base_stream_factory
+{
+public:
+	enum {
+		default_pool_size = 1024
+	};
+
+	pooled_stream_factory(Server *server, size_t pool_size = default_pool_size) :
+		m_server(server), m_pool(std::make_shared<pool>(pool_size))
+	{
+	}
+	~pooled_stream_factory() /*override*/ {}
+
+	std::shared_ptr<base_request_stream> create() /*override*/
+	{
+		if (__builtin_expect(!m_server, false))
+			throw std::logic_error("pooled_stream_factory::m_server is null pointer");
+
+		std::unique_ptr<T> stream = m_pool->pop();
+		if (!stream) {
+			stream.reset(new T);
+			stream->set_server(m_server);
+		}
+
+		// Pool is referenced by the deleter as stream may outlive the factory
+		return std::shared_ptr<T>(stream.release(), recycler { m_pool });
+	}
+
+private:
+	class pool
+	{
+	public:
+		typedef std::vector<std::unique_ptr<T>> free_list;
+
+		pool(size_t max_size) : m_max_size(max_size)
+		{
+		}
+
+		// Thread gets it's free list by the first stream it takes from the pool
+		std::unique_ptr<T> pop()
+		{
+			free_list *list = m_lists.get();
+			if (!list) {
+				list = new free_list;
+				m_lists.reset(list);
+			}
+
+			if (list->empty())
+				return std::unique_ptr<T>();
+
+			std::unique_ptr<T> stream = std::move(list->back());
+			list->pop_back();
+			return stream;
+		}
+
+		/*
+		 * Takes the ownership of the stream only if there is a room for it. Threads which never
+		 * take streams from the pool have no free list, streams released by them are destroyed.
+		 */
+		void push(std::unique_ptr<T> &stream)
+		{
+			free_list *list = m_lists.get();
+			if (!list)
+				return;
+
+			if (list->size() < m_max_size)
+				list->emplace_back(std::move(stream));
+		}
+
+	private:
+		size_t m_max_size;
+		boost::thread_specific_ptr<free_list> m_lists;
+	};
+
+	struct recycler
+	{
+		std::shared_ptr<pool> m_pool;
+
+		void operator() (T *pointer) const
+		{
+			std::unique_ptr<T> stream(pointer);
+
+			// Stream which failed to reset itself is destroyed
+			try {
+				stream->recycle();
+				m_pool->push(stream);
+			} catch (...) {
+			}
+		}
+	};
+
+	Server *m_server;
+	std::shared_ptr<pool> m_pool;
+};
+
 }} // namespace ioremap::thevoid
 
 #endif // IOREMAP_THEVOID_STREAMFACTORY_HPP
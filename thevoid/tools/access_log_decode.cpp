@@ -0,0 +1,113 @@
+/*
+ * Copyright 2015+ Ruslan Nigmatullin <euroelessar@yandex.ru>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <thevoid/access_log_p.hpp>
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include <boost/program_options.hpp>
+
+using namespace ioremap;
+
+/*
+ * Converts binary access log written by thevoid server to text or json lines.
+ */
+int main(int argc, char *argv[])
+{
+	namespace po = boost::program_options;
+
+	std::string input;
+	std::string format;
+
+	po::options_description description("Options");
+	description.add_options()
+		("help", "this help message")
+		("input,i", po::value<std::string>(&input), "binary access log path, stdin is used by default")
+		("format,f", po::value<std::string>(&format)->default_value("text"), "output format: text or json")
+		;
+
+	po::positional_options_description positional;
+	positional.add("input", 1);
+
+	po::variables_map options;
+	try {
+		po::store(po::command_line_parser(argc, argv).options(description).positional(positional).run(), options);
+		po::notify(options);
+	} catch (std::exception &e) {
+		std::cerr << e.what() << std::endl;
+		std::cerr << description << std::endl;
+		return 1;
+	}
+
+	if (options.count("help")) {
+		std::cerr << description << std::endl;
+		return 1;
+	}
+
+	if (format != "text" && format != "json") {
+		std::cerr << "unknown format: " << format << std::endl;
+		return 1;
+	}
+	const bool json = (format == "json");
+
+	FILE *file = stdin;
+	if (!input.empty()) {
+		file = fopen(input.c_str(), "rb");
+		if (!file) {
+			std::cerr << "failed to open " << input << ": " << strerror(errno) << std::endl;
+			return 1;
+		}
+	}
+
+	thevoid::access_log_file_header header;
+	if (fread(&header, sizeof(header), 1, file) != 1 || !header.is_valid()) {
+		std::cerr << "invalid access log header, expected version "
+			<< thevoid::access_log_file_header::current_version
+			<< " with record size " << sizeof(thevoid::access_log_record) << std::endl;
+		return 1;
+	}
+
+	thevoid::access_log_record record;
+	std::string output;
+	size_t count = 0;
+
+	while (fread(&record, sizeof(record), 1, file) == 1) {
+		if (json)
+			thevoid::format_access_log_json(record, output);
+		else
+			thevoid::format_access_log_text(record, output);
+
+		if (++count % 1024 == 0) {
+			fwrite(output.data(), 1, output.size(), stdout);
+			output.clear();
+		}
+	}
+
+	fwrite(output.data(), 1, output.size(), stdout);
+
+	if (!feof(file)) {
+		std::cerr << "failed to read access log: " << strerror(errno) << std::endl;
+		return 1;
+	}
+
+	if (file != stdin)
+		fclose(file);
+
+	return 0;
+}